@@ -0,0 +1,102 @@
+/*
+
+  Copyright (c) 2018 Martin Sustrik
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"),
+  to deal in the Software without restriction, including without limitation
+  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+  and/or sell copies of the Software, and to permit persons to whom
+  the Software is furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included
+  in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+  IN THE SOFTWARE.
+
+*/
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "alloc.h"
+#include "utils.h"
+
+#define DILL_DISABLE_RAW_NAMES
+#include "libdill.h"
+
+/* User-supplied allocator. If NULL, the standard C library is used. */
+static struct dill_allocator dill_allocator_;
+static int dill_allocator_set = 0;
+/* Set once anything was allocated. The allocator can't be changed afterwards
+   because the memory would be deallocated by a different allocator than the
+   one that allocated it. */
+static int dill_allocator_used = 0;
+
+int dill_set_allocator(const struct dill_allocator *a) {
+    if(dill_slow(a && (!a->alloc || !a->free))) {errno = EINVAL; return -1;}
+    if(dill_slow(dill_allocator_used)) {errno = EBUSY; return -1;}
+    if(a) dill_allocator_ = *a;
+    dill_allocator_set = a ? 1 : 0;
+    return 0;
+}
+
+void *dill_alloc(size_t size, int kind) {
+    return dill_alloc_aligned(size, 0, kind);
+}
+
+void *dill_alloc_aligned(size_t size, size_t align, int kind) {
+    dill_allocator_used = 1;
+    void *ptr;
+    if(dill_slow(dill_allocator_set)) {
+        ptr = dill_allocator_.alloc(dill_allocator_.opaque, size, align, kind);
+    }
+    else if(align) {
+#if HAVE_POSIX_MEMALIGN
+        int rc = posix_memalign(&ptr, align, size);
+        if(dill_slow(rc != 0)) ptr = NULL;
+#else
+        /* Aligning the block by hand would require dill_free() to tell
+           such blocks from the others. */
+        errno = ENOTSUP;
+        return NULL;
+#endif
+    }
+    else {
+        ptr = malloc(size);
+    }
+    if(dill_slow(!ptr)) errno = ENOMEM;
+    return ptr;
+}
+
+void *dill_realloc(void *ptr, size_t oldsize, size_t size, int kind) {
+    if(dill_fast(!dill_allocator_set)) {
+        dill_allocator_used = 1;
+        void *p = realloc(ptr, size);
+        if(dill_slow(!p)) errno = ENOMEM;
+        return p;
+    }
+    /* The user-supplied allocator has no realloc function. */
+    void *p = dill_alloc(size, kind);
+    if(dill_slow(!p)) return NULL;
+    if(ptr) {
+        memcpy(p, ptr, oldsize < size ? oldsize : size);
+        dill_free(ptr, oldsize, kind);
+    }
+    return p;
+}
+
+void dill_free(void *ptr, size_t size, int kind) {
+    if(dill_slow(!ptr)) return;
+    if(dill_slow(dill_allocator_set))
+        dill_allocator_.free(dill_allocator_.opaque, ptr, size, kind);
+    else
+        free(ptr);
+}
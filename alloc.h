@@ -0,0 +1,46 @@
+/*
+
+  Copyright (c) 2018 Martin Sustrik
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"),
+  to deal in the Software without restriction, including without limitation
+  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+  and/or sell copies of the Software, and to permit persons to whom
+  the Software is furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included
+  in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+  IN THE SOFTWARE.
+
+*/
+
+#ifndef DILL_ALLOC_INCLUDED
+#define DILL_ALLOC_INCLUDED
+
+#include <stddef.h>
+
+/* All the memory allocated by libdill is allocated via these functions.
+   'kind' is one of DILL_ALLOC_* constants. The size of the memory block has
+   to be supplied when deallocating it. On failure, the allocation functions
+   return NULL and set errno to ENOMEM. */
+
+void *dill_alloc(size_t size, int kind);
+
+/* 'align' must be a power of two multiple of sizeof(void*). Unless there's
+   a user-supplied allocator, fails with ENOTSUP on platforms without
+   posix_memalign(). */
+void *dill_alloc_aligned(size_t size, size_t align, int kind);
+
+void *dill_realloc(void *ptr, size_t oldsize, size_t size, int kind);
+
+void dill_free(void *ptr, size_t size, int kind);
+
+#endif
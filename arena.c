@@ -0,0 +1,128 @@
+/*
+
+  Copyright (c) 2016 Martin Sustrik
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"),
+  to deal in the Software without restriction, including without limitation
+  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+  and/or sell copies of the Software, and to permit persons to whom
+  the Software is furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included
+  in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+  IN THE SOFTWARE.
+
+*/
+
+#include <errno.h>
+
+#include "alloc.h"
+#include "arena.h"
+#include "utils.h"
+
+#define DILL_DISABLE_RAW_NAMES
+#include "libdill.h"
+
+struct dill_arena_chunk {
+    struct dill_slist item;
+    /* Size of the chunk, including this header. */
+    size_t size;
+} __attribute__((aligned(16)));
+
+/* Allocations bigger than this get a dedicated chunk so that big blocks
+   don't waste the rest of the current standard chunk. */
+#define DILL_ARENA_MAXBUMP \
+    ((DILL_ARENA_CHUNKSIZE - sizeof(struct dill_arena_chunk)) / 4)
+
+void dill_arena_cache_init(struct dill_arena_cache *cache) {
+    dill_slist_init(&cache->chunks);
+    cache->count = 0;
+}
+
+void dill_arena_cache_term(struct dill_arena_cache *cache) {
+    while(!dill_slist_empty(&cache->chunks)) {
+        struct dill_slist *it = dill_slist_pop(&cache->chunks);
+        dill_free(it, DILL_ARENA_CHUNKSIZE, DILL_ALLOC_ARENA);
+    }
+    cache->count = 0;
+}
+
+void dill_arena_init(struct dill_arena *self) {
+    dill_slist_init(&self->chunks);
+    self->pos = NULL;
+    self->left = 0;
+}
+
+static struct dill_arena_chunk *dill_arena_chunk(
+      struct dill_arena_cache *cache, size_t size) {
+    struct dill_arena_chunk *ch;
+    if(size == DILL_ARENA_CHUNKSIZE && !dill_slist_empty(&cache->chunks)) {
+        struct dill_slist *it = dill_slist_pop(&cache->chunks);
+        ch = dill_cont(it, struct dill_arena_chunk, item);
+        --cache->count;
+        return ch;
+    }
+    /* malloc() alignment is good for any object type, there's no need
+       to ask for more. */
+    ch = dill_alloc(size, DILL_ALLOC_ARENA);
+    if(dill_slow(!ch)) return NULL;
+    ch->size = size;
+    return ch;
+}
+
+void *dill_arena_alloc(struct dill_arena_cache *cache, struct dill_arena *self,
+      size_t size) {
+    /* Round the size up to keep the blocks aligned. */
+    size_t sz = (size + 15) & ~(size_t)15;
+    if(dill_slow(sz < size)) {errno = ENOMEM; return NULL;}
+    if(dill_fast(sz <= self->left)) {
+        void *ptr = self->pos;
+        self->pos += sz;
+        self->left -= sz;
+        return ptr;
+    }
+    if(sz > DILL_ARENA_MAXBUMP) {
+        size_t chsz = sizeof(struct dill_arena_chunk) + sz;
+        if(dill_slow(chsz < sz)) {errno = ENOMEM; return NULL;}
+        struct dill_arena_chunk *ch = dill_arena_chunk(cache, chsz);
+        if(dill_slow(!ch)) return NULL;
+        dill_slist_push(&self->chunks, &ch->item);
+        return ch + 1;
+    }
+    /* Start a new standard chunk. Whatever is left in the old one is
+       wasted, but it's less than a quarter of the chunk. */
+    struct dill_arena_chunk *ch = dill_arena_chunk(cache,
+        DILL_ARENA_CHUNKSIZE);
+    if(dill_slow(!ch)) return NULL;
+    dill_slist_push(&self->chunks, &ch->item);
+    self->pos = (uint8_t*)(ch + 1) + sz;
+    self->left = DILL_ARENA_CHUNKSIZE - sizeof(struct dill_arena_chunk) - sz;
+    return ch + 1;
+}
+
+void dill_arena_release(struct dill_arena_cache *cache,
+      struct dill_arena *self) {
+    while(!dill_slist_empty(&self->chunks)) {
+        struct dill_slist *it = dill_slist_pop(&self->chunks);
+        struct dill_arena_chunk *ch =
+            dill_cont(it, struct dill_arena_chunk, item);
+        if(ch->size == DILL_ARENA_CHUNKSIZE &&
+              cache->count < DILL_ARENA_CACHECAP) {
+            dill_slist_push(&cache->chunks, &ch->item);
+            ++cache->count;
+            continue;
+        }
+        dill_free(ch, ch->size, DILL_ALLOC_ARENA);
+    }
+    self->pos = NULL;
+    self->left = 0;
+}
+
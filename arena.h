@@ -0,0 +1,70 @@
+/*
+
+  Copyright (c) 2016 Martin Sustrik
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"),
+  to deal in the Software without restriction, including without limitation
+  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+  and/or sell copies of the Software, and to permit persons to whom
+  the Software is furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included
+  in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+  IN THE SOFTWARE.
+
+*/
+
+#ifndef DILL_ARENA_INCLUDED
+#define DILL_ARENA_INCLUDED
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "slist.h"
+
+/* Size of a standard arena chunk, including its header. Allocations that
+   don't comfortably fit into a standard chunk get a dedicated chunk. */
+#define DILL_ARENA_CHUNKSIZE 4096
+/* Maximum number of unused standard chunks cached per thread. */
+#define DILL_ARENA_CACHECAP 64
+
+/* Bump allocator. The memory is released all at once. */
+struct dill_arena {
+    /* Chunks owned by the arena, most recently allocated first. */
+    struct dill_slist chunks;
+    /* Unused part of the current standard chunk. */
+    uint8_t *pos;
+    size_t left;
+};
+
+/* Unused standard chunks shared by all the arenas in the thread. */
+struct dill_arena_cache {
+    struct dill_slist chunks;
+    int count;
+};
+
+void dill_arena_cache_init(struct dill_arena_cache *cache);
+void dill_arena_cache_term(struct dill_arena_cache *cache);
+
+void dill_arena_init(struct dill_arena *self);
+
+/* Returns a 16-byte aligned block of 'size' bytes. Sets errno to ENOMEM
+   on failure. */
+void *dill_arena_alloc(struct dill_arena_cache *cache, struct dill_arena *self,
+    size_t size);
+
+/* Deallocates all the memory allocated from the arena. Standard chunks are
+   returned to the cache. The arena can be reused afterwards. */
+void dill_arena_release(struct dill_arena_cache *cache,
+    struct dill_arena *self);
+
+#endif
+
@@ -0,0 +1,283 @@
+/*
+
+  Copyright (c) 2018 Martin Sustrik
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"),
+  to deal in the Software without restriction, including without limitation
+  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+  and/or sell copies of the Software, and to permit persons to whom
+  the Software is furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included
+  in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+  IN THE SOFTWARE.
+
+*/
+
+#include <limits.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "alloc.h"
+#include "cr.h"
+#include "list.h"
+#include "slab.h"
+#include "utils.h"
+
+#define DILL_DISABLE_RAW_NAMES
+#include "libdillimpl.h"
+
+/* Broadcast channel keeps the last 'capacity' published messages in a ring
+   buffer. Each subscriber has its own cursor into the stream of messages,
+   so publishing is O(1) irrespective of the number of subscribers.
+
+   Subscribers blocked in dill_bcast_recv() are woken up in a chain: the
+   publisher wakes only the first one and each woken subscriber, once it's
+   scheduled, wakes the next one. Thus, all the subscribers are resumed within
+   a single pass of the scheduler while the publisher doesn't have to
+   iterate over them. */
+
+dill_unique_id(dill_bcast_type);
+dill_unique_id(dill_bcast_sub_type);
+
+struct dill_bcast {
+    /* Table of virtual functions. */
+    struct dill_hvfs vfs;
+    /* Subscribers blocked in dill_bcast_recv(). */
+    struct dill_list waiters;
+    size_t elemsize;
+    size_t capacity;
+    /* Number of messages published so far. */
+    uint64_t seq;
+    /* Number of open subscriber handles. */
+    int nsubs;
+    /* 1 if the publisher handle was closed. */
+    unsigned int closed : 1;
+    uint8_t data[];
+};
+
+struct dill_bcast_sub {
+    /* Table of virtual functions. */
+    struct dill_hvfs vfs;
+    struct dill_bcast *bc;
+    /* Sequence number of the next message to receive. */
+    uint64_t cursor;
+    /* Maximum number of unreceived messages before messages are dropped. */
+    size_t maxlag;
+    int flags;
+    /* Clause of the coroutine blocked in dill_bcast_recv(), if any. */
+    struct dill_bcast_clause *waiter;
+    /* 1 if the coroutine blocked in dill_bcast_recv() was resumed but hasn't
+       run yet. The subscriber can't be deallocated till it does. */
+    unsigned int busy : 1;
+    /* 1 if the handle was closed while the subscriber was busy. */
+    unsigned int closed : 1;
+};
+
+struct dill_bcast_clause {
+    struct dill_clause cl;
+    /* An item in dill_bcast::waiters list. */
+    struct dill_list item;
+    struct dill_bcast_sub *sub;
+    /* Cursor of the blocked subscriber. */
+    uint64_t cursor;
+};
+
+static void dill_bcast_free(struct dill_bcast *self) {
+    dill_assert(dill_list_empty(&self->waiters));
+    dill_free(self, sizeof(struct dill_bcast) +
+        self->elemsize * self->capacity, DILL_ALLOC_CHANBUF);
+}
+
+/* Wakes up the first blocked subscriber if there's a new message for it. */
+static void dill_bcast_relay(struct dill_bcast *self) {
+    if(dill_list_empty(&self->waiters)) return;
+    struct dill_bcast_clause *bccl = dill_cont(dill_list_next(&self->waiters),
+        struct dill_bcast_clause, item);
+    if(bccl->cursor < self->seq) dill_trigger(&bccl->cl, 0);
+}
+
+/******************************************************************************/
+/*  Publisher.                                                                */
+/******************************************************************************/
+
+static void *dill_bcast_hquery(struct dill_hvfs *vfs, const void *type);
+static void dill_bcast_hclose(struct dill_hvfs *vfs);
+
+int dill_bcast(size_t elemsize, size_t capacity) {
+    int err;
+    if(dill_slow(capacity == 0)) {err = EINVAL; goto error1;}
+    if(dill_slow(elemsize > (SIZE_MAX / 2) / capacity)) {
+        err = ENOMEM; goto error1;}
+    struct dill_bcast *self = dill_alloc(sizeof(struct dill_bcast) +
+        elemsize * capacity, DILL_ALLOC_CHANBUF);
+    if(dill_slow(!self)) {err = ENOMEM; goto error1;}
+    self->vfs.query = dill_bcast_hquery;
+    self->vfs.close = dill_bcast_hclose;
+    dill_list_init(&self->waiters);
+    self->elemsize = elemsize;
+    self->capacity = capacity;
+    self->seq = 0;
+    self->nsubs = 0;
+    self->closed = 0;
+    int h = dill_hmake(&self->vfs);
+    if(dill_slow(h < 0)) {err = errno; goto error2;}
+    return h;
+error2:
+    dill_bcast_free(self);
+error1:
+    errno = err;
+    return -1;
+}
+
+static void *dill_bcast_hquery(struct dill_hvfs *vfs, const void *type) {
+    if(dill_fast(type == dill_bcast_type)) return vfs;
+    errno = ENOTSUP;
+    return NULL;
+}
+
+static void dill_bcast_hclose(struct dill_hvfs *vfs) {
+    struct dill_bcast *self = (struct dill_bcast*)vfs;
+    self->closed = 1;
+    /* Blocked subscribers will never get a new message. */
+    while(!dill_list_empty(&self->waiters)) {
+        struct dill_bcast_clause *bccl = dill_cont(
+            dill_list_next(&self->waiters), struct dill_bcast_clause, item);
+        dill_trigger(&bccl->cl, EPIPE);
+    }
+    /* Subscribers may still receive the buffered messages. */
+    if(!self->nsubs) dill_bcast_free(self);
+}
+
+int dill_bcast_send(int h, const void *val, size_t len) {
+    struct dill_bcast *self = dill_hquery(h, dill_bcast_type);
+    if(dill_slow(!self)) return -1;
+    if(dill_slow(len != self->elemsize)) {errno = EMSGSIZE; return -1;}
+    if(dill_slow(len > 0 && !val)) {errno = EINVAL; return -1;}
+    memcpy(self->data + (self->seq % self->capacity) * self->elemsize,
+        val, len);
+    ++self->seq;
+    dill_bcast_relay(self);
+    return 0;
+}
+
+/******************************************************************************/
+/*  Subscriber.                                                               */
+/******************************************************************************/
+
+static void *dill_bcast_sub_hquery(struct dill_hvfs *vfs, const void *type);
+static void dill_bcast_sub_hclose(struct dill_hvfs *vfs);
+
+int dill_bcast_subscribe(int h, size_t maxlag, int flags) {
+    int err;
+    struct dill_bcast *bc = dill_hquery(h, dill_bcast_type);
+    if(dill_slow(!bc)) {err = errno; goto error1;}
+    if(dill_slow(flags & ~DILL_BCAST_LATEST)) {err = EINVAL; goto error1;}
+    struct dill_bcast_sub *self = dill_slab_alloc(
+        sizeof(struct dill_bcast_sub));
+    if(dill_slow(!self)) {err = ENOMEM; goto error1;}
+    self->vfs.query = dill_bcast_sub_hquery;
+    self->vfs.close = dill_bcast_sub_hclose;
+    self->bc = bc;
+    /* The subscriber will get only the messages published from now on. */
+    self->cursor = bc->seq;
+    self->maxlag = maxlag == 0 || maxlag > bc->capacity ?
+        bc->capacity : maxlag;
+    self->flags = flags;
+    self->waiter = NULL;
+    self->busy = 0;
+    self->closed = 0;
+    int sh = dill_hmake(&self->vfs);
+    if(dill_slow(sh < 0)) {err = errno; goto error2;}
+    ++bc->nsubs;
+    return sh;
+error2:
+    dill_slab_free(self, sizeof(struct dill_bcast_sub));
+error1:
+    errno = err;
+    return -1;
+}
+
+static void *dill_bcast_sub_hquery(struct dill_hvfs *vfs, const void *type) {
+    if(dill_fast(type == dill_bcast_sub_type)) return vfs;
+    errno = ENOTSUP;
+    return NULL;
+}
+
+static void dill_bcast_sub_free(struct dill_bcast_sub *self) {
+    struct dill_bcast *bc = self->bc;
+    --bc->nsubs;
+    if(bc->closed && !bc->nsubs) dill_bcast_free(bc);
+    dill_slab_free(self, sizeof(struct dill_bcast_sub));
+}
+
+static void dill_bcast_sub_hclose(struct dill_hvfs *vfs) {
+    struct dill_bcast_sub *self = (struct dill_bcast_sub*)vfs;
+    if(self->waiter) dill_trigger(&self->waiter->cl, EBADF);
+    /* The resumed coroutine will deallocate the subscriber once it runs. */
+    if(self->busy) {self->closed = 1; return;}
+    dill_bcast_sub_free(self);
+}
+
+static void dill_bcast_cancel(struct dill_clause *cl) {
+    struct dill_bcast_clause *bccl = dill_cont(cl,
+        struct dill_bcast_clause, cl);
+    dill_list_erase(&bccl->item);
+    bccl->sub->waiter = NULL;
+    bccl->sub->busy = 1;
+}
+
+int dill_bcast_recv(int h, void *val, size_t len, int64_t deadline) {
+    int rc = dill_canblock();
+    if(dill_slow(rc < 0)) return -1;
+    struct dill_bcast_sub *self = dill_hquery(h, dill_bcast_sub_type);
+    if(dill_slow(!self)) return -1;
+    struct dill_bcast *bc = self->bc;
+    if(dill_slow(len != bc->elemsize)) {errno = EMSGSIZE; return -1;}
+    if(dill_slow(len > 0 && !val)) {errno = EINVAL; return -1;}
+    if(self->cursor == bc->seq) {
+        if(dill_slow(bc->closed)) {errno = EPIPE; return -1;}
+        if(dill_slow(deadline == 0)) {errno = ETIMEDOUT; return -1;}
+        /* Wait for a new message. */
+        struct dill_bcast_clause bccl;
+        dill_list_insert(&bccl.item, &bc->waiters);
+        bccl.sub = self;
+        bccl.cursor = self->cursor;
+        self->waiter = &bccl;
+        dill_waitfor(&bccl.cl, 0, dill_bcast_cancel, DILL_CLAUSE_CHAN);
+        struct dill_tmclause tmcl;
+        dill_timer(&tmcl, 1, deadline);
+        int id = dill_wait();
+        self->busy = 0;
+        if(dill_slow(self->closed)) {
+            dill_bcast_sub_free(self);
+            errno = EBADF;
+            return -1;
+        }
+        if(dill_slow(id < 0)) return -1;
+        if(dill_slow(id == 1)) {errno = ETIMEDOUT; return -1;}
+        if(dill_slow(errno != 0)) return -1;
+        /* Pass the wakeup on to the next blocked subscriber. */
+        dill_bcast_relay(bc);
+    }
+    /* If the subscriber is lagging too far behind, drop the messages. */
+    uint64_t dropped = 0;
+    if(dill_slow(bc->seq - self->cursor > self->maxlag)) {
+        uint64_t cursor = self->flags & DILL_BCAST_LATEST ?
+            bc->seq - 1 : bc->seq - self->maxlag;
+        dropped = cursor - self->cursor;
+        self->cursor = cursor;
+    }
+    memcpy(val, bc->data + (self->cursor % bc->capacity) * bc->elemsize, len);
+    ++self->cursor;
+    return dropped > INT_MAX ? INT_MAX : (int)dropped;
+}
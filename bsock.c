@@ -30,6 +30,7 @@
 #include "utils.h"
 
 dill_unique_id(dill_bsock_type);
+dill_unique_id(dill_bpeek_type);
 
 int dill_bsend(int s, const void *buf, size_t len, int64_t deadline) {
     struct dill_bsock_vfs *b = dill_hquery(s, dill_bsock_type);
@@ -63,3 +64,16 @@ int dill_brecvl(int s, struct dill_iolist *first, struct dill_iolist *last,
     return b->brecvl(b, first, last, deadline);
 }
 
+int dill_bpeek(int s, const void **buf, size_t *len, int64_t deadline) {
+    struct dill_bpeek_vfs *p = dill_hquery(s, dill_bpeek_type);
+    if(dill_slow(!p)) return -1;
+    if(dill_slow(!buf || !len)) {errno = EINVAL; return -1;}
+    return p->bpeek(p, buf, len, deadline);
+}
+
+int dill_bconsume(int s, size_t len) {
+    struct dill_bpeek_vfs *p = dill_hquery(s, dill_bpeek_type);
+    if(dill_slow(!p)) return -1;
+    return p->bconsume(p, len);
+}
+
@@ -27,14 +27,28 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "alloc.h"
 #include "cr.h"
 #include "ctx.h"
 #include "list.h"
+#include "pollset.h"
+#include "slab.h"
 #include "utils.h"
 
 #define DILL_DISABLE_RAW_NAMES
 #include "libdillimpl.h"
 
+/* Ring buffer of a buffered channel. */
+struct dill_chbuf {
+    size_t elemsize;
+    size_t capacity;
+    /* Index of the oldest message in the buffer. */
+    size_t first;
+    /* Number of messages in the buffer. */
+    size_t count;
+    uint8_t data[];
+};
+
 struct dill_halfchan {
     /* Table of virtual functions. */
     struct dill_hvfs vfs;
@@ -42,6 +56,11 @@ struct dill_halfchan {
     struct dill_list in;
     /* List of clauses wanting to send to the inbound halfchannel. */
     struct dill_list out;
+    /* Select set items interested in the readiness of this halfchannel. */
+    struct dill_list sel;
+    /* Messages sent to the inbound halfchannel but not yet received.
+       NULL for unbuffered channels. */
+    struct dill_chbuf *buf;
     /* Whether this is the fist or the second half-channel of the channel. */
     unsigned int index : 1;
     /* 1 if chdone() has been called on this channel. 0 otherwise. */
@@ -57,9 +76,16 @@ struct dill_chanclause {
     struct dill_clause cl;
     /* An item in either the dill_halfchan::in or dill_halfchan::out list. */
     struct dill_list item;
-    /* The object being passed via the channel. */
+    /* The halfchannel the above list belongs to. */
+    struct dill_halfchan *ch;
+    /* The objects being passed via the channel. There are 'count' objects,
+       each 'len' bytes long, stored back to back. */
     void *val;
     size_t len;
+    size_t count;
+    /* Number of objects actually transferred. Set before the clause is
+       triggered. */
+    size_t moved;
 };
 
 DILL_CT_ASSERT(sizeof(struct dill_chstorage) >=
@@ -74,6 +100,9 @@ const void *dill_halfchan_type = &dill_halfchan_type_placeholder;
 static void *dill_halfchan_query(struct dill_hvfs *vfs, const void *type);
 static void dill_halfchan_close(struct dill_hvfs *vfs);
 
+static void dill_chselect_update(struct dill_halfchan *ch);
+static void dill_chselect_detach(struct dill_halfchan *ch);
+
 /******************************************************************************/
 /*  Helpers.                                                                  */
 /******************************************************************************/
@@ -90,6 +119,8 @@ static void dill_halfchan_init(struct dill_halfchan *ch, int index) {
     ch->vfs.close = dill_halfchan_close;
     dill_list_init(&ch->in);
     dill_list_init(&ch->out);
+    dill_list_init(&ch->sel);
+    ch->buf = NULL;
     ch->index = index;
     ch->done = 0;
     ch->mem = 1;
@@ -118,7 +149,8 @@ error1:
 
 int dill_chmake(int chv[2]) {
     int err;
-    struct dill_chstorage *ch = malloc(sizeof(struct dill_chstorage));
+    struct dill_chstorage *ch = dill_slab_alloc(
+        sizeof(struct dill_chstorage));
     if(dill_slow(!ch)) {err = ENOMEM; goto error1;}
     int h = dill_chmake_mem(ch, chv);
     if(dill_slow(h < 0)) {err = errno; goto error2;}
@@ -126,7 +158,46 @@ int dill_chmake(int chv[2]) {
     ((struct dill_halfchan*)ch)[1].mem = 0;
     return h;
 error2:
-    free(ch);
+    dill_slab_free(ch, sizeof(struct dill_chstorage));
+error1:
+    errno = err;
+    return -1;
+}
+
+/* Size of the ring buffer, rounded up so that the next buffer is aligned. */
+static size_t dill_chbuf_size(size_t elemsize, size_t capacity) {
+    size_t sz = sizeof(struct dill_chbuf) + elemsize * capacity;
+    return (sz + sizeof(size_t) - 1) & ~(sizeof(size_t) - 1);
+}
+
+int dill_chmake_buffered(int chv[2], size_t elemsize, size_t capacity) {
+    int err;
+    if(dill_slow(!chv)) {err = EINVAL; goto error1;}
+    if(capacity == 0) return dill_chmake(chv);
+    if(dill_slow(elemsize > (SIZE_MAX / 4) / capacity)) {
+        err = ENOMEM; goto error1;}
+    /* Allocate the channel and the ring buffers for both directions in
+       a single chunk of memory. */
+    size_t bufsz = dill_chbuf_size(elemsize, capacity);
+    struct dill_chstorage *mem = dill_alloc(sizeof(struct dill_chstorage) +
+        2 * bufsz, DILL_ALLOC_CHANBUF);
+    if(dill_slow(!mem)) {err = ENOMEM; goto error1;}
+    int h = dill_chmake_mem(mem, chv);
+    if(dill_slow(h < 0)) {err = errno; goto error2;}
+    struct dill_halfchan *ch = (struct dill_halfchan*)mem;
+    int i;
+    for(i = 0; i != 2; ++i) {
+        ch[i].mem = 0;
+        ch[i].buf = (struct dill_chbuf*)(((uint8_t*)(mem + 1)) + i * bufsz);
+        ch[i].buf->elemsize = elemsize;
+        ch[i].buf->capacity = capacity;
+        ch[i].buf->first = 0;
+        ch[i].buf->count = 0;
+    }
+    return h;
+error2:
+    dill_free(mem, sizeof(struct dill_chstorage) + 2 * bufsz,
+        DILL_ALLOC_CHANBUF);
 error1:
     errno = err;
     return -1;
@@ -164,7 +235,15 @@ static void dill_halfchan_close(struct dill_hvfs *vfs) {
     if(ch->index) ch = dill_halfchan_other(ch);
     dill_halfchan_term(&ch[0]);
     dill_halfchan_term(&ch[1]);
-    if(!ch->mem) free(ch);
+    dill_chselect_detach(&ch[0]);
+    dill_chselect_detach(&ch[1]);
+    if(ch->mem) return;
+    /* Buffered channels have the ring buffers allocated in the same chunk of
+       memory, so they are not cached. */
+    if(ch->buf) dill_free(ch, sizeof(struct dill_chstorage) +
+        2 * dill_chbuf_size(ch->buf->elemsize, ch->buf->capacity),
+        DILL_ALLOC_CHANBUF);
+    else dill_slab_free(ch, sizeof(struct dill_chstorage));
 }
 
 /******************************************************************************/
@@ -174,85 +253,200 @@ static void dill_halfchan_close(struct dill_hvfs *vfs) {
 static void dill_chcancel(struct dill_clause *cl) {
     struct dill_chanclause *chcl = dill_cont(cl, struct dill_chanclause, cl);
     dill_list_erase(&chcl->item);
+    dill_chselect_update(chcl->ch);
 }
 
-int dill_chsend(int h, const void *val, size_t len, int64_t deadline) {
-    int rc = dill_canblock();
-    if(dill_slow(rc < 0)) return -1;
-    /* Get the channel interface. */
-    struct dill_halfchan *ch = dill_hquery(h, dill_halfchan_type);
-    if(dill_slow(!ch)) return -1;
-    /* Sending is always done to the opposite side of the channel. */
-    ch = dill_halfchan_other(ch);   
+/* Appends a message to the ring buffer. There must be space left. */
+static void dill_chbuf_push(struct dill_chbuf *buf, const void *val) {
+    size_t pos = buf->first + buf->count;
+    if(pos >= buf->capacity) pos -= buf->capacity;
+    memcpy(buf->data + pos * buf->elemsize, val, buf->elemsize);
+    ++buf->count;
+}
+
+/* Removes the oldest message from the ring buffer. It must not be empty. */
+static void dill_chbuf_pop(struct dill_chbuf *buf, void *val) {
+    memcpy(val, buf->data + buf->first * buf->elemsize, buf->elemsize);
+    ++buf->first;
+    if(buf->first == buf->capacity) buf->first = 0;
+    --buf->count;
+}
+
+/* Sends up to 'count' messages to the halfchannel, as many as can be sent
+   without blocking. Returns the number of messages sent. If no message can
+   be sent returns -1 and sets errno to EAGAIN. */
+static ssize_t dill_chsend_nb(struct dill_halfchan *ch, const void *val,
+      size_t len, size_t count) {
     /* Check if the channel is done. */
     if(dill_slow(ch->done)) {errno = EPIPE; return -1;}
-    /* Copy the message directly to the waiting receiver, if any. */
-    if(!dill_list_empty(&ch->in)) {
+    struct dill_chbuf *buf = ch->buf;
+    if(dill_slow(buf && len != buf->elemsize)) {errno = EMSGSIZE; return -1;}
+    const uint8_t *src = val;
+    size_t moved = 0;
+    /* Copy the messages directly to the waiting receivers, if any.
+       If the channel is buffered it means that the buffer is empty. */
+    while(moved < count && !dill_list_empty(&ch->in)) {
         struct dill_chanclause *chcl = dill_cont(dill_list_next(&ch->in),
             struct dill_chanclause, item);
         if(dill_slow(len != chcl->len)) {
+            /* Report the error once the messages sent so far are
+               accounted for. */
+            if(moved) return moved;
             dill_trigger(&chcl->cl, EMSGSIZE);
             errno = EMSGSIZE;
             return -1;
         }
-        memcpy(chcl->val, val, len);
+        size_t n = count - moved;
+        if(n > chcl->count) n = chcl->count;
+        memcpy(chcl->val, src + moved * len, n * len);
+        chcl->moved = n;
         dill_trigger(&chcl->cl, 0);
-        return 0;
+        moved += n;
+    }
+    /* Store the rest of the messages in the buffer, if there's space left. */
+    if(buf && moved < count && buf->count < buf->capacity) {
+        while(moved < count && buf->count < buf->capacity) {
+            dill_chbuf_push(buf, src + moved * len);
+            ++moved;
+        }
+        dill_chselect_update(ch);
+    }
+    if(!moved) {errno = EAGAIN; return -1;}
+    return moved;
+}
+
+/* Receives up to 'count' messages from the halfchannel, as many as can be
+   received without blocking. Returns the number of messages received. If no
+   message can be received returns -1 and sets errno to EAGAIN. */
+static ssize_t dill_chrecv_nb(struct dill_halfchan *ch, void *val,
+      size_t len, size_t count) {
+    uint8_t *dst = val;
+    size_t moved = 0;
+    /* Buffered messages can be received even if the channel is done. */
+    struct dill_chbuf *buf = ch->buf;
+    if(buf && buf->count) {
+        if(dill_slow(len != buf->elemsize)) {errno = EMSGSIZE; return -1;}
+        while(moved < count && buf->count) {
+            while(moved < count && buf->count) {
+                dill_chbuf_pop(buf, dst + moved * len);
+                ++moved;
+            }
+            /* There's space in the buffer now. Move the messages from
+               the blocked senders, if any, to the buffer. */
+            while(buf->count < buf->capacity && !dill_list_empty(&ch->out)) {
+                struct dill_chanclause *chcl = dill_cont(
+                    dill_list_next(&ch->out), struct dill_chanclause, item);
+                size_t n = 0;
+                while(n < chcl->count && buf->count < buf->capacity) {
+                    dill_chbuf_push(buf, (uint8_t*)chcl->val + n * len);
+                    ++n;
+                }
+                chcl->moved = n;
+                dill_trigger(&chcl->cl, 0);
+            }
+        }
+        dill_chselect_update(ch);
+        return moved;
     }
+    /* Check whether the channel is done. */
+    if(dill_slow(ch->done)) {errno = EPIPE; return -1;}
+    if(dill_slow(buf && len != buf->elemsize)) {errno = EMSGSIZE; return -1;}
+    /* If there are senders waiting, copy the messages directly
+       from the senders. */
+    while(moved < count && !dill_list_empty(&ch->out)) {
+        struct dill_chanclause *chcl = dill_cont(dill_list_next(&ch->out),
+            struct dill_chanclause, item);
+        if(dill_slow(len != chcl->len)) {
+            if(moved) return moved;
+            dill_trigger(&chcl->cl, EMSGSIZE);
+            errno = EMSGSIZE;
+            return -1;
+        }
+        size_t n = count - moved;
+        if(n > chcl->count) n = chcl->count;
+        memcpy(dst + moved * len, chcl->val, n * len);
+        chcl->moved = n;
+        dill_trigger(&chcl->cl, 0);
+        moved += n;
+    }
+    if(!moved) {errno = EAGAIN; return -1;}
+    return moved;
+}
+
+ssize_t dill_chsendv(int h, const void *vals, size_t len, size_t count,
+      int64_t deadline) {
+    int rc = dill_canblock();
+    if(dill_slow(rc < 0)) return -1;
+    /* Get the channel interface. */
+    struct dill_halfchan *ch = dill_hquery(h, dill_halfchan_type);
+    if(dill_slow(!ch)) return -1;
+    if(dill_slow(count == 0 || (len > 0 && !vals))) {
+        errno = EINVAL; return -1;}
+    /* Sending is always done to the opposite side of the channel. */
+    ch = dill_halfchan_other(ch);
+    ssize_t sz = dill_chsend_nb(ch, vals, len, count);
+    if(dill_fast(sz > 0)) return sz;
+    if(dill_slow(errno != EAGAIN)) return -1;
     /* The clause is not available immediately. */
     if(dill_slow(deadline == 0)) {errno = ETIMEDOUT; return -1;}
     /* Let's wait. */
     struct dill_chanclause chcl;
     dill_list_insert(&chcl.item, &ch->out);
-    chcl.val = (void*)val;
+    chcl.ch = ch;
+    chcl.val = (void*)vals;
     chcl.len = len;
-    dill_waitfor(&chcl.cl, 0, dill_chcancel);
+    chcl.count = count;
+    dill_chselect_update(ch);
+    dill_waitfor(&chcl.cl, 0, dill_chcancel, DILL_CLAUSE_CHAN);
     struct dill_tmclause tmcl;
     dill_timer(&tmcl, 1, deadline);
     int id = dill_wait();
     if(dill_slow(id < 0)) return -1;
     if(dill_slow(id == 1)) {errno = ETIMEDOUT; return -1;}
     if(dill_slow(errno != 0)) return -1;
-    return 0;
+    return chcl.moved;
 }
 
-int dill_chrecv(int h, void *val, size_t len, int64_t deadline) {
+ssize_t dill_chrecvv(int h, void *vals, size_t len, size_t count,
+      int64_t deadline) {
     int rc = dill_canblock();
     if(dill_slow(rc < 0)) return -1;
     /* Get the channel interface. */
     struct dill_halfchan *ch = dill_hquery(h, dill_halfchan_type);
     if(dill_slow(!ch)) return -1;
-    /* Check whether the channel is done. */
-    if(dill_slow(ch->done)) {errno = EPIPE; return -1;}
-    /* If there's a sender waiting, copy the message directly
-       from the sender. */
-    if(!dill_list_empty(&ch->out)) {
-        struct dill_chanclause *chcl = dill_cont(dill_list_next(&ch->out),
-            struct dill_chanclause, item);
-        if(dill_slow(len != chcl->len)) {
-            dill_trigger(&chcl->cl, EMSGSIZE);
-            errno = EMSGSIZE;
-            return -1;
-        }
-        memcpy(val, chcl->val, len);
-        dill_trigger(&chcl->cl, 0);
-        return 0;
-    }
+    if(dill_slow(count == 0 || (len > 0 && !vals))) {
+        errno = EINVAL; return -1;}
+    ssize_t sz = dill_chrecv_nb(ch, vals, len, count);
+    if(dill_fast(sz > 0)) return sz;
+    if(dill_slow(errno != EAGAIN)) return -1;
     /* The clause is not immediately available. */
     if(dill_slow(deadline == 0)) {errno = ETIMEDOUT; return -1;}
     /* Let's wait. */
     struct dill_chanclause chcl;
     dill_list_insert(&chcl.item, &ch->in);
-    chcl.val = val;
+    chcl.ch = ch;
+    chcl.val = vals;
     chcl.len = len;
-    dill_waitfor(&chcl.cl, 0, dill_chcancel);
+    chcl.count = count;
+    dill_chselect_update(ch);
+    dill_waitfor(&chcl.cl, 0, dill_chcancel, DILL_CLAUSE_CHAN);
     struct dill_tmclause tmcl;
     dill_timer(&tmcl, 1, deadline);
     int id = dill_wait();
     if(dill_slow(id < 0)) return -1;
     if(dill_slow(id == 1)) {errno = ETIMEDOUT; return -1;}
     if(dill_slow(errno != 0)) return -1;
-    return 0;
+    return chcl.moved;
+}
+
+int dill_chsend(int h, const void *val, size_t len, int64_t deadline) {
+    ssize_t sz = dill_chsendv(h, val, len, 1, deadline);
+    return sz < 0 ? -1 : 0;
+}
+
+int dill_chrecv(int h, void *val, size_t len, int64_t deadline) {
+    ssize_t sz = dill_chrecvv(h, val, len, 1, deadline);
+    return sz < 0 ? -1 : 0;
 }
 
 int dill_chdone(int h) {
@@ -262,6 +456,7 @@ int dill_chdone(int h) {
     ch = dill_halfchan_other(ch);
     if(ch->done) {errno = EPIPE; return -1;}
     ch->done = 1;
+    dill_chselect_update(ch);
     /* Resume any remaining senders and receivers on the channel
        with the EPIPE error. */
     while(!dill_list_empty(&ch->in)) {
@@ -282,61 +477,82 @@ int dill_choose(struct dill_chclause *clauses, int nclauses, int64_t deadline) {
     if(dill_slow(rc < 0)) return -1;
     if(dill_slow(nclauses < 0 || (nclauses != 0 && !clauses))) {
         errno = EINVAL; return -1;}
+    int nfds = 0;
     int i;
     for(i = 0; i != nclauses; ++i) {
         struct dill_chclause *cl = &clauses[i];
+        /* The readiness of file descriptors is checked by the pollset
+           while waiting. */
+        if(cl->op == DILL_FDIN || cl->op == DILL_FDOUT) {
+            if(dill_slow(cl->ch < 0)) {errno = EBADF; return i;}
+            ++nfds;
+            continue;
+        }
         struct dill_halfchan *ch = dill_hquery(cl->ch, dill_halfchan_type);
         if(dill_slow(!ch)) return i;
         if(dill_slow(cl->len > 0 && !cl->val)) {errno = EINVAL; return i;}
-        struct dill_chanclause *chcl;
         switch(cl->op) {
         case DILL_CHSEND:
-            ch = dill_halfchan_other(ch);
-            if(dill_slow(ch->done)) {errno = EPIPE; return i;}
-            if(dill_list_empty(&ch->in)) break;
-            chcl = dill_cont(dill_list_next(&ch->in),
-                struct dill_chanclause, item);
-            if(dill_slow(cl->len != chcl->len)) {
-                dill_trigger(&chcl->cl, EMSGSIZE);
-                errno = EMSGSIZE;
-                return i;
-            }
-            memcpy(chcl->val, cl->val, cl->len);
-            dill_trigger(&chcl->cl, 0);
-            errno = 0;
+            rc = dill_chsend_nb(dill_halfchan_other(ch), cl->val,
+                cl->len, 1);
+            if(rc < 0 && errno == EAGAIN) break;
+            if(rc > 0) errno = 0;
             return i;
         case DILL_CHRECV:
-            if(dill_slow(ch->done)) {errno = EPIPE; return i;}
-            if(dill_list_empty(&ch->out)) break;
-            chcl = dill_cont(dill_list_next(&ch->out),
-                struct dill_chanclause, item);
-            if(dill_slow(cl->len != chcl->len)) {
-                dill_trigger(&chcl->cl, EMSGSIZE);
-                errno = EMSGSIZE;
-                return i;
-            }
-            memcpy(cl->val, chcl->val, cl->len);
-            dill_trigger(&chcl->cl, 0);
-            errno = 0;
+            rc = dill_chrecv_nb(ch, cl->val, cl->len, 1);
+            if(rc < 0 && errno == EAGAIN) break;
+            if(rc > 0) errno = 0;
             return i;
         default:
             errno = EINVAL;
             return i;
         } 
     }
-    /* There are no clauses immediately available. */
-    if(dill_slow(deadline == 0)) {errno = ETIMEDOUT; return -1;}
+    /* There are no clauses immediately available. With zero deadline,
+       file descriptors still have to be polled once. */
+    if(dill_slow(deadline == 0 && !nfds)) {errno = ETIMEDOUT; return -1;}
     /* Let's wait. */
-    struct dill_chanclause chcls[nclauses];
+    union {
+        struct dill_chanclause ch;
+        struct dill_fdclause fd;
+    } cls[nclauses];
+    for(i = 0; i != nclauses; ++i) {
+        switch(clauses[i].op) {
+        case DILL_FDIN:
+            rc = dill_pollset_in(&cls[i].fd, i, clauses[i].ch, 0);
+            break;
+        case DILL_FDOUT:
+            rc = dill_pollset_out(&cls[i].fd, i, clauses[i].ch, 0);
+            break;
+        default:
+            continue;
+        }
+        if(dill_slow(rc < 0)) {
+            int err = errno;
+            dill_waitcancel();
+            errno = err;
+            return i;
+        }
+    }
     for(i = 0; i != nclauses; ++i) {
+        if(clauses[i].op != DILL_CHSEND && clauses[i].op != DILL_CHRECV)
+            continue;
         struct dill_halfchan *ch = dill_hquery(clauses[i].ch,
             dill_halfchan_type);
         dill_assert(ch);
-        dill_list_insert(&chcls[i].item, clauses[i].op == DILL_CHRECV ?
-            &ch->in : &dill_halfchan_other(ch)->out);
-        chcls[i].val = clauses[i].val;
-        chcls[i].len = clauses[i].len;
-        dill_waitfor(&chcls[i].cl, i, dill_chcancel);
+        if(clauses[i].op == DILL_CHRECV) {
+            dill_list_insert(&cls[i].ch.item, &ch->in);
+        }
+        else {
+            ch = dill_halfchan_other(ch);
+            dill_list_insert(&cls[i].ch.item, &ch->out);
+        }
+        cls[i].ch.ch = ch;
+        dill_chselect_update(ch);
+        cls[i].ch.val = clauses[i].val;
+        cls[i].ch.len = clauses[i].len;
+        cls[i].ch.count = 1;
+        dill_waitfor(&cls[i].ch.cl, i, dill_chcancel, DILL_CLAUSE_CHAN);
     }
     struct dill_tmclause tmcl;
     dill_timer(&tmcl, nclauses, deadline);
@@ -346,3 +562,262 @@ int dill_choose(struct dill_chclause *clauses, int nclauses, int64_t deadline) {
     return id;
 }
 
+
+/******************************************************************************/
+/*  Persistent select sets.                                                   */
+/******************************************************************************/
+
+static const int dill_chselect_type_placeholder = 0;
+const void *dill_chselect_type = &dill_chselect_type_placeholder;
+static void *dill_chselect_query(struct dill_hvfs *vfs, const void *type);
+static void dill_chselect_close(struct dill_hvfs *vfs);
+
+struct dill_chselect_slot {
+    struct dill_chselect_item *item;
+    /* Index of the next hole, if this slot is a hole. */
+    int next;
+};
+
+struct dill_chselect {
+    /* Table of virtual functions. */
+    struct dill_hvfs vfs;
+    /* Items whose operations can be performed without blocking. */
+    struct dill_list ready;
+    /* Clause of the coroutine blocked in dill_chselect_wait(), if any. */
+    struct dill_clause *waiter;
+    /* Registered items. Item ID is the index in this array. Removed items
+       leave holes that are reused by subsequent additions. */
+    struct dill_chselect_slot *items;
+    int nitems;
+    int capacity;
+    /* Linked list of holes. -1 means the list is empty. */
+    int unused;
+};
+
+struct dill_chselect_item {
+    struct dill_chselect *sel;
+    /* The halfchannel whose in or out list the item is interested in.
+       NULL if the channel was already closed. */
+    struct dill_halfchan *ch;
+    /* An item in dill_halfchan::sel list. */
+    struct dill_list chitem;
+    /* An item in dill_chselect::ready list. Points to itself if the item
+       is not ready. */
+    struct dill_list readyitem;
+    int id;
+    int op;
+    void *val;
+    size_t len;
+};
+
+static int dill_chselect_isready(struct dill_chselect_item *it) {
+    if(!it->ch || it->ch->done) return 1;
+    struct dill_chbuf *buf = it->ch->buf;
+    if(it->op == DILL_CHRECV)
+        return (buf && buf->count) || !dill_list_empty(&it->ch->out);
+    return (buf && buf->count < buf->capacity) ||
+        !dill_list_empty(&it->ch->in);
+}
+
+/* Moves the item to or from the list of ready items. */
+static void dill_chselect_mark(struct dill_chselect_item *item, int ready) {
+    int inlist = item->readyitem.next != &item->readyitem;
+    if(ready && !inlist) {
+        dill_list_insert(&item->readyitem, &item->sel->ready);
+        /* Wake up the waiting coroutine, if any. The cancel callback
+           of the clause resets the waiter. */
+        if(item->sel->waiter) dill_trigger(item->sel->waiter, 0);
+    }
+    else if(!ready && inlist) {
+        dill_list_erase(&item->readyitem);
+        dill_list_init(&item->readyitem);
+    }
+}
+
+/* Gets called each time a clause is added to or removed from one of the lists
+   of the halfchannel. The cost is proportional to the number of select set
+   items watching the halfchannel, which is typically zero or one. */
+static void dill_chselect_update(struct dill_halfchan *ch) {
+    struct dill_list *it;
+    for(it = dill_list_next(&ch->sel); it != &ch->sel;
+          it = dill_list_next(it)) {
+        struct dill_chselect_item *item = dill_cont(it,
+            struct dill_chselect_item, chitem);
+        dill_chselect_mark(item, dill_chselect_isready(item));
+    }
+}
+
+/* The channel is being deallocated. Items watching it are marked as ready
+   so that the user learns about the fact. */
+static void dill_chselect_detach(struct dill_halfchan *ch) {
+    while(!dill_list_empty(&ch->sel)) {
+        struct dill_chselect_item *item = dill_cont(dill_list_next(&ch->sel),
+            struct dill_chselect_item, chitem);
+        dill_list_erase(&item->chitem);
+        dill_list_init(&item->chitem);
+        item->ch = NULL;
+        dill_chselect_mark(item, 1);
+    }
+}
+
+int dill_chselect(void) {
+    int err;
+    struct dill_chselect *self = dill_slab_alloc(
+        sizeof(struct dill_chselect));
+    if(dill_slow(!self)) {err = ENOMEM; goto error1;}
+    self->vfs.query = dill_chselect_query;
+    self->vfs.close = dill_chselect_close;
+    dill_list_init(&self->ready);
+    self->waiter = NULL;
+    self->items = NULL;
+    self->nitems = 0;
+    self->capacity = 0;
+    self->unused = -1;
+    int h = dill_hmake(&self->vfs);
+    if(dill_slow(h < 0)) {err = errno; goto error2;}
+    return h;
+error2:
+    dill_slab_free(self, sizeof(struct dill_chselect));
+error1:
+    errno = err;
+    return -1;
+}
+
+static void *dill_chselect_query(struct dill_hvfs *vfs, const void *type) {
+    if(dill_fast(type == dill_chselect_type)) return vfs;
+    errno = ENOTSUP;
+    return NULL;
+}
+
+static void dill_chselect_free(struct dill_chselect_item *item) {
+    if(item->ch) dill_list_erase(&item->chitem);
+    if(item->readyitem.next != &item->readyitem)
+        dill_list_erase(&item->readyitem);
+    dill_slab_free(item, sizeof(struct dill_chselect_item));
+}
+
+static void dill_chselect_close(struct dill_hvfs *vfs) {
+    struct dill_chselect *self = (struct dill_chselect*)vfs;
+    /* Resume the coroutine blocked on the set, if any. The cancel callback
+       of its clause runs now, while the set still exists. */
+    if(self->waiter) dill_trigger(self->waiter, EBADF);
+    int i;
+    for(i = 0; i != self->nitems; ++i) {
+        if(self->items[i].item) dill_chselect_free(self->items[i].item);
+    }
+    dill_free(self->items, self->capacity * sizeof(struct dill_chselect_slot),
+        DILL_ALLOC_OBJECT);
+    dill_slab_free(self, sizeof(struct dill_chselect));
+}
+
+int dill_chselect_add(int h, struct dill_chclause *clause) {
+    struct dill_chselect *self = dill_hquery(h, dill_chselect_type);
+    if(dill_slow(!self)) return -1;
+    if(dill_slow(!clause || (clause->len > 0 && !clause->val) ||
+          (clause->op != DILL_CHSEND && clause->op != DILL_CHRECV))) {
+        errno = EINVAL; return -1;}
+    struct dill_halfchan *ch = dill_hquery(clause->ch, dill_halfchan_type);
+    if(dill_slow(!ch)) return -1;
+    /* Sending is always done to the opposite side of the channel. */
+    if(clause->op == DILL_CHSEND) ch = dill_halfchan_other(ch);
+    /* Find a slot for the new item. */
+    int id;
+    if(self->unused >= 0) {
+        id = self->unused;
+    }
+    else {
+        if(self->nitems == self->capacity) {
+            int capacity = self->capacity ? self->capacity * 2 : 64;
+            struct dill_chselect_slot *items = dill_realloc(self->items,
+                self->capacity * sizeof(struct dill_chselect_slot),
+                capacity * sizeof(struct dill_chselect_slot),
+                DILL_ALLOC_OBJECT);
+            if(dill_slow(!items)) return -1;
+            self->items = items;
+            self->capacity = capacity;
+        }
+        id = self->nitems;
+    }
+    struct dill_chselect_item *item = dill_slab_alloc(
+        sizeof(struct dill_chselect_item));
+    if(dill_slow(!item)) {errno = ENOMEM; return -1;}
+    item->sel = self;
+    item->ch = ch;
+    dill_list_insert(&item->chitem, &ch->sel);
+    dill_list_init(&item->readyitem);
+    item->id = id;
+    item->op = clause->op;
+    item->val = clause->val;
+    item->len = clause->len;
+    if(id == self->unused) self->unused = self->items[id].next;
+    else ++self->nitems;
+    self->items[id].item = item;
+    dill_chselect_mark(item, dill_chselect_isready(item));
+    return id;
+}
+
+int dill_chselect_rm(int h, int id) {
+    struct dill_chselect *self = dill_hquery(h, dill_chselect_type);
+    if(dill_slow(!self)) return -1;
+    if(dill_slow(id < 0 || id >= self->nitems || !self->items[id].item)) {
+        errno = EINVAL; return -1;}
+    dill_chselect_free(self->items[id].item);
+    self->items[id].item = NULL;
+    self->items[id].next = self->unused;
+    self->unused = id;
+    return 0;
+}
+
+/* Clause of a coroutine blocked in dill_chselect_wait(). */
+struct dill_chselect_clause {
+    struct dill_clause cl;
+    struct dill_chselect *sel;
+};
+
+/* Gets called when the coroutine is unblocked, whatever the reason. Once
+   that happens the select set must not trigger the clause anymore. */
+static void dill_chselect_cancel(struct dill_clause *cl) {
+    struct dill_chselect_clause *sc = dill_cont(cl,
+        struct dill_chselect_clause, cl);
+    sc->sel->waiter = NULL;
+}
+
+int dill_chselect_wait(int h, int64_t deadline) {
+    int rc = dill_canblock();
+    if(dill_slow(rc < 0)) return -1;
+    struct dill_chselect *self = dill_hquery(h, dill_chselect_type);
+    if(dill_slow(!self)) return -1;
+    if(dill_slow(self->waiter)) {errno = EBUSY; return -1;}
+    while(dill_list_empty(&self->ready)) {
+        if(dill_slow(deadline == 0)) {errno = ETIMEDOUT; return -1;}
+        /* Wait till one of the items becomes ready. */
+        struct dill_chselect_clause sc;
+        sc.sel = self;
+        self->waiter = &sc.cl;
+        dill_waitfor(&sc.cl, 0, dill_chselect_cancel, DILL_CLAUSE_CHAN);
+        struct dill_tmclause tmcl;
+        dill_timer(&tmcl, 1, deadline);
+        int id = dill_wait();
+        /* The set may have been closed in the meantime. Don't touch it
+           before making sure it wasn't. */
+        if(dill_slow(id < 0)) return -1;
+        if(dill_slow(id == 1)) {errno = ETIMEDOUT; return -1;}
+        if(dill_slow(errno != 0)) return -1;
+        dill_assert(!self->waiter);
+    }
+    struct dill_chselect_item *item = dill_cont(dill_list_next(&self->ready),
+        struct dill_chselect_item, readyitem);
+    int id = item->id;
+    if(dill_slow(!item->ch)) {errno = EBADF; return id;}
+    /* Move the item to the end of the list so that the ready items are
+       served in round-robin fashion. */
+    dill_list_erase(&item->readyitem);
+    dill_list_insert(&item->readyitem, &self->ready);
+    if(item->op == DILL_CHRECV)
+        rc = dill_chrecv_nb(item->ch, item->val, item->len, 1);
+    else
+        rc = dill_chsend_nb(item->ch, item->val, item->len, 1);
+    if(dill_slow(rc < 0)) return id;
+    errno = 0;
+    return id;
+}
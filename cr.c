@@ -31,7 +31,9 @@
 
 #include "cr.h"
 #include "pollset.h"
+#include "probes.h"
 #include "stack.h"
+#include "trace.h"
 #include "utils.h"
 #include "ctx.h"
 
@@ -68,6 +70,8 @@ static const int dill_bundle_type_placeholder = 0;
 const void *dill_bundle_type = &dill_bundle_type_placeholder;
 static void *dill_bundle_query(struct dill_hvfs *vfs, const void *type);
 static void dill_bundle_close(struct dill_hvfs *vfs);
+static void dill_acct_add(struct dill_cracct *dst,
+    const struct dill_cracct *src);
 
 struct dill_bundle {
     /* Table of virtual functions. */
@@ -77,6 +81,9 @@ struct dill_bundle {
     /* If somebody is doing hdone() on this bundle, here's the clause
        to trigger when all coroutines are finished. */
     struct dill_clause *waiter;
+    /* Accumulated accounting of the coroutines that have already finished.
+       Allocated when the first coroutine finishes. */
+    struct dill_cracct *finished;
     /* If true, the bundle was created by bundle_mem. */
     unsigned int mem : 1;
 };
@@ -92,20 +99,21 @@ int dill_bundle_mem(struct dill_bundle_storage *mem) {
     b->vfs.close = dill_bundle_close;
     dill_list_init(&b->crs);
     b->waiter = NULL;
+    b->finished = NULL;
     b->mem = 1;
     return dill_hmake(&b->vfs);
 }
 
 int dill_bundle(void) {
     int err;
-    struct dill_bundle *b = malloc(sizeof(struct dill_bundle));
+    struct dill_bundle *b = dill_slab_alloc(sizeof(struct dill_bundle));
     if(dill_slow(!b)) {err = ENOMEM; goto error1;}
     int h = dill_bundle_mem((struct dill_bundle_storage*)b);
     if(dill_slow(h < 0)) {err = errno; goto error2;}
     b->mem = 0;
     return h;
 error2:
-    free(b);
+    dill_slab_free(b, sizeof(struct dill_bundle));
 error1:
     errno = err;
     return -1;
@@ -124,7 +132,9 @@ static void dill_bundle_close(struct dill_hvfs *vfs) {
         struct dill_cr *cr = dill_cont(it, struct dill_cr, bundle);
         dill_cr_close(&cr->vfs);
     }
-    if(!self->mem) free(self);
+    if(self->finished)
+        dill_slab_free(self->finished, sizeof(struct dill_cracct));
+    if(!self->mem) dill_slab_free(self, sizeof(struct dill_bundle));
 }
 
 int dill_bundle_wait(int h, int64_t deadline) {
@@ -137,7 +147,7 @@ int dill_bundle_wait(int h, int64_t deadline) {
     /* Otherwise wait for all coroutines to finish. */
     struct dill_clause cl;
     self->waiter = &cl;
-    dill_waitfor(&cl, 0, NULL);
+    dill_waitfor(&cl, 0, NULL, DILL_CLAUSE_OTHER);
     struct dill_tmclause tmcl;
     dill_timer(&tmcl, 1, deadline);
     int id = dill_wait();
@@ -148,10 +158,104 @@ int dill_bundle_wait(int h, int64_t deadline) {
     return 0;
 }
 
+int dill_bundle_stats(int h, struct dill_bundle_stats *stats) {
+    struct dill_ctx_cr *ctx = &dill_getctx->cr;
+    if(dill_slow(!stats)) {errno = EINVAL; return -1;}
+    struct dill_bundle *self = dill_hquery(h, dill_bundle_type);
+    if(dill_slow(!self)) return -1;
+    struct dill_cracct acct;
+    if(self->finished) acct = *self->finished;
+    else memset(&acct, 0, sizeof(acct));
+    uint64_t ncrs = 0;
+    uint64_t t = dill_ticks();
+    struct dill_list *it;
+    for(it = self->crs.next; it != &self->crs; it = dill_list_next(it)) {
+        struct dill_cr *cr = dill_cont(it, struct dill_cr, bundle);
+        ++ncrs;
+        dill_acct_add(&acct, &cr->acct);
+        /* Account for what the coroutine is doing at the moment. */
+        if(cr == ctx->r)
+            acct.cpu += t - ctx->switchin;
+        else if(cr->ready.next)
+            acct.ready += t - cr->waketime;
+        else if(cr->waitkind >= 0)
+            acct.blocked[cr->waitkind] += t - cr->blockstart;
+    }
+    double scale = dill_ticks_scale();
+    stats->coroutines = ncrs;
+    stats->switches = acct.switches;
+    stats->cpu_ns = (uint64_t)(acct.cpu * scale);
+    stats->ready_ns = (uint64_t)(acct.ready * scale);
+    int i;
+    for(i = 0; i != DILL_WAIT_NKINDS; ++i)
+        stats->blocked_ns[i] = (uint64_t)(acct.blocked[i] * scale);
+    return 0;
+}
+
 /******************************************************************************/
 /*  Helpers.                                                                  */
 /******************************************************************************/
 
+/* Returns what the coroutine is about to wait for. */
+static int dill_waitkind(struct dill_cr *cr) {
+    /* Yielding. */
+    if(cr->ready.next) return -1;
+    int kind = -1;
+    struct dill_slist *it;
+    for(it = dill_slist_next(&cr->clauses); it != &cr->clauses;
+          it = dill_slist_next(it)) {
+        switch(dill_cont(it, struct dill_clause, item)->kind) {
+        case DILL_CLAUSE_FDIN:
+        case DILL_CLAUSE_FDOUT:
+            return DILL_WAIT_FD;
+        case DILL_CLAUSE_CHAN:
+            return DILL_WAIT_CHAN;
+        case DILL_CLAUSE_SYNC:
+            return DILL_WAIT_SYNC;
+        case DILL_CLAUSE_TIMER:
+            /* Deadlines don't count unless there's nothing else. */
+            if(kind < 0) kind = DILL_WAIT_TIMER;
+            break;
+        default:
+            kind = DILL_WAIT_OTHER;
+        }
+    }
+    return kind < 0 ? DILL_WAIT_OTHER : kind;
+}
+
+/* Called when the running coroutine is about to be switched out.
+   'waitkind' is what it is going to wait for, -1 if it remains ready. */
+static void dill_acct_out(struct dill_ctx_cr *ctx, uint64_t t, int waitkind) {
+    struct dill_cr *r = ctx->r;
+    r->acct.cpu += t - ctx->switchin;
+    r->waitkind = waitkind;
+    r->blockstart = t;
+    if(waitkind < 0) r->waketime = t;
+}
+
+/* Called when a coroutine was switched to. */
+static void dill_acct_in(struct dill_ctx_cr *ctx, uint64_t t) {
+    struct dill_cr *r = ctx->r;
+    if(r->waitkind >= 0)
+        r->acct.blocked[r->waitkind] += r->waketime - r->blockstart;
+    uint64_t wait = t - r->waketime;
+    r->acct.ready += wait;
+    ++r->acct.switches;
+    /* Exponentially weighted moving average with weight of 1/8. */
+    ctx->lag = ctx->lag - ctx->lag / 8 + wait / 8;
+    ctx->switchin = t;
+}
+
+static void dill_acct_add(struct dill_cracct *dst,
+      const struct dill_cracct *src) {
+    dst->switches += src->switches;
+    dst->cpu += src->cpu;
+    dst->ready += src->ready;
+    int i;
+    for(i = 0; i != DILL_WAIT_NKINDS; ++i)
+        dst->blocked[i] += src->blocked[i];
+}
+
 static void dill_resume(struct dill_cr *cr, int id, int err) {
     struct dill_ctx_cr *ctx = &dill_getctx->cr;
     cr->id = id;
@@ -186,10 +290,30 @@ int dill_ctx_cr_init(struct dill_ctx_cr *ctx) {
     dill_rbtree_init(&ctx->timers);
     /* We can't use now() here as the context is still being intialized. */
     ctx->last_poll = dill_mnow();
+    ctx->polling = 0;
     /* Initialize the main coroutine. */
     memset(&ctx->main, 0, sizeof(ctx->main));
     ctx->main.ready.next = NULL;
     dill_slist_init(&ctx->main.clauses);
+    dill_arena_init(&ctx->main.arena);
+    ctx->serial = 1;
+    ctx->ncrs = 0;
+    ctx->switches = 0;
+    ctx->polls = 0;
+    ctx->poll_ticks = 0;
+    ctx->timers_armed = 0;
+    ctx->timers_fired = 0;
+    ctx->timers_removed = 0;
+    memset(ctx->wakehists, 0, sizeof(ctx->wakehists));
+    ctx->main.wakesrc = -1;
+    ctx->main.waitkind = -1;
+    ctx->switchin = dill_ticks();
+    ctx->lag = 0;
+    ctx->poll_lag = 0;
+    ctx->lag_target = 0;
+    ctx->lag_target_ms = DILL_OVERLOAD_TARGET;
+    ctx->rejected = 0;
+    dill_arena_cache_init(&ctx->arenas);
 #if defined DILL_CENSUS
     dill_slist_init(&ctx->census);
 #endif
@@ -197,6 +321,8 @@ int dill_ctx_cr_init(struct dill_ctx_cr *ctx) {
 }
 
 void dill_ctx_cr_term(struct dill_ctx_cr *ctx) {
+    dill_arena_release(&ctx->arenas, &ctx->main.arena);
+    dill_arena_cache_term(&ctx->arenas);
 #if defined DILL_CENSUS
     struct dill_slist *it;
     for(it = dill_slist_next(&ctx->census); it != &ctx->census;
@@ -217,6 +343,7 @@ static void dill_timer_cancel(struct dill_clause *cl) {
     struct dill_ctx_cr *ctx = &dill_getctx->cr;
     struct dill_tmclause *tmcl = dill_cont(cl, struct dill_tmclause, cl);
     dill_rbtree_erase(&ctx->timers, &tmcl->item);
+    ++ctx->timers_removed;
     /* This is a safeguard. If an item isn't properly removed from the rb-tree,
        we can spot the fact by seeing that the cr has been set to NULL. */
     tmcl->cl.cr = NULL;
@@ -228,7 +355,8 @@ void dill_timer(struct dill_tmclause *tmcl, int id, int64_t deadline) {
     /* If the deadline is infinite, there's nothing to wait for. */
     if(deadline < 0) return;
     dill_rbtree_insert(&ctx->timers, deadline, &tmcl->item);
-    dill_waitfor(&tmcl->cl, id, dill_timer_cancel);
+    ++ctx->timers_armed;
+    dill_waitfor(&tmcl->cl, id, dill_timer_cancel, DILL_CLAUSE_TIMER);
 }
 
 /******************************************************************************/
@@ -297,6 +425,15 @@ int dill_prologue(sigjmp_buf **jb, void **ptr, size_t len, int bndl,
     cr->no_blocking2 = 0;
     cr->done = 0;
     cr->mem = *ptr ? 1 : 0;
+    cr->stackhw = cr->mem ? 0 : dill_stack_hwmark(cr + 1, cr);
+    cr->serial = ctx->serial++;
+    cr->file = file;
+    cr->line = line;
+    cr->wakesrc = -1;
+    cr->waitkind = -1;
+    memset(&cr->acct, 0, sizeof(cr->acct));
+    cr->owner = bundle;
+    dill_arena_init(&cr->arena);
 #if defined DILL_VALGRIND
     cr->sid = VALGRIND_STACK_REGISTER((char*)(cr + 1) - stacksz, cr);
 #endif
@@ -312,7 +449,7 @@ int dill_prologue(sigjmp_buf **jb, void **ptr, size_t len, int bndl,
     }
     /* Allocate it if it does not exist. */
     if(it == &ctx->census) {
-        cr->census = malloc(sizeof(struct dill_census_item));
+        cr->census = dill_slab_alloc(sizeof(struct dill_census_item));
         dill_assert(cr->census);
         dill_slist_push(&ctx->census, &cr->census->crs);
         cr->census->file = file;
@@ -325,8 +462,21 @@ int dill_prologue(sigjmp_buf **jb, void **ptr, size_t len, int bndl,
        store its current state. It can't be done here because we are at the
        wrong stack frame here. */
     *jb = &ctx->r->ctx;
-    /* Add parent coroutine to the list of coroutines ready for execution. */
+    /* Add parent coroutine to the list of coroutines ready for execution.
+       The wake-up time is recorded by dill_acct_out() below. */
+    ctx->r->wakesrc = DILL_WAKE_OTHER;
     dill_resume(ctx->r, 0, 0);
+    struct dill_ctx_trace *trace = &dill_getctx->trace;
+    dill_trace(trace, DILL_TRACE_SPAWN, cr->serial, ctx->r->serial);
+    dill_trace(trace, DILL_TRACE_SWITCH, cr->serial, 0);
+    dill_probe2(cr_create, cr->serial, ctx->r->serial);
+    dill_probe2(cr_switch, ctx->r->serial, cr->serial);
+    ++ctx->ncrs;
+    ++ctx->switches;
+    uint64_t t = dill_ticks();
+    dill_acct_out(ctx, t, -1);
+    ++cr->acct.switches;
+    ctx->switchin = t;
     /* Mark the new coroutine as running. */
     *ptr = ctx->r = cr;
     /* In case of success go() returns the handle, bundle_go() returns 0. */
@@ -346,6 +496,8 @@ void dill_epilogue(void) {
     struct dill_ctx_cr *ctx = &dill_getctx->cr;
     /* Mark the coroutine as finished. */
     ctx->r->done = 1;
+    dill_trace(&dill_getctx->trace, DILL_TRACE_EXIT, ctx->r->serial, 0);
+    dill_probe1(cr_exit, ctx->r->serial);
     /* If there's a coroutine waiting for us to finish, unblock it now. */
     if(ctx->r->closer)
         dill_cancel(ctx->r->closer, 0);
@@ -359,6 +511,17 @@ void dill_epilogue(void) {
                 struct dill_bundle, crs);
             if(b->waiter) dill_trigger(b->waiter, 0);
         }
+        /* Pass the accounting to the bundle. If there's no memory for it,
+           it gets lost. */
+        struct dill_bundle *b = ctx->r->owner;
+        if(!b->finished) {
+            b->finished = dill_slab_alloc(sizeof(struct dill_cracct));
+            if(b->finished) memset(b->finished, 0, sizeof(struct dill_cracct));
+        }
+        if(dill_fast(b->finished)) {
+            ctx->r->acct.cpu += dill_ticks() - ctx->switchin;
+            dill_acct_add(b->finished, &ctx->r->acct);
+        }
         dill_list_erase(&ctx->r->bundle);
         dill_cr_close(&ctx->r->vfs);
     }
@@ -419,21 +582,80 @@ static void dill_cr_close(struct dill_hvfs *vfs) {
     VALGRIND_STACK_DEREGISTER(cr->sid);
 #endif
     /* Now that the coroutine is finished, deallocate it. */
+    --ctx->ncrs;
+    dill_arena_release(&ctx->arenas, &cr->arena);
+    if(cr->stackhw) dill_stack_hwrecord(cr + 1, cr, cr->file, cr->line);
     if(!cr->mem) dill_freestack(cr + 1);
 }
 
+void *dill_cr_alloc(size_t size) {
+    struct dill_ctx_cr *ctx = &dill_getctx->cr;
+    if(dill_slow(size == 0)) {errno = EINVAL; return NULL;}
+    return dill_arena_alloc(&ctx->arenas, &ctx->r->arena, size);
+}
+
+/******************************************************************************/
+/*  Overload detection.                                                       */
+/******************************************************************************/
+
+/* Period of re-checking the overload while throttling, in milliseconds. */
+#define DILL_OVERLOAD_BACKOFF 10
+
+int dill_overload_target(int64_t target) {
+    struct dill_ctx_cr *ctx = &dill_getctx->cr;
+    if(dill_slow(target <= 0)) {errno = EINVAL; return -1;}
+    ctx->lag_target_ms = target;
+    ctx->lag_target = 0;
+    return 0;
+}
+
+int dill_overloaded(void) {
+    struct dill_ctx_cr *ctx = &dill_getctx->cr;
+    if(dill_slow(!ctx->lag_target)) {
+        ctx->lag_target = (uint64_t)((double)ctx->lag_target_ms * 1000000.0 /
+            dill_ticks_scale());
+        if(!ctx->lag_target) ctx->lag_target = 1;
+    }
+    return ctx->lag > ctx->lag_target || ctx->poll_lag > ctx->lag_target_ms;
+}
+
+int dill_overload_wait(int64_t deadline) {
+    while(dill_overloaded()) {
+        int64_t nw = dill_now();
+        if(dill_slow(deadline >= 0 && nw >= deadline)) {
+            errno = ETIMEDOUT; return -1;}
+        int64_t wakeup = nw + DILL_OVERLOAD_BACKOFF;
+        if(deadline >= 0 && deadline < wakeup) wakeup = deadline;
+        int rc = dill_msleep(wakeup);
+        if(dill_slow(rc < 0)) return -1;
+    }
+    return 0;
+}
+
 /******************************************************************************/
 /*  Suspend/resume functionality.                                             */
 /******************************************************************************/
 
 void dill_waitfor(struct dill_clause *cl, int id,
-      void (*cancel)(struct dill_clause *cl)) {
+      void (*cancel)(struct dill_clause *cl), int kind) {
     struct dill_ctx_cr *ctx = &dill_getctx->cr;
     /* Add a clause to the coroutine list of active clauses. */
     cl->cr = ctx->r;
     dill_slist_push(&ctx->r->clauses, &cl->item);
     cl->id = id;
     cl->cancel = cancel;
+    cl->kind = kind;
+}
+
+void dill_waitcancel(void) {
+    struct dill_ctx_cr *ctx = &dill_getctx->cr;
+    struct dill_slist *it;
+    for(it = dill_slist_next(&ctx->r->clauses); it != &ctx->r->clauses;
+          it = dill_slist_next(it)) {
+        struct dill_clause *cl = dill_cont(it, struct dill_clause, item);
+        if(cl->cancel) cl->cancel(cl);
+    }
+    dill_slist_init(&ctx->r->clauses);
 }
 
 int dill_wait(void)  {
@@ -445,6 +667,19 @@ int dill_wait(void)  {
         errno = ctx->r->err;
         return ctx->r->id;
     }
+    struct dill_ctx_trace *trace = &dill_getctx->trace;
+    if(dill_slow(trace->on) && !ctx->r->done) {
+        /* Record what the coroutine is waiting for. */
+        int64_t kinds = 0;
+        struct dill_slist *it;
+        for(it = dill_slist_next(&ctx->r->clauses); it != &ctx->r->clauses;
+              it = dill_slist_next(it))
+            kinds |= (int64_t)1 << dill_cont(it, struct dill_clause,
+                item)->kind;
+        dill_trace_(trace, DILL_TRACE_BLOCK, ctx->r->serial, kinds);
+    }
+    if(!ctx->r->done) dill_probe1(cr_block, ctx->r->serial);
+    dill_acct_out(ctx, dill_ticks(), dill_waitkind(ctx->r));
     /* For performance reasons, we want to avoid excessive checking of current
        time, so we cache the value here. It will be recomputed only after
        a blocking call. */
@@ -456,6 +691,7 @@ int dill_wait(void)  {
        intensive operation. */
     if(dill_qlist_empty(&ctx->ready) || nw > ctx->last_poll + 1000) {
         int block = dill_qlist_empty(&ctx->ready);
+        ctx->poll_lag = block ? 0 : nw - ctx->last_poll;
         while(1) {
             /* Compute the timeout for the subsequent poll. */
             int timeout = 0;
@@ -470,7 +706,16 @@ int dill_wait(void)  {
                 }
             }
             /* Wait for events. */
+            dill_probe1(poll_enter, timeout);
+            uint64_t start = dill_ticks();
+            ctx->polling = 1;
             int fired = dill_pollset_poll(timeout);
+            ctx->polling = 0;
+            dill_probe1(poll_exit, fired);
+            uint64_t elapsed = dill_ticks() - start;
+            ++ctx->polls;
+            ctx->poll_ticks += elapsed;
+            dill_trace(trace, DILL_TRACE_POLL, ctx->r->serial, elapsed);
             if(timeout != 0) nw = dill_now();
             if(dill_slow(fired < 0)) continue;
             /* Fire all expired timers. */
@@ -481,7 +726,9 @@ int dill_wait(void)  {
                         struct dill_tmclause, item);
                     if(tmcl->item.val > nw)
                         break;
+                    dill_probe1(timer_fire, tmcl->cl.cr->serial);
                     dill_trigger(&tmcl->cl, ETIMEDOUT);
+                    ++ctx->timers_fired;
                     fired = 1;
                 }
             }
@@ -497,7 +744,18 @@ int dill_wait(void)  {
     /* There's a coroutine ready to be executed so jump to it. */
     struct dill_slist *it = dill_qlist_pop(&ctx->ready);
     it->next = NULL;
+    dill_probe2(cr_switch, ctx->r->serial,
+        dill_cont(it, struct dill_cr, ready)->serial);
     ctx->r = dill_cont(it, struct dill_cr, ready);
+    ++ctx->switches;
+    uint64_t t = dill_ticks();
+    if(ctx->r->wakesrc >= 0) {
+        dill_lathist_add(&ctx->wakehists[ctx->r->wakesrc],
+            t - ctx->r->waketime);
+        ctx->r->wakesrc = -1;
+    }
+    dill_acct_in(ctx, t);
+    dill_trace(trace, DILL_TRACE_SWITCH, ctx->r->serial, 0);
     /* dill_longjmp has to be at the end of a function body, otherwise stack
        unwinding information will be trimmed if a crash occurs in this
        function. */
@@ -520,10 +778,33 @@ static void dill_docancel(struct dill_cr *cr, int id, int err) {
 }
 
 void dill_trigger(struct dill_clause *cl, int err) {
+    dill_trace(&dill_getctx->trace, DILL_TRACE_WAKE, cl->cr->serial,
+        cl->kind);
+    switch(cl->kind) {
+    case DILL_CLAUSE_FDIN:
+    case DILL_CLAUSE_FDOUT:
+        cl->cr->wakesrc = DILL_WAKE_FD;
+        break;
+    case DILL_CLAUSE_CHAN:
+        cl->cr->wakesrc = DILL_WAKE_CHAN;
+        break;
+    case DILL_CLAUSE_TIMER:
+        cl->cr->wakesrc = DILL_WAKE_TIMER;
+        break;
+    default:
+        cl->cr->wakesrc = DILL_WAKE_OTHER;
+    }
+    cl->cr->waketime = dill_ticks();
+    dill_probe2(cr_unblock, cl->cr->serial, cl->cr->wakesrc);
     dill_docancel(cl->cr, cl->id, err);
 }
 
 static void dill_cancel(struct dill_cr *cr, int err) {
+    dill_trace(&dill_getctx->trace, DILL_TRACE_WAKE, cr->serial,
+        DILL_TRACE_CANCEL);
+    cr->wakesrc = DILL_WAKE_CANCEL;
+    cr->waketime = dill_ticks();
+    dill_probe2(cr_unblock, cr->serial, DILL_WAKE_CANCEL);
     dill_docancel(cr, -1, err);
 }
 
@@ -531,7 +812,9 @@ int dill_yield(void) {
     struct dill_ctx_cr *ctx = &dill_getctx->cr;
     int rc = dill_canblock();
     if(dill_slow(rc < 0)) return -1;
-    /* Put the current coroutine into the ready queue. */
+    /* Put the current coroutine into the ready queue. The wake-up time is
+       recorded by dill_acct_out() once the coroutine is switched out. */
+    ctx->r->wakesrc = DILL_WAKE_OTHER;
     dill_resume(ctx->r, 0, 0);
     /* Suspend. */
     return dill_wait();
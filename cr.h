@@ -25,6 +25,8 @@
 
 #include <stdint.h>
 
+#include "arena.h"
+#include "lathist.h"
 #include "list.h"
 #include "qlist.h"
 #include "rbtree.h"
@@ -33,6 +35,18 @@
 #define DILL_DISABLE_RAW_NAMES
 #include "libdillimpl.h"
 
+/* Time accounting of a coroutine. Also used to accumulate the accounting
+   of finished coroutines of a bundle. All the values are in ticks. */
+struct dill_cracct {
+    uint64_t switches;
+    uint64_t cpu;
+    uint64_t ready;
+    /* Indexed by DILL_WAIT_* constants. */
+    uint64_t blocked[DILL_WAIT_NKINDS];
+};
+
+struct dill_bundle;
+
 /* The coroutine. The memory layout looks like this:
    +-------------------------------------------------------------+---------+
    |                                                      stack  | dill_cr |
@@ -68,9 +82,31 @@ struct dill_cr {
     unsigned int done : 1;
     /* If true, the coroutine was launched with go_mem. */
     unsigned int mem : 1;
+    /* If true, high-water mark of the stack is being measured. */
+    unsigned int stackhw : 1;
+    /* Number identifying the coroutine in diagnostic output. The main
+       coroutine is 0. */
+    uint32_t serial;
+    /* Where the coroutine was launched. NULL for the main coroutine. */
+    const char *file;
+    int line;
+    /* What resumed the coroutine (one of DILL_WAKE_* constants, -1 if
+       the wake-up is not measured) and when. */
+    int wakesrc;
+    uint64_t waketime;
+    /* What the coroutine is blocked on (one of DILL_WAIT_* constants or -1
+       if it's just yielding) and since when. */
+    int waitkind;
+    uint64_t blockstart;
+    struct dill_cracct acct;
+    /* The bundle the coroutine belongs to. */
+    struct dill_bundle *owner;
     /* When the coroutine handle is being closed, this points to the
        coroutine that is doing the hclose() call. */
     struct dill_cr *closer;
+    /* Memory allocated by dill_cr_alloc(). Released when the coroutine
+       is deallocated. */
+    struct dill_arena arena;
 #if defined DILL_VALGRIND
     /* Valgrind stack identifier. This way, valgrind knows which areas of
        memory are used as stacks, and so it doesn't produce spurious warnings.
@@ -88,6 +124,9 @@ struct dill_cr {
    benefit of a minor optimization). */
 } __attribute__((aligned(16)));
 
+/* Default target scheduler lag, in milliseconds. */
+#define DILL_OVERLOAD_TARGET 50
+
 struct dill_ctx_cr {
     /* Currently running coroutine. */
     struct dill_cr *r;
@@ -97,15 +136,53 @@ struct dill_ctx_cr {
     struct dill_rbtree timers;
     /* Last time poll was performed. */
     int64_t last_poll;
+    /* 1 while the thread is waiting for events in the pollset. */
+    int polling;
     /* The main coroutine. We don't control the creation of the main coroutine's
        stack, so we have to store this info here instead of the top of
        the stack. */
     struct dill_cr main;
+    /* Serial number to assign to the next coroutine. */
+    uint32_t serial;
+    /* When the running coroutine was switched to. */
+    uint64_t switchin;
+    /* Statistics. Fired timers are removed as well, so the number of
+       canceled timers is 'timers_removed' minus 'timers_fired'. */
+    int ncrs;
+    uint64_t switches;
+    uint64_t polls;
+    uint64_t poll_ticks;
+    uint64_t timers_armed;
+    uint64_t timers_fired;
+    uint64_t timers_removed;
+    /* Scheduler lag. 'lag' is a moving average of the time coroutines
+       spend in the ready queue, in ticks. 'poll_lag' is how long, in
+       milliseconds, external events had to wait before the last poll.
+       The thread is overloaded if either exceeds the target. Target in
+       ticks is computed lazily from the target in milliseconds. */
+    uint64_t lag;
+    int64_t poll_lag;
+    uint64_t lag_target;
+    int64_t lag_target_ms;
+    /* Number of connections rejected by listeners because of overload. */
+    uint64_t rejected;
+    /* Wake-up latencies, indexed by DILL_WAKE_* constants. */
+    struct dill_lathist wakehists[DILL_WAKE_NSOURCES];
+    /* Arena chunks released by finished coroutines. */
+    struct dill_arena_cache arenas;
 #if defined DILL_CENSUS
     struct dill_slist census;
 #endif
 };
 
+/* Kinds of clauses. Used only for diagnostic purposes. */
+#define DILL_CLAUSE_OTHER 0
+#define DILL_CLAUSE_FDIN 1
+#define DILL_CLAUSE_FDOUT 2
+#define DILL_CLAUSE_CHAN 3
+#define DILL_CLAUSE_TIMER 4
+#define DILL_CLAUSE_SYNC 5
+
 struct dill_clause {
     /* The coroutine that owns this clause. */
     struct dill_cr *cr;
@@ -115,6 +192,8 @@ struct dill_clause {
     int id;
     /* Function to call when this clause is canceled. */
     void (*cancel)(struct dill_clause *cl);
+    /* What the coroutine is waiting for. One of DILL_CLAUSE_* constants. */
+    int kind;
 };
 
 /* Timer clause. */
@@ -133,9 +212,9 @@ void dill_ctx_cr_term(struct dill_ctx_cr *ctx);
 /* When dill_wait() is called next time, the coroutine will wait
    (among other clauses) on this clause. 'id' must not be negative.
    'cancel' is a function to be called when the clause is canceled
-   without being triggered. */
+   without being triggered. 'kind' is one of DILL_CLAUSE_* constants. */
 void dill_waitfor(struct dill_clause *cl, int id,
-    void (*cancel)(struct dill_clause *cl));
+    void (*cancel)(struct dill_clause *cl), int kind);
 
 /* Suspend running coroutine. Move to executing different coroutines.
    The coroutine will be resumed once one of the clauses previously added by
@@ -145,6 +224,10 @@ void dill_waitfor(struct dill_clause *cl, int id,
    success or non-zero value to indicate error. */
 int dill_wait(void);
 
+/* Cancel all the clauses added by dill_waitfor() so far without blocking.
+   Used to back out if adding one of the clauses fails. */
+void dill_waitcancel(void);
+
 /* Schedule a previously suspended coroutine for execution. Keep in mind that
    this doesn't immediately run it, it just puts it into the coroutine ready
    queue. It will cause dill_wait() to return the id supplied in
@@ -154,6 +237,10 @@ void dill_trigger(struct dill_clause *cl, int err);
 /* Add a timer to the list of active clauses. */
 void dill_timer(struct dill_tmclause *tmcl, int id, int64_t deadline);
 
+/* If the thread is overloaded, waits until it's not. Returns -1 and sets
+   errno to ETIMEDOUT if the overload persists past the deadline. */
+int dill_overload_wait(int64_t deadline);
+
 /* Returns 0 if blocking functions are allowed.
    Returns -1 and sets errno to ECANCELED otherwise. */
 int dill_canblock(void);
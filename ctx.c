@@ -20,6 +20,9 @@
 
 */
 
+#include <string.h>
+
+#include "alloc.h"
 #include "ctx.h"
 
 static void dill_ctx_init_(struct dill_ctx *ctx) {
@@ -27,12 +30,20 @@ static void dill_ctx_init_(struct dill_ctx *ctx) {
     ctx->initialized = 1;
     int rc = dill_ctx_now_init(&ctx->now);
     dill_assert(rc == 0);
+    rc = dill_ctx_trace_init(&ctx->trace);
+    dill_assert(rc == 0);
     rc = dill_ctx_cr_init(&ctx->cr);
     dill_assert(rc == 0);
+    rc = dill_ctx_prof_init(&ctx->prof);
+    dill_assert(rc == 0);
+    rc = dill_ctx_watchdog_init(&ctx->watchdog);
+    dill_assert(rc == 0);
     rc = dill_ctx_handle_init(&ctx->handle);
     dill_assert(rc == 0);
     rc = dill_ctx_stack_init(&ctx->stack);
     dill_assert(rc == 0);
+    rc = dill_ctx_slab_init(&ctx->slab);
+    dill_assert(rc == 0);
     rc = dill_ctx_pollset_init(&ctx->pollset);
     dill_assert(rc == 0);
 #if defined DILL_SOCKETS
@@ -47,13 +58,27 @@ static void dill_ctx_term_(struct dill_ctx *ctx) {
     dill_ctx_fd_term(&ctx->fd);
 #endif
     dill_ctx_pollset_term(&ctx->pollset);
+    dill_ctx_slab_term(&ctx->slab);
     dill_ctx_stack_term(&ctx->stack);
     dill_ctx_handle_term(&ctx->handle);
+    dill_ctx_watchdog_term(&ctx->watchdog);
+    dill_ctx_prof_term(&ctx->prof);
     dill_ctx_cr_term(&ctx->cr);
+    dill_ctx_trace_term(&ctx->trace);
     dill_ctx_now_term(&ctx->now);
     ctx->initialized = 0;
 }
 
+void dill_ctx_atfork(void) {
+    struct dill_ctx *ctx = dill_getctx;
+    /* Kernel-side pollset is shared with the parent process. Modifying it
+       would mess up parent's event loop. */
+    dill_ctx_pollset_term(&ctx->pollset);
+    int rc = dill_ctx_pollset_init(&ctx->pollset);
+    dill_assert(rc == 0);
+    dill_ctx_watchdog_atfork(&ctx->watchdog);
+}
+
 #if !defined DILL_THREADS
 
 /* This implementation of context is used when threading is disabled, i.e.
@@ -166,7 +191,7 @@ static void *dill_main = NULL;
 static void dill_ctx_term(void *ptr) {
     struct dill_ctx *ctx = ptr;
     dill_ctx_term_(ctx);
-    free(ctx);
+    dill_free(ctx, sizeof(struct dill_ctx), DILL_ALLOC_OTHER);
     if(dill_ismain()) dill_main = NULL;
 }
 
@@ -184,8 +209,9 @@ struct dill_ctx *dill_getctx_(void) {
     dill_assert(rc == 0);
     struct dill_ctx *ctx = pthread_getspecific(dill_key);
     if(dill_fast(ctx)) return ctx;
-    ctx = calloc(1, sizeof(struct dill_ctx));
+    ctx = dill_alloc(sizeof(struct dill_ctx), DILL_ALLOC_OTHER);
     dill_assert(ctx);
+    memset(ctx, 0, sizeof(struct dill_ctx));
     dill_ctx_init_(ctx);
     if(dill_ismain()) {
         dill_main = ctx;
@@ -28,14 +28,22 @@
 #include "handle.h"
 #include "now.h"
 #include "pollset.h"
+#include "prof.h"
+#include "slab.h"
 #include "stack.h"
+#include "trace.h"
+#include "watchdog.h"
 
 struct dill_ctx {
     int initialized;
     struct dill_ctx_now now;
+    struct dill_ctx_trace trace;
     struct dill_ctx_cr cr;
+    struct dill_ctx_prof prof;
+    struct dill_ctx_watchdog watchdog;
     struct dill_ctx_handle handle;
     struct dill_ctx_stack stack;
+    struct dill_ctx_slab slab;
     struct dill_ctx_pollset pollset;
 #if defined DILL_SOCKETS
     struct dill_ctx_fd fd;
@@ -44,6 +52,10 @@ struct dill_ctx {
 
 struct dill_ctx *dill_ctx_init(void);
 
+/* Re-creates the parts of the context that can't be shared with the parent
+   process after fork(). */
+void dill_ctx_atfork(void);
+
 #if !defined DILL_THREADS
 
 extern struct dill_ctx dill_ctx_;
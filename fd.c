@@ -27,13 +27,21 @@
 #include <string.h>
 #include <unistd.h>
 
+#include "alloc.h"
 #include "ctx.h"
 #include "fd.h"
 #include "iol.h"
 #include "utils.h"
 
+/* Cache of each size class holds up to this many default-sized buffers
+   worth of memory. */
 #define DILL_FD_CACHESIZE 32
-#define DILL_FD_BUFSIZE 1984
+#define DILL_FD_DEFCLASS 2
+#define DILL_FD_BUFSIZE(cls) (((size_t)512 << (cls)) - 64)
+/* Number of consecutive observations needed to grow or shrink the rx
+   buffer. Shrinking is deliberately slower than growing. */
+#define DILL_FD_GROW 4
+#define DILL_FD_SHRINK 16
 
 #if defined MSG_NOSIGNAL
 #define FD_NOSIGNAL MSG_NOSIGNAL
@@ -42,39 +50,55 @@
 #endif
 
 int dill_ctx_fd_init(struct dill_ctx_fd *ctx) {
-    ctx->count = 0;
-    dill_slist_init(&ctx->cache);
+    int i;
+    for(i = 0; i != DILL_FD_NCLASSES; ++i) {
+        ctx->count[i] = 0;
+        dill_slist_init(&ctx->cache[i]);
+    }
+    ctx->nused = 0;
+    memset(ctx->sent, 0, sizeof(ctx->sent));
+    memset(ctx->received, 0, sizeof(ctx->received));
     return 0;
 }
 
 void dill_ctx_fd_term(struct dill_ctx_fd *ctx) {
-    while(1) {
-        struct dill_slist *it = dill_slist_pop(&ctx->cache);
-        if(it == &ctx->cache) break;
-        free(it);
+    int i;
+    for(i = 0; i != DILL_FD_NCLASSES; ++i) {
+        while(1) {
+            struct dill_slist *it = dill_slist_pop(&ctx->cache[i]);
+            if(it == &ctx->cache[i]) break;
+            dill_free(it, DILL_FD_BUFSIZE(i), DILL_ALLOC_RXBUF);
+        }
     }
 }
 
-static uint8_t *dill_fd_allocbuf(void) {
+static uint8_t *dill_fd_allocbuf(int cls) {
     struct dill_ctx_fd *ctx = &dill_getctx->fd;
-    struct dill_slist *it = dill_slist_pop(&ctx->cache);
-    if(dill_fast(it != &ctx->cache)) {
-        ctx->count--;
+    struct dill_slist *it = dill_slist_pop(&ctx->cache[cls]);
+    if(dill_fast(it != &ctx->cache[cls])) {
+        ctx->count[cls]--;
+        ctx->nused++;
         return (uint8_t*)it;
     }
-    uint8_t *p = malloc(DILL_FD_BUFSIZE);
-    if(dill_slow(!p)) {errno = ENOMEM; return NULL;}
-    return p;
+    uint8_t *buf = dill_alloc(DILL_FD_BUFSIZE(cls), DILL_ALLOC_RXBUF);
+    if(dill_fast(buf)) ctx->nused++;
+    return buf;
 }
 
-static void dill_fd_freebuf(uint8_t *buf) {
+static void dill_fd_freebuf(uint8_t *buf, int cls) {
     struct dill_ctx_fd *ctx = &dill_getctx->fd;
-    if(ctx->count >= DILL_FD_CACHESIZE) {
-        free(buf);
+    ctx->nused--;
+    /* Keep about the same amount of memory in each cache but cache at least
+       one buffer. */
+    int limit = DILL_FD_CACHESIZE * DILL_FD_BUFSIZE(DILL_FD_DEFCLASS) /
+        DILL_FD_BUFSIZE(cls);
+    if(limit < 1) limit = 1;
+    if(ctx->count[cls] >= limit) {
+        dill_free(buf, DILL_FD_BUFSIZE(cls), DILL_ALLOC_RXBUF);
         return;
     }
-    dill_slist_push(&ctx->cache, (struct dill_slist*)buf);
-    ctx->count++;
+    dill_slist_push(&ctx->cache[cls], (struct dill_slist*)buf);
+    ctx->count[cls]++;
 }
 
 void dill_fd_initrxbuf(struct dill_fd_rxbuf *rxbuf) {
@@ -82,10 +106,48 @@ void dill_fd_initrxbuf(struct dill_fd_rxbuf *rxbuf) {
     rxbuf->len = 0;
     rxbuf->pos = 0;
     rxbuf->buf = NULL;
+    rxbuf->cls = DILL_FD_DEFCLASS;
+    rxbuf->want = DILL_FD_DEFCLASS;
+    rxbuf->score = 0;
+    rxbuf->fixed = 0;
+    rxbuf->peeked = 0;
 }
 
 void dill_fd_termrxbuf(struct dill_fd_rxbuf *rxbuf) {
-    if(rxbuf->buf) dill_fd_freebuf(rxbuf->buf);
+    if(rxbuf->buf) dill_fd_freebuf(rxbuf->buf, rxbuf->cls);
+}
+
+int dill_fd_setrxbuf(struct dill_fd_rxbuf *rxbuf, size_t size) {
+    if(!size) {
+        rxbuf->fixed = 0;
+        rxbuf->score = 0;
+        return 0;
+    }
+    int cls = 0;
+    while(DILL_FD_BUFSIZE(cls) < size) {
+        if(dill_slow(++cls == DILL_FD_NCLASSES)) {errno = EINVAL; return -1;}
+    }
+    /* The buffer itself is replaced once it's drained. */
+    rxbuf->want = cls;
+    rxbuf->fixed = 1;
+    return 0;
+}
+
+/* Adapts the size of the rx buffer to the traffic. If grow is set the buffer
+   was found too small, otherwise it was found too big. */
+static void dill_fd_adapt(struct dill_fd_rxbuf *rxbuf, int grow) {
+    if(rxbuf->fixed) return;
+    if(grow) {
+        if(rxbuf->score < 0) rxbuf->score = 0;
+        if(++rxbuf->score < DILL_FD_GROW) return;
+        if(rxbuf->want < DILL_FD_NCLASSES - 1) rxbuf->want++;
+    }
+    else {
+        if(rxbuf->score > 0) rxbuf->score = 0;
+        if(--rxbuf->score > -DILL_FD_SHRINK) return;
+        if(rxbuf->want > 0) rxbuf->want--;
+    }
+    rxbuf->score = 0;
 }
 
 int dill_fd_unblock(int s) {
@@ -148,13 +210,34 @@ int dill_fd_accept(int s, struct sockaddr *addr, socklen_t *addrlen,
     return as;
 }
 
-int dill_fd_send(int s, struct dill_iolist *first, struct dill_iolist *last,
-      int64_t deadline) {
+int dill_fd_admit(int s, struct sockaddr *addr, socklen_t *addrlen,
+      int policy, int64_t deadline) {
+    if(policy == DILL_OVERLOAD_THROTTLE) {
+        int rc = dill_overload_wait(deadline);
+        if(dill_slow(rc < 0)) return -1;
+    }
+    socklen_t len = addrlen ? *addrlen : 0;
+    while(1) {
+        if(addrlen) *addrlen = len;
+        int as = dill_fd_accept(s, addr, addrlen, deadline);
+        if(dill_slow(as < 0)) return -1;
+        if(dill_fast(policy != DILL_OVERLOAD_REJECT || !dill_overloaded()))
+            return as;
+        dill_fd_close(as);
+        ++dill_getctx->cr.rejected;
+        /* Give other coroutines a chance to catch up. */
+        int rc = dill_yield();
+        if(dill_slow(rc < 0)) return -1;
+    }
+}
+
+ssize_t dill_fd_send(int s, struct dill_sockstats *st,
+      struct dill_iolist *first, struct dill_iolist *last, int64_t deadline) {
     /* Make a local iovec array. */
     /* TODO: This is dangerous, it may cause stack overflow.
        There should probably be a on-heap per-socket buffer for that. */
-    size_t niov;
-    int rc = dill_iolcheck(first, last, &niov, NULL);
+    size_t niov, nbytes;
+    int rc = dill_iolcheck(first, last, &niov, &nbytes);
     if(dill_slow(rc < 0)) return -1;
     struct iovec iov[niov];
     dill_ioltoiov(first, iov);
@@ -171,16 +254,19 @@ int dill_fd_send(int s, struct dill_iolist *first, struct dill_iolist *last,
             hdr.msg_iov++;
             hdr.msg_iovlen--;
         }
-        if(!hdr.msg_iovlen) return 0;
+        if(!hdr.msg_iovlen) return nbytes;
         ssize_t sz = sendmsg(s, &hdr, FD_NOSIGNAL);
+        st->syscalls++;
         dill_assert(sz != 0);
         if(sz < 0) {
             if(dill_slow(errno != EWOULDBLOCK && errno != EAGAIN)) {
                 if(errno == EPIPE) errno = ECONNRESET;
                 return -1;
             }
+            st->eagains++;
             sz = 0;
         }
+        st->wire_out += sz;
         /* Adjust the iovec array so that it doesn't contain data
            that was already sent. */
         while(sz) {
@@ -193,17 +279,17 @@ int dill_fd_send(int s, struct dill_iolist *first, struct dill_iolist *last,
             sz -= head->iov_len;
             hdr.msg_iov++;
             hdr.msg_iovlen--;
-            if(!hdr.msg_iovlen) return 0;
+            if(!hdr.msg_iovlen) return nbytes;
         }
         /* Wait till more data can be sent. */
-        int rc = dill_fdout(s, deadline);
+        int rc = dill_sockstats_fdout(st, s, deadline);
         if(dill_slow(rc < 0)) return -1;
     }
 }
 
 /* Same as dill_fd_recv() but with no rx buffering. */
-static int dill_fd_recv_(int s, struct dill_iolist *first,
-      struct dill_iolist *last, int64_t deadline) {
+static int dill_fd_recv_(int s, struct dill_sockstats *st,
+      struct dill_iolist *first, struct dill_iolist *last, int64_t deadline) {
     /* Make a local iovec array. */
     /* TODO: This is dangerous, it may cause stack overflow.
        There should probably be a on-heap per-socket buffer for that. */
@@ -219,14 +305,17 @@ static int dill_fd_recv_(int s, struct dill_iolist *first,
     hdr.msg_iovlen = niov;
     while(1) {
         ssize_t sz = recvmsg(s, &hdr, 0);
+        st->syscalls++;
         if(dill_slow(sz == 0)) {errno = EPIPE; return -1;}
         if(sz < 0) {
             if(dill_slow(errno != EWOULDBLOCK && errno != EAGAIN)) {
                 if(errno == EPIPE) errno = ECONNRESET;
                 return -1;
             }
+            st->eagains++;
             sz = 0;
         }
+        st->wire_in += sz;
         /* Adjust the iovec array so that it doesn't contain buffers
            that ware already filled in. */
         while(sz) {
@@ -242,18 +331,19 @@ static int dill_fd_recv_(int s, struct dill_iolist *first,
             if(!hdr.msg_iovlen) return 0;
         }
         /* Wait for more data. */
-        int rc = dill_fdin(s, deadline);
+        int rc = dill_sockstats_fdin(st, s, deadline);
         if(dill_slow(rc < 0)) return -1;
     }
 }
 
 /* Skip len bytes. If len is negative skip until error occurs. */
-static int dill_fd_skip(int s, ssize_t len, int64_t deadline) {
+static int dill_fd_skip(int s, struct dill_sockstats *st, ssize_t len,
+      int64_t deadline) {
     uint8_t buf[512];
     while(len) {
         size_t to_recv = len < 0 || len > sizeof(buf) ? sizeof(buf) : len;
         struct dill_iolist iol = {buf, to_recv, NULL, 0};
-        int rc = dill_fd_recv_(s, &iol, &iol, deadline);
+        int rc = dill_fd_recv_(s, st, &iol, &iol, deadline);
         if(dill_slow(rc < 0)) return -1;
         if(len >= 0) len -= to_recv;
     }
@@ -271,7 +361,7 @@ static size_t dill_fd_copy(struct dill_fd_rxbuf *rxbuf,
             memcpy(iol->iol_base, rxbuf->buf + rxbuf->pos, rmn);
         rxbuf->len = 0;
         rxbuf->pos = 0;
-        dill_fd_freebuf(rxbuf->buf);
+        dill_fd_freebuf(rxbuf->buf, rxbuf->cls);
         rxbuf->buf = NULL;
         return rmn;
     }
@@ -281,18 +371,19 @@ static size_t dill_fd_copy(struct dill_fd_rxbuf *rxbuf,
     return iol->iol_len;
 }
 
-int dill_fd_recv(int s, struct dill_fd_rxbuf *rxbuf, struct dill_iolist *first,
-      struct dill_iolist *last, int64_t deadline) {
+int dill_fd_recv(int s, struct dill_fd_rxbuf *rxbuf, struct dill_sockstats *st,
+      struct dill_iolist *first, struct dill_iolist *last, int64_t deadline) {
     /* Skip all data until error occurs. */
-    if(dill_slow(!first && !last)) return dill_fd_skip(s, -1, deadline);
+    if(dill_slow(!first && !last)) return dill_fd_skip(s, st, -1, deadline);
     /* Fill in data from the rxbuf. */
     size_t sz = 0;
     if(dill_fast(rxbuf)) {
+        rxbuf->peeked = 0;
         while(1) {
             sz = dill_fd_copy(rxbuf, first);
             if(sz < first->iol_len) break;
             first = first->iol_next;
-            if(!first) return 0;
+            if(!first) {st->rxbuf_hits++; return 0;}
         }
     }
     /* Copy the current iolist element so that we can modify it without
@@ -310,8 +401,13 @@ int dill_fd_recv(int s, struct dill_fd_rxbuf *rxbuf, struct dill_iolist *first,
         it = it->iol_next;
     }
     /* If requested amount of data is larger than rx buffer avoid the copy
-       and read it directly into user's buffer. */
-    if(!rxbuf || miss > DILL_FD_BUFSIZE) {
+       and read it directly into user's buffer. If a bigger buffer would
+       have done, remember that. Subsequent reads may then get several
+       messages with a single syscall. */
+    if(!rxbuf || miss > DILL_FD_BUFSIZE(rxbuf->want)) {
+        st->direct_reads++;
+        if(rxbuf && miss <= DILL_FD_BUFSIZE(DILL_FD_NCLASSES - 1))
+            dill_fd_adapt(rxbuf, 1);
         // There may be NULL bufers in the list. These can't be passed to
         // recv_(). We have to split the list and call recv_() and skip()
         // respectively.
@@ -327,14 +423,14 @@ int dill_fd_recv(int s, struct dill_fd_rxbuf *rxbuf, struct dill_iolist *first,
             if(dill_slow(!it->iol_base)) {
                 /* Skip specified number of bytes. */
                 dill_assert(it == begin);
-                int rc = dill_fd_skip(s, it->iol_len, deadline);
+                int rc = dill_fd_skip(s, st, it->iol_len, deadline);
                 goto next;
             }
             if(it == end || !it->iol_next->iol_base || !it->iol_next->iol_len) {
                 /* Do the actual recv syscall. */
                 struct dill_iolist *tmp = it->iol_next;
                 it->iol_next = NULL;
-                int rc = dill_fd_recv_(s, begin, it, deadline);
+                int rc = dill_fd_recv_(s, st, begin, it, deadline);
                 it->iol_next = tmp;
                 if(dill_slow(rc < 0)) return -1;
                 goto next;
@@ -353,19 +449,32 @@ next:
         /* Read as much data as possible to the buffer to avoid extra
            syscalls. Do the speculative recv() first to avoid extra
            polling. Do fdin() only after recv() fails to get data. */
+        if(rxbuf->buf && rxbuf->cls != rxbuf->want) {
+            dill_fd_freebuf(rxbuf->buf, rxbuf->cls);
+            rxbuf->buf = NULL;
+        }
         if(!rxbuf->buf) {
-            rxbuf->buf = dill_fd_allocbuf();
+            rxbuf->buf = dill_fd_allocbuf(rxbuf->want);
             if(dill_slow(!rxbuf->buf)) return -1;
+            rxbuf->cls = rxbuf->want;
         }
-        ssize_t sz = recv(s, rxbuf->buf, DILL_FD_BUFSIZE, 0);
+        size_t bufsz = DILL_FD_BUFSIZE(rxbuf->cls);
+        ssize_t sz = recv(s, rxbuf->buf, bufsz, 0);
+        st->syscalls++;
         if(dill_slow(sz == 0)) {errno = EPIPE; return -1;}
         if(sz < 0) {
             if(dill_slow(errno != EWOULDBLOCK && errno != EAGAIN)) {
                 if(errno == EPIPE) errno = ECONNRESET;
                 return -1;
             }
+            st->eagains++;
             sz = 0;
         }
+        st->wire_in += sz;
+        /* Filled buffer means that there may be more data in the kernel.
+           Mostly empty buffer means that it is unnecessarily large. */
+        if(sz == bufsz) dill_fd_adapt(rxbuf, 1);
+        else if(sz > 0 && sz <= bufsz / 4) dill_fd_adapt(rxbuf, 0);
         rxbuf->len = sz;
         rxbuf->pos = 0;
         /* Copy the data from rxbuffer to the iolist. */
@@ -378,9 +487,82 @@ next:
         if(curr.iol_base) curr.iol_base += sz;
         curr.iol_len -= sz;
         /* Wait for more data. */
-        int rc = dill_fdin(s, deadline);
+        int rc = dill_sockstats_fdin(st, s, deadline);
+        if(dill_slow(rc < 0)) return -1;
+    }
+}
+
+int dill_fd_peek(int s, struct dill_fd_rxbuf *rxbuf, struct dill_sockstats *st,
+      const void **buf, size_t *len, int64_t deadline) {
+    size_t rmn = rxbuf->len - rxbuf->pos;
+    if(rmn && !rxbuf->peeked) {
+        st->rxbuf_hits++;
+        goto done;
+    }
+    /* Make space for more data. */
+    if(!rmn) {
+        rxbuf->len = 0;
+        rxbuf->pos = 0;
+        if(rxbuf->buf && rxbuf->cls != rxbuf->want) {
+            dill_fd_freebuf(rxbuf->buf, rxbuf->cls);
+            rxbuf->buf = NULL;
+        }
+        if(!rxbuf->buf) {
+            rxbuf->buf = dill_fd_allocbuf(rxbuf->want);
+            if(dill_slow(!rxbuf->buf)) return -1;
+            rxbuf->cls = rxbuf->want;
+        }
+    }
+    else if(rmn == DILL_FD_BUFSIZE(rxbuf->cls)) {
+        /* The buffer is full. Move the data to a bigger one. */
+        if(dill_slow(rxbuf->cls == DILL_FD_NCLASSES - 1)) {
+            errno = ENOBUFS; return -1;}
+        uint8_t *nbuf = dill_fd_allocbuf(rxbuf->cls + 1);
+        if(dill_slow(!nbuf)) return -1;
+        memcpy(nbuf, rxbuf->buf + rxbuf->pos, rmn);
+        dill_fd_freebuf(rxbuf->buf, rxbuf->cls);
+        rxbuf->buf = nbuf;
+        rxbuf->cls++;
+        rxbuf->len = rmn;
+        rxbuf->pos = 0;
+    }
+    else if(rxbuf->pos) {
+        memmove(rxbuf->buf, rxbuf->buf + rxbuf->pos, rmn);
+        rxbuf->len = rmn;
+        rxbuf->pos = 0;
+    }
+    /* Append whatever data the kernel has. */
+    while(1) {
+        ssize_t sz = recv(s, rxbuf->buf + rxbuf->len,
+            DILL_FD_BUFSIZE(rxbuf->cls) - rxbuf->len, 0);
+        st->syscalls++;
+        if(dill_slow(sz == 0)) {errno = EPIPE; return -1;}
+        if(sz > 0) {
+            st->wire_in += sz;
+            rxbuf->len += sz;
+            break;
+        }
+        if(dill_slow(errno != EWOULDBLOCK && errno != EAGAIN)) {
+            if(errno == EPIPE) errno = ECONNRESET;
+            return -1;
+        }
+        st->eagains++;
+        int rc = dill_sockstats_fdin(st, s, deadline);
         if(dill_slow(rc < 0)) return -1;
     }
+done:
+    rxbuf->peeked = 1;
+    *buf = rxbuf->buf + rxbuf->pos;
+    *len = rxbuf->len - rxbuf->pos;
+    return 0;
+}
+
+int dill_fd_consume(struct dill_fd_rxbuf *rxbuf, size_t len) {
+    if(dill_slow(len > rxbuf->len - rxbuf->pos)) {errno = EINVAL; return -1;}
+    if(!len) return 0;
+    rxbuf->pos += len;
+    rxbuf->peeked = 0;
+    return 0;
 }
 
 void dill_fd_close(int s) {
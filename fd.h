@@ -32,25 +32,53 @@
 #define DILL_DISABLE_RAW_NAMES
 #include "libdill.h"
 #include "slist.h"
+#include "sockstats.h"
+
+/* Rx buffers come in size classes. Class N buffer is (512 << N) - 64 bytes
+   long, i.e. from 448 bytes to almost 64kB. */
+#define DILL_FD_NCLASSES 8
 
 struct dill_ctx_fd {
-    int count;
-    struct dill_slist cache;
+    /* Caches of unused rx buffers, one per size class. */
+    int count[DILL_FD_NCLASSES];
+    struct dill_slist cache[DILL_FD_NCLASSES];
+    /* Statistics. Number of rx buffers in use and bytes transferred,
+       indexed by DILL_STATS_* socket type. */
+    int nused;
+    uint64_t sent[DILL_STATS_NSOCKTYPES];
+    uint64_t received[DILL_STATS_NSOCKTYPES];
 };
 
 int dill_ctx_fd_init(struct dill_ctx_fd *ctx);
 void dill_ctx_fd_term(struct dill_ctx_fd *ctx);
 
 struct dill_fd_rxbuf {
-    size_t len;
-    size_t pos;
+    uint32_t len;
+    uint32_t pos;
     uint8_t *buf;
+    /* Size class of buf. */
+    uint8_t cls;
+    /* Size class to use for the next refill of the buffer. */
+    uint8_t want;
+    /* Positive if the buffer was found too small recently, negative if it
+       was found too big. */
+    int8_t score;
+    /* If set, the size was chosen by the user and is not adapted. */
+    unsigned int fixed : 1;
+    /* Set if the buffered data were returned by dill_fd_peek() and nothing
+       was consumed since. */
+    unsigned int peeked : 1;
 };
 
 void dill_fd_initrxbuf(
     struct dill_fd_rxbuf *rxbuf);
 void dill_fd_termrxbuf(
     struct dill_fd_rxbuf *rxbuf);
+/* Sets the size of the rx buffer. Zero means adapting the size to the
+   traffic, which is the default. */
+int dill_fd_setrxbuf(
+    struct dill_fd_rxbuf *rxbuf,
+    size_t size);
 int dill_fd_unblock(
     int s);
 int dill_fd_connect(
@@ -63,17 +91,39 @@ int dill_fd_accept(
     struct sockaddr *addr,
     socklen_t *addrlen,
     int64_t deadline);
-int dill_fd_send(
+/* Same as dill_fd_accept() but applies one of DILL_OVERLOAD_* policies. */
+int dill_fd_admit(
+    int s,
+    struct sockaddr *addr,
+    socklen_t *addrlen,
+    int policy,
+    int64_t deadline);
+/* Returns number of bytes sent. */
+ssize_t dill_fd_send(
     int s,
+    struct dill_sockstats *st,
     struct dill_iolist *first,
     struct dill_iolist *last,
     int64_t deadline);
 int dill_fd_recv(
     int s,
     struct dill_fd_rxbuf *rxbuf,
+    struct dill_sockstats *st,
     struct dill_iolist *first,
     struct dill_iolist *last,
     int64_t deadline);
+/* Returns the data in rxbuf, receiving more if there's none or if the data
+   were already peeked at. */
+int dill_fd_peek(
+    int s,
+    struct dill_fd_rxbuf *rxbuf,
+    struct dill_sockstats *st,
+    const void **buf,
+    size_t *len,
+    int64_t deadline);
+int dill_fd_consume(
+    struct dill_fd_rxbuf *rxbuf,
+    size_t len);
 void dill_fd_close(
     int s);
 int dill_fd_own(
@@ -0,0 +1,154 @@
+/*
+
+  Copyright (c) 2018 Martin Sustrik
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"),
+  to deal in the Software without restriction, including without limitation
+  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+  and/or sell copies of the Software, and to permit persons to whom
+  the Software is furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included
+  in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+  IN THE SOFTWARE.
+
+*/
+
+#include <string.h>
+
+#include "cr.h"
+#include "list.h"
+#include "utils.h"
+
+#define DILL_DISABLE_RAW_NAMES
+#include "libdillimpl.h"
+
+/* One-shot future. Unlike most other objects it's not a handle. It lives in
+   the memory supplied by the user, typically on the stack of the coroutine
+   that awaits the result, and the result is copied directly into the
+   buffer supplied by the same coroutine. The user has to make sure that
+   the coroutine fulfilling the future doesn't outlive the future itself,
+   e.g. by closing the bundle it runs in before the future goes out of
+   scope. */
+
+struct dill_fut {
+    /* Coroutines waiting for the future to be fulfilled. */
+    struct dill_list waiters;
+    /* Buffer to store the result in. */
+    void *val;
+    size_t len;
+    /* Error to report to the waiters. 0 in case of success. */
+    int err;
+    /* 1 if the future was already fulfilled. */
+    unsigned int ready : 1;
+};
+
+DILL_CT_ASSERT(sizeof(struct dill_future) >= sizeof(struct dill_fut));
+
+struct dill_futclause {
+    struct dill_clause cl;
+    /* An item in dill_fut::waiters list. */
+    struct dill_list item;
+};
+
+int dill_future_init(struct dill_future *f, void *val, size_t len) {
+    if(dill_slow(!f || (len > 0 && !val))) {errno = EINVAL; return -1;}
+    struct dill_fut *self = (struct dill_fut*)f;
+    dill_list_init(&self->waiters);
+    self->val = val;
+    self->len = len;
+    self->err = 0;
+    self->ready = 0;
+    return 0;
+}
+
+static void dill_future_complete(struct dill_fut *self, int err) {
+    self->err = err;
+    self->ready = 1;
+    while(!dill_list_empty(&self->waiters)) {
+        struct dill_futclause *fcl = dill_cont(dill_list_next(&self->waiters),
+            struct dill_futclause, item);
+        dill_trigger(&fcl->cl, err);
+    }
+}
+
+int dill_future_set(struct dill_future *f, const void *val, size_t len) {
+    if(dill_slow(!f || (len > 0 && !val))) {errno = EINVAL; return -1;}
+    struct dill_fut *self = (struct dill_fut*)f;
+    if(dill_slow(self->ready)) {errno = EALREADY; return -1;}
+    /* The waiters have to learn about the failure, otherwise they would
+       wait forever. */
+    if(dill_slow(len != self->len)) {
+        dill_future_complete(self, EMSGSIZE);
+        errno = EMSGSIZE;
+        return -1;
+    }
+    memcpy(self->val, val, len);
+    dill_future_complete(self, 0);
+    return 0;
+}
+
+int dill_future_fail(struct dill_future *f, int err) {
+    if(dill_slow(!f || err == 0)) {errno = EINVAL; return -1;}
+    struct dill_fut *self = (struct dill_fut*)f;
+    if(dill_slow(self->ready)) {errno = EALREADY; return -1;}
+    dill_future_complete(self, err);
+    return 0;
+}
+
+static void dill_future_cancel(struct dill_clause *cl) {
+    struct dill_futclause *fcl = dill_cont(cl, struct dill_futclause, cl);
+    dill_list_erase(&fcl->item);
+}
+
+int dill_future_wait(struct dill_future *f, int64_t deadline) {
+    int i = dill_future_waitany(&f, 1, deadline);
+    return i < 0 ? -1 : (errno ? -1 : 0);
+}
+
+int dill_future_waitany(struct dill_future **fs, int nfs, int64_t deadline) {
+    int rc = dill_canblock();
+    if(dill_slow(rc < 0)) return -1;
+    if(dill_slow(nfs <= 0 || !fs)) {errno = EINVAL; return -1;}
+    /* Check whether any of the futures is already fulfilled. */
+    int i;
+    for(i = 0; i != nfs; ++i) {
+        if(dill_slow(!fs[i])) {errno = EINVAL; return -1;}
+        struct dill_fut *self = (struct dill_fut*)fs[i];
+        if(self->ready) {errno = self->err; return i;}
+    }
+    if(dill_slow(deadline == 0)) {errno = ETIMEDOUT; return -1;}
+    /* Let's wait. */
+    struct dill_futclause fcls[nfs];
+    for(i = 0; i != nfs; ++i) {
+        struct dill_fut *self = (struct dill_fut*)fs[i];
+        dill_list_insert(&fcls[i].item, &self->waiters);
+        dill_waitfor(&fcls[i].cl, i, dill_future_cancel, DILL_CLAUSE_SYNC);
+    }
+    struct dill_tmclause tmcl;
+    dill_timer(&tmcl, nfs, deadline);
+    int id = dill_wait();
+    if(dill_slow(id < 0)) return -1;
+    if(dill_slow(id == nfs)) {errno = ETIMEDOUT; return -1;}
+    return id;
+}
+
+int dill_future_waitall(struct dill_future **fs, int nfs, int64_t deadline) {
+    if(dill_slow(nfs < 0 || (nfs > 0 && !fs))) {errno = EINVAL; return -1;}
+    /* Each future is waited for at most once so waiting for them one by one
+       doesn't cost more than waiting for them all at once. */
+    int i;
+    for(i = 0; i != nfs; ++i) {
+        int rc = dill_future_waitany(&fs[i], 1, deadline);
+        if(dill_slow(rc < 0)) return -1;
+    }
+    return 0;
+}
@@ -29,6 +29,7 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "alloc.h"
 #include "cr.h"
 #include "handle.h"
 #include "utils.h"
@@ -37,25 +38,61 @@
 #define DILL_DISABLE_RAW_NAMES
 #include "libdillimpl.h"
 
+/* Number of (type, pointer) pairs cached by each handle. Layered sockets
+   are routinely queried for several different types, e.g. both bsock and
+   tcp, so caching a single type would result in constant cache misses. */
+#define DILL_HCACHE_SIZE 3
+
 struct dill_handle {
     /* Table of virtual functions. */
     struct dill_hvfs *vfs;
     /* Index of the next handle in the linked list of unused handles. -1 means
        'the end of the list'. -2 means 'handle is in use'. */
     int next;
-    /* Cache the last call to hquery. */
-    const void *type;
-    void *ptr;
+    /* Slot in the cache to be replaced on the next cache miss. */
+    int victim;
+    /* Cache of recent calls to hquery. Entries with NULL pointer are
+       unused. */
+    const void *types[DILL_HCACHE_SIZE];
+    void *ptrs[DILL_HCACHE_SIZE];
 };
 
+/* Handles are allocated in chunks of fixed size. Chunks are never moved,
+   so pointers to handles remain valid as the table grows. */
+#define DILL_HCHUNK_SHIFT 8
+#define DILL_HCHUNK_SIZE (1 << DILL_HCHUNK_SHIFT)
+
+#define dill_handle_get(ctx, h) (&(ctx)->chunks[(h) >> DILL_HCHUNK_SHIFT]\
+    [(h) & (DILL_HCHUNK_SIZE - 1)])
+
 #define DILL_CHECKHANDLE(h, err) \
-    if(dill_slow((h) < 0 || (h) >= ctx->nhandles ||\
-          ctx->handles[(h)].next != -2)) {\
+    if(dill_slow((h) < 0 || (h) >= ctx->nhandles)) {\
         errno = EBADF; return (err);}\
-    struct dill_handle *hndl = &ctx->handles[(h)];
+    struct dill_handle *hndl = dill_handle_get(ctx, (h));\
+    if(dill_slow(hndl->next != -2)) {errno = EBADF; return (err);}
+
+static void dill_handle_clearcache(struct dill_handle *hndl) {
+    int i;
+    for(i = 0; i != DILL_HCACHE_SIZE; ++i) {
+        hndl->types[i] = NULL;
+        hndl->ptrs[i] = NULL;
+    }
+    hndl->victim = 0;
+}
+
+/* Returns the handle to the shared pool. */
+static void dill_handle_release(struct dill_ctx_handle *ctx, int h) {
+    struct dill_handle *hndl = dill_handle_get(ctx, h);
+    dill_handle_clearcache(hndl);
+    hndl->next = -1;
+    if(ctx->first == -1) ctx->first = h;
+    else dill_handle_get(ctx, ctx->last)->next = h;
+    ctx->last = h;
+    ctx->nused--;
+}
 
 int dill_ctx_handle_init(struct dill_ctx_handle *ctx) {
-    ctx->handles = NULL;
+    ctx->chunks = NULL;
     ctx->nhandles = 0;
     ctx->nused = 0;
     ctx->first = -1;
@@ -64,7 +101,12 @@ int dill_ctx_handle_init(struct dill_ctx_handle *ctx) {
 }
 
 void dill_ctx_handle_term(struct dill_ctx_handle *ctx) {
-    free(ctx->handles);
+    int i;
+    for(i = 0; i != ctx->nhandles >> DILL_HCHUNK_SHIFT; ++i)
+        dill_free(ctx->chunks[i], DILL_HCHUNK_SIZE * sizeof(struct dill_handle),
+            DILL_ALLOC_HANDLES);
+    dill_free(ctx->chunks, (ctx->nhandles >> DILL_HCHUNK_SHIFT) *
+        sizeof(struct dill_handle*), DILL_ALLOC_HANDLES);
 }
 
 int dill_hmake(struct dill_hvfs *vfs) {
@@ -74,34 +116,45 @@ int dill_hmake(struct dill_hvfs *vfs) {
     /* Returns ECANCELED if shutting down. */
     int rc = dill_canblock();
     if(dill_slow(rc < 0)) return -1;
-    /* If there's no space for the new handle, expand the array.
+    /* If there's no space for the new handle, add a new chunk of handles.
        Keep at least 8 handles unused so that there's at least some rotation
        of handle numbers even if operating close to the current limit. */
     if(dill_slow(ctx->nhandles - ctx->nused <= 8)) {
-        /* Start with 256 handles, double the size when needed. */
-        int sz = ctx->nhandles ? ctx->nhandles * 2 : 256;
-        struct dill_handle *hndls =
-            realloc(ctx->handles, sz * sizeof(struct dill_handle));
-        if(dill_slow(!hndls)) {errno = ENOMEM; return -1;}
+        int nchunks = ctx->nhandles >> DILL_HCHUNK_SHIFT;
+        /* Only the array of pointers to chunks is reallocated. It's small
+           and it's done once per DILL_HCHUNK_SIZE handles. */
+        struct dill_handle *chunk = dill_alloc(
+            DILL_HCHUNK_SIZE * sizeof(struct dill_handle), DILL_ALLOC_HANDLES);
+        if(dill_slow(!chunk)) return -1;
+        struct dill_handle **chunks = dill_realloc(ctx->chunks,
+            nchunks * sizeof(struct dill_handle*),
+            (nchunks + 1) * sizeof(struct dill_handle*), DILL_ALLOC_HANDLES);
+        if(dill_slow(!chunks)) {
+            dill_free(chunk, DILL_HCHUNK_SIZE * sizeof(struct dill_handle),
+                DILL_ALLOC_HANDLES);
+            return -1;
+        }
+        ctx->chunks = chunks;
+        chunks[nchunks] = chunk;
         /* Add newly allocated handles to the list of unused handles. */
+        int base = ctx->nhandles;
         int i;
-        for(i = ctx->nhandles; i != sz - 1; ++i)
-            hndls[i].next = i + 1;
-        hndls[sz - 1].next = -1;
-        ctx->first = ctx->nhandles;
-        ctx->last = sz - 1; 
-        /* Adjust the array. */
-        ctx->handles = hndls;
-        ctx->nhandles = sz;
+        for(i = 0; i != DILL_HCHUNK_SIZE - 1; ++i)
+            chunk[i].next = base + i + 1;
+        chunk[DILL_HCHUNK_SIZE - 1].next = -1;
+        if(ctx->first == -1) ctx->first = base;
+        else dill_handle_get(ctx, ctx->last)->next = base;
+        ctx->last = base + DILL_HCHUNK_SIZE - 1;
+        ctx->nhandles += DILL_HCHUNK_SIZE;
     }
     /* Return first handle from the list of unused handles. */
     int h = ctx->first;
-    ctx->first = ctx->handles[h].next;
+    struct dill_handle *hndl = dill_handle_get(ctx, h);
+    ctx->first = hndl->next;
     if(dill_slow(ctx->first) == -1) ctx->last = -1;
-    ctx->handles[h].vfs = vfs;
-    ctx->handles[h].next = -2;
-    ctx->handles[h].type = NULL;
-    ctx->handles[h].ptr = NULL;
+    hndl->vfs = vfs;
+    hndl->next = -2;
+    dill_handle_clearcache(hndl);
     ctx->nused++;
     return h;
 }
@@ -116,33 +169,33 @@ int dill_hown(int h) {
         dill_assert(rc == 0);
         return -1;
     }
-    /* In case handle array was reallocated we have to recompute the pointer. */
-    hndl = &ctx->handles[h];
-    /* Return a handle to the shared pool. */
-    hndl->ptr = NULL;
-    hndl->next = -1;
-    if(ctx->first == -1) ctx->first = h;
-    else ctx->handles[ctx->last].next = h;
-    ctx->last = h;
-    ctx->nused--;
+    /* The cache is still valid, it refers to the same object. The handle
+       storage is stable, so the pointer is valid even if the table grew. */
+    struct dill_handle *nhndl = dill_handle_get(ctx, res);
+    memcpy(nhndl->types, hndl->types, sizeof(hndl->types));
+    memcpy(nhndl->ptrs, hndl->ptrs, sizeof(hndl->ptrs));
+    nhndl->victim = hndl->victim;
+    dill_handle_release(ctx, h);
     return res;
 }
 
 void *dill_hquery(int h, const void *type) {
     struct dill_ctx_handle *ctx = &dill_getctx->handle;
     DILL_CHECKHANDLE(h, NULL);
-    /* Try and use the cached pointer first; otherwise do the expensive virtual
-       call.*/
-    if(dill_fast(hndl->ptr != NULL && hndl->type == type))
-        return hndl->ptr;
-    else {
-        void *ptr = hndl->vfs->query(hndl->vfs, type);
-        if(dill_slow(!ptr)) return NULL;
-        /* Update cache. */
-        hndl->type = type;
-        hndl->ptr = ptr;
-        return ptr;
+    /* Try and use the cached pointers first; otherwise do the expensive
+       virtual call.*/
+    int i;
+    for(i = 0; i != DILL_HCACHE_SIZE; ++i) {
+        if(dill_fast(hndl->types[i] == type && hndl->ptrs[i] != NULL))
+            return hndl->ptrs[i];
     }
+    void *ptr = hndl->vfs->query(hndl->vfs, type);
+    if(dill_slow(!ptr)) return NULL;
+    /* Update cache. */
+    hndl->types[hndl->victim] = type;
+    hndl->ptrs[hndl->victim] = ptr;
+    hndl->victim = (hndl->victim + 1) % DILL_HCACHE_SIZE;
+    return ptr;
 }
 
 int dill_hclose(int h) {
@@ -155,14 +208,6 @@ int dill_hclose(int h) {
     hndl->vfs->close(hndl->vfs);
     /* Restore the previous state. */
     dill_no_blocking(old);
-    /* Mark the cache as invalid. */
-    hndl->ptr = NULL;
-    /* Return a handle to the shared pool. */
-    hndl->next = -1;
-    if(ctx->first == -1) ctx->first = h;
-    else ctx->handles[ctx->last].next = h;
-    ctx->last = h;
-    ctx->nused--;
+    dill_handle_release(ctx, h);
     return 0;
 }
-
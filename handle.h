@@ -26,8 +26,9 @@
 struct dill_handle;
 
 struct dill_ctx_handle {
-    /* Array of handles. The size of the array is stored in 'nall'. */
-    struct dill_handle *handles;
+    /* Handles are stored in fixed-size chunks. 'nhandles' is the total
+       number of handles in all the chunks. */
+    struct dill_handle **chunks;
     int nhandles;
     /* Number of allocated handles. */
     int nused;
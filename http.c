@@ -31,6 +31,7 @@
 
 #define DILL_DISABLE_RAW_NAMES
 #include "libdillimpl.h"
+#include "slab.h"
 #include "utils.h"
 
 dill_unique_id(dill_http_type);
@@ -88,14 +89,14 @@ error:
 
 int dill_http_attach(int s) {
     int err;
-    struct dill_http_sock *obj = malloc(sizeof(struct dill_http_sock));
+    struct dill_http_sock *obj = dill_slab_alloc(sizeof(struct dill_http_sock));
     if(dill_slow(!obj)) {err = ENOMEM; goto error1;}
     s = dill_http_attach_mem(s, (struct dill_http_storage*)obj);
     if(dill_slow(s < 0)) {err = errno; goto error2;}
     obj->mem = 0;
     return s;
 error2:
-    free(obj);
+    dill_slab_free(obj, sizeof(struct dill_http_sock));
 error1:
     if(s >= 0) dill_hclose(s);
     errno = err;
@@ -117,7 +118,7 @@ int dill_http_detach(int s, int64_t deadline) {
     u = dill_suffix_detach(u, deadline);
     if(dill_slow(u < 0)) {err = errno; goto error;}
 error:
-    if(!obj->mem) free(obj);
+    if(!obj->mem) dill_slab_free(obj, sizeof(struct dill_http_sock));
     errno = err;
     return u;
 }
@@ -318,6 +319,6 @@ static void dill_http_hclose(struct dill_hvfs *hvfs) {
         int rc = dill_hclose(obj->u);
         dill_assert(rc == 0);
     }
-    if(!obj->mem) free(obj);
+    if(!obj->mem) dill_slab_free(obj, sizeof(struct dill_http_sock));
 }
 
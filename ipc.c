@@ -30,7 +30,12 @@
 
 #define DILL_DISABLE_RAW_NAMES
 #include "libdillimpl.h"
+#include "ctx.h"
 #include "fd.h"
+#include "iol.h"
+#include "probes.h"
+#include "slab.h"
+#include "sockstats.h"
 #include "utils.h"
 
 static int dill_ipc_resolve(const char *addr, struct sockaddr_un *su);
@@ -54,6 +59,7 @@ struct dill_ipc_conn {
     struct dill_bsock_vfs bvfs;
     int fd;
     struct dill_fd_rxbuf rxbuf;
+    struct dill_sockstats stats;
     unsigned int scm_rights : 1;
     unsigned int rbusy : 1;
     unsigned int sbusy : 1;
@@ -75,6 +81,7 @@ static int dill_ipc_makeconn(int fd, void *mem) {
     self->bvfs.brecvl = dill_ipc_brecvl;
     self->fd = fd;
     dill_fd_initrxbuf(&self->rxbuf);
+    dill_sockstats_init(&self->stats, fd, -1);
     self->scm_rights = 1;
     self->rbusy = 0;
     self->sbusy = 0;
@@ -91,6 +98,7 @@ static void *dill_ipc_hquery(struct dill_hvfs *hvfs, const void *type) {
     struct dill_ipc_conn *self = (struct dill_ipc_conn*)hvfs;
     if(type == dill_bsock_type) return &self->bvfs;
     if(type == dill_ipc_type) return self;
+    if(type == dill_sockstats_type) return &self->stats;
     errno = ENOTSUP;
     return NULL;
 }
@@ -119,14 +127,14 @@ error1:
 
 int dill_ipc_fromfd(int fd) {
     int err;
-    struct dill_ipc_conn *obj = malloc(sizeof(struct dill_ipc_conn));
+    struct dill_ipc_conn *obj = dill_slab_alloc(sizeof(struct dill_ipc_conn));
     if(dill_slow(!obj)) {err = ENOMEM; goto error1;}
     int s = dill_ipc_fromfd_mem(fd, (struct dill_ipc_storage*)obj);
     if (dill_slow(s < 0)) {err = errno; goto error2;}
     obj->mem = 0;
     return s;
 error2:
-    free(obj);
+    dill_slab_free(obj, sizeof(struct dill_ipc_conn));
 error1:
     errno = err;
     return -1;
@@ -162,14 +170,14 @@ error1:
 
 int dill_ipc_connect(const char *addr, int64_t deadline) {
     int err;
-    struct dill_ipc_conn *obj = malloc(sizeof(struct dill_ipc_conn));
+    struct dill_ipc_conn *obj = dill_slab_alloc(sizeof(struct dill_ipc_conn));
     if(dill_slow(!obj)) {err = ENOMEM; goto error1;}
     int s = dill_ipc_connect_mem(addr, (struct dill_ipc_storage*)obj, deadline);
     if(dill_slow(s < 0)) {err = errno; goto error2;}
     obj->mem = 0;
     return s;
 error2:
-    free(obj);
+    dill_slab_free(obj, sizeof(struct dill_ipc_conn));
 error1:
     errno = err;
     return -1;
@@ -182,9 +190,15 @@ static int dill_ipc_bsendl(struct dill_bsock_vfs *bvfs,
     if(dill_slow(self->outdone)) {errno = EPIPE; return -1;}
     if(dill_slow(self->outerr)) {errno = ECONNRESET; return -1;}
     self->sbusy = 1;
-    ssize_t sz = dill_fd_send(self->fd, first, last, deadline);
+    ssize_t sz = dill_fd_send(self->fd, &self->stats, first, last, deadline);
     self->sbusy = 0;
-    if(dill_fast(sz >= 0)) return sz;
+    if(dill_fast(sz >= 0)) {
+        dill_getctx->fd.sent[DILL_STATS_IPC] += sz;
+        self->stats.bytes_out += sz;
+        self->stats.msgs_out++;
+        dill_probe2(sock_send, DILL_STATS_IPC, sz);
+        return 0;
+    }
     self->outerr = 1;
     return -1;
 }
@@ -198,9 +212,18 @@ static int dill_ipc_brecvl(struct dill_bsock_vfs *bvfs,
     self->rbusy = 1;
     /* If we want to use SCM_RIGHTS we can't do rx buffering. */
     int rc = dill_fd_recv(self->fd, self->scm_rights ? NULL : &self->rxbuf,
-        first, last, deadline);
+        &self->stats, first, last, deadline);
     self->rbusy = 0;
-    if(dill_fast(rc == 0)) return 0;
+    if(dill_fast(rc == 0)) {
+        size_t nbytes;
+        rc = dill_iolcheck(first, last, NULL, &nbytes);
+        dill_assert(rc == 0);
+        dill_getctx->fd.received[DILL_STATS_IPC] += nbytes;
+        self->stats.bytes_in += nbytes;
+        self->stats.msgs_in++;
+        dill_probe2(sock_recv, DILL_STATS_IPC, nbytes);
+        return 0;
+    }
     if(errno == EPIPE) self->indone = 1;
     else self->inerr = 1;
     return -1;
@@ -232,9 +255,10 @@ int dill_ipc_sendfd(int s, int fd, int64_t deadline) {
     cmsg->cmsg_len = CMSG_LEN(sizeof(fd));
     *((int*)CMSG_DATA(cmsg)) = fd;
     msg.msg_controllen = cmsg->cmsg_len;
-    int rc = dill_fdout(self->fd, deadline);
+    int rc = dill_sockstats_fdout(&self->stats, self->fd, deadline);
     if(dill_slow(rc < 0)) return -1;
     ssize_t sz = sendmsg(self->fd, &msg, 0);
+    self->stats.syscalls++;
     if(dill_slow(sz == 0)) {self->outdone = 1; errno = EPIPE; return -1;}
     if(dill_slow(sz < 0)) {
        if(errno == ECONNRESET) {self->outerr = 1; return -1;}
@@ -261,9 +285,10 @@ int dill_ipc_recvfd(int s, int64_t deadline) {
     unsigned char control[1024];
     msg.msg_control = control;
     msg.msg_controllen = sizeof(control);
-    int rc = dill_fdin(self->fd, deadline);
+    int rc = dill_sockstats_fdin(&self->stats, self->fd, deadline);
     if(dill_slow(rc < 0)) return -1;
     ssize_t sz = recvmsg(self->fd, &msg, 0);
+    self->stats.syscalls++;
     if(dill_slow(sz == 0)) {self->indone = 1; errno = EPIPE; return -1;}
     if(dill_slow(sz < 0)) {
        if(errno == ECONNRESET) {self->outerr = 1; return -1;}
@@ -333,7 +358,7 @@ static void dill_ipc_hclose(struct dill_hvfs *hvfs) {
     struct dill_ipc_conn *self = (struct dill_ipc_conn*)hvfs;
     dill_fd_close(self->fd);
     dill_fd_termrxbuf(&self->rxbuf);
-    if(!self->mem) free(self);
+    if(!self->mem) dill_slab_free(self, sizeof(struct dill_ipc_conn));
 }
 
 /******************************************************************************/
@@ -347,6 +372,8 @@ struct dill_ipc_listener {
     struct dill_hvfs hvfs;
     int fd;
     unsigned int mem : 1;
+    /* One of DILL_OVERLOAD_* constants. */
+    unsigned int overload : 2;
 };
 
 DILL_CHECK_STORAGE(dill_ipc_listener, dill_ipc_listener_storage)
@@ -367,13 +394,24 @@ static int dill_ipc_makelistener(int fd,
     self->hvfs.close = dill_ipc_listener_hclose;
     self->fd = fd;
     self->mem = 1;
+    self->overload = DILL_OVERLOAD_IGNORE;
     /* Create the handle. */
     return dill_hmake(&self->hvfs);
 }
 
+int dill_ipc_listener_overload(int s, int policy) {
+    if(dill_slow(policy < DILL_OVERLOAD_IGNORE ||
+          policy > DILL_OVERLOAD_REJECT)) {errno = EINVAL; return -1;}
+    struct dill_ipc_listener *self = dill_hquery(s, dill_ipc_listener_type);
+    if(dill_slow(!self)) return -1;
+    self->overload = policy;
+    return 0;
+}
+
 int dill_ipc_listener_fromfd(int fd) {
     int err;
-    struct dill_ipc_listener *obj = malloc(sizeof(struct dill_ipc_listener));
+    struct dill_ipc_listener *obj = dill_slab_alloc(
+        sizeof(struct dill_ipc_listener));
     if(dill_slow(!obj)) {err = ENOMEM; goto error1;}
     int s = dill_ipc_listener_fromfd_mem(fd,
         (struct dill_ipc_listener_storage*)obj);
@@ -381,7 +419,7 @@ int dill_ipc_listener_fromfd(int fd) {
     obj->mem = 0;
     return s;
 error2:
-    free(obj);
+    dill_slab_free(obj, sizeof(struct dill_ipc_listener));
 error1:
     errno = err;
     return -1;
@@ -440,7 +478,8 @@ error1:
 
 int dill_ipc_listen(const char *addr, int backlog) {
     int err;
-    struct dill_ipc_listener *obj = malloc(sizeof(struct dill_ipc_listener));
+    struct dill_ipc_listener *obj = dill_slab_alloc(
+        sizeof(struct dill_ipc_listener));
     if(dill_slow(!obj)) {err = ENOMEM; goto error1;}
     int ls = dill_ipc_listen_mem(addr, backlog,
         (struct dill_ipc_listener_storage*)obj);
@@ -448,7 +487,7 @@ int dill_ipc_listen(const char *addr, int backlog) {
     obj->mem = 0;
     return ls;
 error2:
-    free(obj);
+    dill_slab_free(obj, sizeof(struct dill_ipc_listener));
 error1:
     errno = err;
     return -1;
@@ -461,7 +500,7 @@ int dill_ipc_accept_mem(int s, struct dill_ipc_storage *mem, int64_t deadline) {
     struct dill_ipc_listener *lst = dill_hquery(s, dill_ipc_listener_type);
     if(dill_slow(!lst)) {err = errno; goto error1;}
     /* Try to get new connection in a non-blocking way. */
-    int as = dill_fd_accept(lst->fd, NULL, NULL, deadline);
+    int as = dill_fd_admit(lst->fd, NULL, NULL, lst->overload, deadline);
     if(dill_slow(as < 0)) {err = errno; goto error1;}
     /* Set it to non-blocking mode. */
     int rc = dill_fd_unblock(as);
@@ -479,14 +518,14 @@ error1:
 
 int dill_ipc_accept(int s, int64_t deadline) {
     int err;
-    struct dill_ipc_conn *obj = malloc(sizeof(struct dill_ipc_conn));
+    struct dill_ipc_conn *obj = dill_slab_alloc(sizeof(struct dill_ipc_conn));
     if(dill_slow(!obj)) {err = ENOMEM; goto error1;}
     int as = dill_ipc_accept_mem(s, (struct dill_ipc_storage*)obj, deadline);
     if(dill_slow(as < 0)) {err = errno; goto error2;}
     obj->mem = 0;
     return as;
 error2:
-    free(obj);
+    dill_slab_free(obj, sizeof(struct dill_ipc_conn));
 error1:
     errno = err;
     return -1;
@@ -495,7 +534,7 @@ error1:
 static void dill_ipc_listener_hclose(struct dill_hvfs *hvfs) {
     struct dill_ipc_listener *self = (struct dill_ipc_listener*)hvfs;
     dill_fd_close(self->fd);
-    if(!self->mem) free(self);
+    if(!self->mem) dill_slab_free(self, sizeof(struct dill_ipc_listener));
 }
 
 /******************************************************************************/
@@ -545,9 +584,9 @@ int dill_ipc_pair(int s[2]) {
     rc = dill_fd_unblock(fds[1]);
     if(dill_slow(rc < 0)) {err = errno; goto error3;}
     /* Allocate the memory. */
-    struct dill_ipc_conn *conn0 = malloc(sizeof(struct dill_ipc_conn));
+    struct dill_ipc_conn *conn0 = dill_slab_alloc(sizeof(struct dill_ipc_conn));
     if(dill_slow(!conn0)) {err = ENOMEM; goto error3;}
-    struct dill_ipc_conn *conn1 = malloc(sizeof(struct dill_ipc_conn));
+    struct dill_ipc_conn *conn1 = dill_slab_alloc(sizeof(struct dill_ipc_conn));
     if(dill_slow(!conn1)) {err = ENOMEM; goto error4;}
     /* Create the handles. */
     s[0] = dill_ipc_makeconn(fds[0], conn0);
@@ -561,9 +600,9 @@ error6:
     rc = dill_hclose(s[0]);
     goto error2;
 error5:
-    free(conn1);
+    dill_slab_free(conn1, sizeof(struct dill_ipc_conn));
 error4:
-    free(conn0);
+    dill_slab_free(conn0, sizeof(struct dill_ipc_conn));
 error3:
     dill_fd_close(fds[0]);
 error2:
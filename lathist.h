@@ -0,0 +1,67 @@
+/*
+
+  Copyright (c) 2016 Martin Sustrik
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"),
+  to deal in the Software without restriction, including without limitation
+  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+  and/or sell copies of the Software, and to permit persons to whom
+  the Software is furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included
+  in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+  IN THE SOFTWARE.
+
+*/
+
+#ifndef DILL_LATHIST_INCLUDED
+#define DILL_LATHIST_INCLUDED
+
+#include <stdint.h>
+
+#define DILL_DISABLE_RAW_NAMES
+#include "libdill.h"
+
+/* Log-linear histogram of latencies measured in ticks. Values below 4 have
+   a bucket each. Above that, each power of two is split into 4 equally
+   sized buckets. Values that don't fit end up in the last bucket. */
+struct dill_lathist {
+    uint64_t count;
+    uint64_t sum;
+    uint64_t max;
+    uint64_t buckets[DILL_WAKEHIST_NBUCKETS];
+};
+
+static inline int dill_lathist_bucket(uint64_t val) {
+    if(val < 4) return (int)val;
+    int e = 63 - __builtin_clzll(val);
+    int b = 4 + (e - 2) * 4 + (int)((val >> (e - 2)) & 3);
+    return b < DILL_WAKEHIST_NBUCKETS ? b : DILL_WAKEHIST_NBUCKETS - 1;
+}
+
+static inline void dill_lathist_add(struct dill_lathist *self, uint64_t val) {
+    ++self->count;
+    self->sum += val;
+    if(val > self->max) self->max = val;
+    ++self->buckets[dill_lathist_bucket(val)];
+}
+
+/* Returns the largest value that belongs to the bucket. */
+static inline uint64_t dill_lathist_bound(int bucket) {
+    if(bucket < 4) return bucket;
+    if(bucket == DILL_WAKEHIST_NBUCKETS - 1) return UINT64_MAX;
+    int e = (bucket - 4) / 4 + 2;
+    uint64_t sub = (bucket - 4) % 4;
+    return ((4 + sub + 1) << (e - 2)) - 1;
+}
+
+#endif
+
@@ -41,13 +41,14 @@ int dill_msleep(int64_t deadline) {
     return 0;
 }
 
-int dill_fdin(int fd, int64_t deadline) {
+static int dill_fdwait(int fd, int out, int all, int64_t deadline) {
     /* Return ECANCELED if shutting down. */
     int rc = dill_canblock();
     if(dill_slow(rc < 0)) return -1;
     /* Start waiting for the fd. */
     struct dill_fdclause fdcl;
-    rc = dill_pollset_in(&fdcl, 1, fd);
+    rc = out ? dill_pollset_out(&fdcl, 1, fd, all) :
+        dill_pollset_in(&fdcl, 1, fd, all);
     if(dill_slow(rc < 0)) return -1;
     /* Optionally, start waiting for a timer. */
     struct dill_tmclause tmcl;
@@ -59,22 +60,20 @@ int dill_fdin(int fd, int64_t deadline) {
     return 0;
 }
 
+int dill_fdin(int fd, int64_t deadline) {
+    return dill_fdwait(fd, 0, 0, deadline);
+}
+
 int dill_fdout(int fd, int64_t deadline) {
-    /* Return ECANCELED if shutting down. */
-    int rc = dill_canblock();
-    if(dill_slow(rc < 0)) return -1;
-    /* Start waiting for the fd. */
-    struct dill_fdclause fdcl;
-    rc = dill_pollset_out(&fdcl, 1, fd);
-    if(dill_slow(rc < 0)) return -1;
-    /* Optionally, start waiting for a timer. */
-    struct dill_tmclause tmcl;
-    dill_timer(&tmcl, 2, deadline);
-    /* Block. */
-    int id = dill_wait();
-    if(dill_slow(id < 0)) return -1;
-    if(dill_slow(id == 2)) {errno = ETIMEDOUT; return -1;}
-    return 0;
+    return dill_fdwait(fd, 1, 0, deadline);
+}
+
+int dill_fdin_all(int fd, int64_t deadline) {
+    return dill_fdwait(fd, 0, 1, deadline);
+}
+
+int dill_fdout_all(int fd, int64_t deadline) {
+    return dill_fdwait(fd, 1, 1, deadline);
 }
 
 int dill_fdclean(int fd) {
@@ -99,6 +99,8 @@ extern "C" {
 DILL_EXPORT int dill_fdclean(int fd);
 DILL_EXPORT int dill_fdin(int fd, int64_t deadline);
 DILL_EXPORT int dill_fdout(int fd, int64_t deadline);
+DILL_EXPORT int dill_fdin_all(int fd, int64_t deadline);
+DILL_EXPORT int dill_fdout_all(int fd, int64_t deadline);
 DILL_EXPORT int64_t dill_now(void);
 DILL_EXPORT int dill_msleep(int64_t deadline);
 
@@ -106,6 +108,8 @@ DILL_EXPORT int dill_msleep(int64_t deadline);
 #define fdclean dill_fdclean
 #define fdin dill_fdin
 #define fdout dill_fdout
+#define fdin_all dill_fdin_all
+#define fdout_all dill_fdout_all
 #define now dill_now
 #define msleep dill_msleep
 #endif
@@ -268,6 +272,45 @@ DILL_EXPORT int dill_bundle_mem(struct dill_bundle_storage *mem);
 DILL_EXPORT int dill_bundle_wait(int h, int64_t deadline);
 DILL_EXPORT int dill_yield(void);
 
+/* What a coroutine was blocked on. A coroutine waiting for something with
+   a deadline counts as waiting for that something. */
+#define DILL_WAIT_FD 0
+#define DILL_WAIT_CHAN 1
+#define DILL_WAIT_TIMER 2
+#define DILL_WAIT_SYNC 3
+#define DILL_WAIT_OTHER 4
+#define DILL_WAIT_NKINDS 5
+
+/* Time spent by the coroutines of a bundle, both running and finished.
+   'ready_ns' is the time the coroutines were ready to run but had to wait
+   for other coroutines to yield the CPU. */
+struct dill_bundle_stats {
+    uint64_t coroutines;
+    uint64_t switches;
+    uint64_t cpu_ns;
+    uint64_t ready_ns;
+    uint64_t blocked_ns[DILL_WAIT_NKINDS];
+};
+
+DILL_EXPORT int dill_bundle_stats(int h, struct dill_bundle_stats *stats);
+
+/* The thread is overloaded if coroutines have to wait for the CPU or
+   external events have to wait for the poll for longer than the target
+   (in milliseconds, 50 by default). */
+DILL_EXPORT int dill_overload_target(int64_t target);
+DILL_EXPORT int dill_overloaded(void);
+
+/* What listeners do with new connections when the thread is overloaded.
+   THROTTLE leaves them in the kernel's backlog until the overload is over.
+   REJECT accepts and immediately closes them. */
+#define DILL_OVERLOAD_IGNORE 0
+#define DILL_OVERLOAD_THROTTLE 1
+#define DILL_OVERLOAD_REJECT 2
+
+/* Allocates memory owned by the running coroutine. There's no way to
+   deallocate it explicitly, it's released once the coroutine exits. */
+DILL_EXPORT void *dill_cr_alloc(size_t size);
+
 #if !defined DILL_DISABLE_RAW_NAMES
 #define coroutine dill_coroutine
 #define go dill_go
@@ -278,7 +321,20 @@ DILL_EXPORT int dill_yield(void);
 #define bundle dill_bundle
 #define bundle_mem dill_bundle_mem
 #define bundle_wait dill_bundle_wait
+#define WAIT_FD DILL_WAIT_FD
+#define WAIT_CHAN DILL_WAIT_CHAN
+#define WAIT_TIMER DILL_WAIT_TIMER
+#define WAIT_SYNC DILL_WAIT_SYNC
+#define WAIT_OTHER DILL_WAIT_OTHER
+#define WAIT_NKINDS DILL_WAIT_NKINDS
+#define bundle_stats dill_bundle_stats
+#define overload_target dill_overload_target
+#define overloaded dill_overloaded
+#define OVERLOAD_IGNORE DILL_OVERLOAD_IGNORE
+#define OVERLOAD_THROTTLE DILL_OVERLOAD_THROTTLE
+#define OVERLOAD_REJECT DILL_OVERLOAD_REJECT
 #define yield dill_yield
+#define cr_alloc dill_cr_alloc
 #endif
 
 /******************************************************************************/
@@ -287,6 +343,9 @@ DILL_EXPORT int dill_yield(void);
 
 #define DILL_CHSEND 1
 #define DILL_CHRECV 2
+/* For these two operations 'ch' is a file descriptor. */
+#define DILL_FDIN 3
+#define DILL_FDOUT 4
 
 struct dill_chclause {
     int op;
@@ -295,13 +354,17 @@ struct dill_chclause {
     size_t len;
 };
 
-struct dill_chstorage {char _[144];} DILL_ALIGN;
+struct dill_chstorage {char _[160];} DILL_ALIGN;
 
 DILL_EXPORT int dill_chmake(
     int chv[2]);
 DILL_EXPORT int dill_chmake_mem(
     struct dill_chstorage *mem,
     int chv[2]);
+DILL_EXPORT int dill_chmake_buffered(
+    int chv[2],
+    size_t elemsize,
+    size_t capacity);
 DILL_EXPORT int dill_chsend(
     int ch,
     const void *val,
@@ -312,24 +375,491 @@ DILL_EXPORT int dill_chrecv(
     void *val,
     size_t len,
     int64_t deadline);
+DILL_EXPORT ssize_t dill_chsendv(
+    int ch,
+    const void *vals,
+    size_t len,
+    size_t count,
+    int64_t deadline);
+DILL_EXPORT ssize_t dill_chrecvv(
+    int ch,
+    void *vals,
+    size_t len,
+    size_t count,
+    int64_t deadline);
 DILL_EXPORT int dill_chdone(
     int ch);
 DILL_EXPORT int dill_choose(
     struct dill_chclause *clauses,
     int nclauses,
     int64_t deadline);
+DILL_EXPORT int dill_chselect(void);
+DILL_EXPORT int dill_chselect_add(
+    int s,
+    struct dill_chclause *clause);
+DILL_EXPORT int dill_chselect_rm(
+    int s,
+    int id);
+DILL_EXPORT int dill_chselect_wait(
+    int s,
+    int64_t deadline);
 
 #if !defined DILL_DISABLE_RAW_NAMES
 #define CHSEND DILL_CHSEND
 #define CHRECV DILL_CHRECV
+#define FDIN DILL_FDIN
+#define FDOUT DILL_FDOUT
 #define chclause dill_chclause
 #define chstorage dill_chstorage
 #define chmake dill_chmake
 #define chmake_mem dill_chmake_mem
+#define chmake_buffered dill_chmake_buffered
 #define chsend dill_chsend
 #define chrecv dill_chrecv
+#define chsendv dill_chsendv
+#define chrecvv dill_chrecvv
 #define chdone dill_chdone
 #define choose dill_choose
+#define chselect dill_chselect
+#define chselect_add dill_chselect_add
+#define chselect_rm dill_chselect_rm
+#define chselect_wait dill_chselect_wait
+#endif
+
+/******************************************************************************/
+/*  Broadcast channels.                                                       */
+/******************************************************************************/
+
+/* When the subscriber lags too far behind, skip to the newest message rather
+   than to the oldest message still within the allowed lag. */
+#define DILL_BCAST_LATEST 1
+
+DILL_EXPORT int dill_bcast(
+    size_t elemsize,
+    size_t capacity);
+DILL_EXPORT int dill_bcast_send(
+    int h,
+    const void *val,
+    size_t len);
+DILL_EXPORT int dill_bcast_subscribe(
+    int h,
+    size_t maxlag,
+    int flags);
+DILL_EXPORT int dill_bcast_recv(
+    int h,
+    void *val,
+    size_t len,
+    int64_t deadline);
+
+#if !defined DILL_DISABLE_RAW_NAMES
+#define BCAST_LATEST DILL_BCAST_LATEST
+#define bcast dill_bcast
+#define bcast_send dill_bcast_send
+#define bcast_subscribe dill_bcast_subscribe
+#define bcast_recv dill_bcast_recv
+#endif
+
+/******************************************************************************/
+/*  Synchronization primitives.                                               */
+/******************************************************************************/
+
+struct dill_mutex_storage {char _[64];} DILL_ALIGN;
+
+DILL_EXPORT int dill_mutex(void);
+DILL_EXPORT int dill_mutex_mem(
+    struct dill_mutex_storage *mem);
+DILL_EXPORT int dill_mutex_lock(
+    int h,
+    int64_t deadline);
+DILL_EXPORT int dill_mutex_unlock(
+    int h);
+
+struct dill_sem_storage {char _[64];} DILL_ALIGN;
+
+DILL_EXPORT int dill_sem(
+    int value);
+DILL_EXPORT int dill_sem_mem(
+    struct dill_sem_storage *mem,
+    int value);
+DILL_EXPORT int dill_sem_acquire(
+    int h,
+    int64_t deadline);
+DILL_EXPORT int dill_sem_release(
+    int h);
+
+struct dill_cond_storage {char _[64];} DILL_ALIGN;
+
+DILL_EXPORT int dill_cond(void);
+DILL_EXPORT int dill_cond_mem(
+    struct dill_cond_storage *mem);
+DILL_EXPORT int dill_cond_wait(
+    int h,
+    int mutex,
+    int64_t deadline);
+DILL_EXPORT int dill_cond_signal(
+    int h);
+DILL_EXPORT int dill_cond_broadcast(
+    int h);
+
+struct dill_rwlock_storage {char _[64];} DILL_ALIGN;
+
+DILL_EXPORT int dill_rwlock(void);
+DILL_EXPORT int dill_rwlock_mem(
+    struct dill_rwlock_storage *mem);
+DILL_EXPORT int dill_rwlock_rdlock(
+    int h,
+    int64_t deadline);
+DILL_EXPORT int dill_rwlock_wrlock(
+    int h,
+    int64_t deadline);
+DILL_EXPORT int dill_rwlock_unlock(
+    int h);
+
+struct dill_waitgroup_storage {char _[64];} DILL_ALIGN;
+
+DILL_EXPORT int dill_waitgroup(void);
+DILL_EXPORT int dill_waitgroup_mem(
+    struct dill_waitgroup_storage *mem);
+DILL_EXPORT int dill_waitgroup_add(
+    int h,
+    int delta);
+DILL_EXPORT int dill_waitgroup_done(
+    int h);
+DILL_EXPORT int dill_waitgroup_wait(
+    int h,
+    int64_t deadline);
+
+#if !defined DILL_DISABLE_RAW_NAMES
+#define mutex_storage dill_mutex_storage
+#define mutex dill_mutex
+#define mutex_mem dill_mutex_mem
+#define mutex_lock dill_mutex_lock
+#define mutex_unlock dill_mutex_unlock
+#define sem_storage dill_sem_storage
+#define sem dill_sem
+#define sem_mem dill_sem_mem
+#define sem_acquire dill_sem_acquire
+#define sem_release dill_sem_release
+#define cond_storage dill_cond_storage
+#define cond dill_cond
+#define cond_mem dill_cond_mem
+#define cond_wait dill_cond_wait
+#define cond_signal dill_cond_signal
+#define cond_broadcast dill_cond_broadcast
+#define rwlock_storage dill_rwlock_storage
+#define rwlock dill_rwlock
+#define rwlock_mem dill_rwlock_mem
+#define rwlock_rdlock dill_rwlock_rdlock
+#define rwlock_wrlock dill_rwlock_wrlock
+#define rwlock_unlock dill_rwlock_unlock
+#define waitgroup_storage dill_waitgroup_storage
+#define waitgroup dill_waitgroup
+#define waitgroup_mem dill_waitgroup_mem
+#define waitgroup_add dill_waitgroup_add
+#define waitgroup_done dill_waitgroup_done
+#define waitgroup_wait dill_waitgroup_wait
+#endif
+
+/******************************************************************************/
+/*  Futures.                                                                  */
+/******************************************************************************/
+
+/* Once dill_future_waitall() succeeds, the result of each individual future
+   can be checked by dill_future_wait() with zero deadline. */
+
+struct dill_future {char _[48];} DILL_ALIGN;
+
+DILL_EXPORT int dill_future_init(
+    struct dill_future *f,
+    void *val,
+    size_t len);
+DILL_EXPORT int dill_future_set(
+    struct dill_future *f,
+    const void *val,
+    size_t len);
+DILL_EXPORT int dill_future_fail(
+    struct dill_future *f,
+    int err);
+DILL_EXPORT int dill_future_wait(
+    struct dill_future *f,
+    int64_t deadline);
+DILL_EXPORT int dill_future_waitany(
+    struct dill_future **fs,
+    int nfs,
+    int64_t deadline);
+DILL_EXPORT int dill_future_waitall(
+    struct dill_future **fs,
+    int nfs,
+    int64_t deadline);
+
+#if !defined DILL_DISABLE_RAW_NAMES
+#define future dill_future
+#define future_init dill_future_init
+#define future_set dill_future_set
+#define future_fail dill_future_fail
+#define future_wait dill_future_wait
+#define future_waitany dill_future_waitany
+#define future_waitall dill_future_waitall
+#endif
+
+/******************************************************************************/
+/*  Memory allocation.                                                        */
+/******************************************************************************/
+
+/* Kinds of memory allocated by libdill. */
+#define DILL_ALLOC_OTHER 0
+#define DILL_ALLOC_STACK 1
+#define DILL_ALLOC_HANDLES 2
+#define DILL_ALLOC_POLLSET 3
+#define DILL_ALLOC_RXBUF 4
+#define DILL_ALLOC_OBJECT 5
+#define DILL_ALLOC_CHANBUF 6
+#define DILL_ALLOC_ARENA 7
+
+/* 'align' is either zero, meaning the alignment of malloc(), or a power of
+   two multiple of sizeof(void*). 'free' gets the same size and kind that were
+   passed to 'alloc'. The allocator has to be set before any other libdill
+   function is called and it's shared by all the threads. */
+struct dill_allocator {
+    void *(*alloc)(void *opaque, size_t size, size_t align, int kind);
+    void (*free)(void *opaque, void *ptr, size_t size, int kind);
+    void *opaque;
+};
+
+DILL_EXPORT int dill_set_allocator(
+    const struct dill_allocator *a);
+
+#if !defined DILL_DISABLE_RAW_NAMES
+#define ALLOC_OTHER DILL_ALLOC_OTHER
+#define ALLOC_STACK DILL_ALLOC_STACK
+#define ALLOC_HANDLES DILL_ALLOC_HANDLES
+#define ALLOC_POLLSET DILL_ALLOC_POLLSET
+#define ALLOC_RXBUF DILL_ALLOC_RXBUF
+#define ALLOC_OBJECT DILL_ALLOC_OBJECT
+#define ALLOC_CHANBUF DILL_ALLOC_CHANBUF
+#define ALLOC_ARENA DILL_ALLOC_ARENA
+#define allocator dill_allocator
+#define set_allocator dill_set_allocator
+#endif
+
+/******************************************************************************/
+/*  Object caches.                                                            */
+/******************************************************************************/
+
+/* Storage of the objects created by non-_mem functions is cached per thread
+   in size classes. */
+
+struct dill_slab_stats {
+    /* Size of the objects in the size class. */
+    size_t size;
+    /* Number of unused objects in the cache. */
+    int cached;
+    /* Maximum number of unused objects in the cache. */
+    int cap;
+    uint64_t allocs;
+    /* Number of allocations served from the cache. */
+    uint64_t hits;
+    uint64_t frees;
+};
+
+DILL_EXPORT int dill_slab_setcap(
+    int cap);
+DILL_EXPORT int dill_slab_stats(
+    struct dill_slab_stats *stats,
+    int nstats);
+
+#if !defined DILL_DISABLE_RAW_NAMES
+#define slab_stats dill_slab_stats
+#define slab_setcap dill_slab_setcap
+#endif
+
+/* Stack use is measured for one in 'every' coroutines launched by go().
+   Zero switches the sampling off. The measurement is page-granular.
+   Sampling is not supported in builds with coroutine census enabled. */
+
+struct dill_stack_stats {
+    /* Location of the go() call. */
+    const char *file;
+    int line;
+    /* Number of coroutines measured. */
+    uint64_t samples;
+    /* Maximum and percentiles of stack use in bytes. */
+    size_t max;
+    size_t p50;
+    size_t p90;
+    size_t p99;
+};
+
+DILL_EXPORT int dill_stack_sample(
+    int every);
+DILL_EXPORT int dill_stack_stats(
+    struct dill_stack_stats *stats,
+    int nstats);
+
+#if !defined DILL_DISABLE_RAW_NAMES
+#define stack_sample dill_stack_sample
+#define stack_stats dill_stack_stats
+#endif
+
+/******************************************************************************/
+/*  Tracing.                                                                  */
+/******************************************************************************/
+
+/* Scheduler events of the calling thread are recorded into a ring buffer
+   of 'nevents' events. The oldest events are overwritten. dill_trace_dump()
+   writes the recorded events to 'fd' in Chrome JSON trace format, which
+   can be loaded into chrome://tracing or Perfetto. */
+
+DILL_EXPORT int dill_trace_start(
+    size_t nevents);
+DILL_EXPORT int dill_trace_stop(void);
+DILL_EXPORT int dill_trace_dump(
+    int fd);
+
+#if !defined DILL_DISABLE_RAW_NAMES
+#define trace_start dill_trace_start
+#define trace_stop dill_trace_stop
+#define trace_dump dill_trace_dump
+#endif
+
+/******************************************************************************/
+/*  Profiling.                                                                */
+/******************************************************************************/
+
+/* Samples CPU usage of the calling thread 'hz' times per second of CPU time
+   using SIGPROF. Each sample is attributed to the go() call site of
+   the coroutine that was running at the moment. Only one thread in
+   the process can be profiled at a time. dill_prof_dump() writes the
+   samples to 'fd' in folded stack format, one "file:line count" line per
+   call site, as consumed by flamegraph.pl and similar tools. */
+
+DILL_EXPORT int dill_prof_start(
+    int hz);
+DILL_EXPORT int dill_prof_stop(void);
+DILL_EXPORT int dill_prof_dump(
+    int fd);
+
+#if !defined DILL_DISABLE_RAW_NAMES
+#define prof_start dill_prof_start
+#define prof_stop dill_prof_stop
+#define prof_dump dill_prof_dump
+#endif
+
+/* Starts a thread that watches over the calling thread. If the calling
+   thread doesn't get back to the scheduler for 'threshold' milliseconds,
+   e.g. because a coroutine is doing a blocking system call or a long
+   computation, the stalled thread is interrupted by SIGURG. The signal
+   handler writes the serial number and the go() call site of the running
+   coroutine, along with a backtrace, if available, to 'fd'. Each stall is
+   reported once. Only one thread in the process can be watched at a time;
+   the previous SIGURG handler is restored by dill_watchdog_stop(). */
+
+DILL_EXPORT int dill_watchdog_start(
+    int64_t threshold,
+    int fd);
+DILL_EXPORT int dill_watchdog_stop(void);
+
+#if !defined DILL_DISABLE_RAW_NAMES
+#define watchdog_start dill_watchdog_start
+#define watchdog_stop dill_watchdog_stop
+#endif
+
+/******************************************************************************/
+/*  Statistics.                                                               */
+/******************************************************************************/
+
+/* Socket types. */
+#define DILL_STATS_TCP 0
+#define DILL_STATS_IPC 1
+#define DILL_STATS_UDP 2
+#define DILL_STATS_NSOCKTYPES 3
+
+/* Counters of the calling thread. Fields ending in _total only ever grow,
+   the rest are current values. */
+struct dill_stats {
+    uint64_t coroutines;
+    /* Coroutines ready to run, waiting for the CPU. */
+    uint64_t ready;
+    uint64_t switches_total;
+    uint64_t polls_total;
+    uint64_t poll_ns_total;
+    /* Number of events reported by the polling mechanism. */
+    uint64_t poll_events_total;
+    /* Number of changes applied to the kernel-side pollset
+       (epoll_ctl or kevent calls). */
+    uint64_t pollset_ctls_total;
+    uint64_t timers_armed_total;
+    uint64_t timers_fired_total;
+    uint64_t timers_canceled_total;
+    uint64_t cached_stacks;
+    uint64_t handles;
+    uint64_t rxbufs;
+    /* Scheduler lag, see dill_overloaded(). */
+    uint64_t lag_ns;
+    /* Connections rejected by listeners because of overload. */
+    uint64_t rejected_total;
+    /* Indexed by DILL_STATS_* socket types. */
+    uint64_t bytes_sent_total[DILL_STATS_NSOCKTYPES];
+    uint64_t bytes_received_total[DILL_STATS_NSOCKTYPES];
+};
+
+DILL_EXPORT int dill_stats(
+    struct dill_stats *stats);
+/* Renders the statistics in Prometheus text exposition format. Returns
+   the length of the text. The text is null-terminated. If it doesn't fit
+   into the buffer, fails with ENOBUFS. */
+DILL_EXPORT ssize_t dill_stats_prometheus(
+    const struct dill_stats *stats,
+    char *buf,
+    size_t len);
+
+#if !defined DILL_DISABLE_RAW_NAMES
+#define STATS_TCP DILL_STATS_TCP
+#define STATS_IPC DILL_STATS_IPC
+#define STATS_UDP DILL_STATS_UDP
+#define STATS_NSOCKTYPES DILL_STATS_NSOCKTYPES
+#define stats dill_stats
+#define stats_prometheus dill_stats_prometheus
+#endif
+
+/* Histograms of time between a coroutine being resumed and it actually
+   running, broken down by what resumed it. Coroutines that yielded or
+   launched another coroutine are counted as DILL_WAKE_OTHER. */
+
+#define DILL_WAKE_FD 0
+#define DILL_WAKE_CHAN 1
+#define DILL_WAKE_TIMER 2
+#define DILL_WAKE_CANCEL 3
+#define DILL_WAKE_OTHER 4
+#define DILL_WAKE_NSOURCES 5
+
+#define DILL_WAKEHIST_NBUCKETS 160
+
+struct dill_wakehist {
+    uint64_t count;
+    uint64_t sum_ns;
+    uint64_t max_ns;
+    /* Number of wake-ups with latency less than or equal to bounds_ns[i]
+       and greater than bounds_ns[i - 1]. The last bound is UINT64_MAX. */
+    uint64_t bounds_ns[DILL_WAKEHIST_NBUCKETS];
+    uint64_t counts[DILL_WAKEHIST_NBUCKETS];
+};
+
+DILL_EXPORT int dill_wakehist(
+    int source,
+    struct dill_wakehist *hist);
+DILL_EXPORT int dill_wakehist_reset(void);
+
+#if !defined DILL_DISABLE_RAW_NAMES
+#define WAKE_FD DILL_WAKE_FD
+#define WAKE_CHAN DILL_WAKE_CHAN
+#define WAKE_TIMER DILL_WAKE_TIMER
+#define WAKE_CANCEL DILL_WAKE_CANCEL
+#define WAKE_OTHER DILL_WAKE_OTHER
+#define WAKE_NSOURCES DILL_WAKE_NSOURCES
+#define WAKEHIST_NBUCKETS DILL_WAKEHIST_NBUCKETS
+#define wakehist dill_wakehist
+#define wakehist_reset dill_wakehist_reset
 #endif
 
 #if !defined DILL_DISABLE_SOCKETS
@@ -373,12 +903,27 @@ DILL_EXPORT int dill_brecvl(
     struct dill_iolist *first,
     struct dill_iolist *last,
     int64_t deadline);
+/* Returns the data buffered by the socket without copying it, waiting for
+   some to arrive if there's none. The data remain valid until the next
+   operation on the socket. If called again without consuming anything in
+   between, waits for more data to be appended to the buffer. */
+DILL_EXPORT int dill_bpeek(
+    int s,
+    const void **buf,
+    size_t *len,
+    int64_t deadline);
+/* Removes len bytes from the beginning of the data returned by bpeek. */
+DILL_EXPORT int dill_bconsume(
+    int s,
+    size_t len);
 
 #if !defined DILL_DISABLE_RAW_NAMES
 #define bsend dill_bsend
 #define brecv dill_brecv
 #define bsendl dill_bsendl
 #define brecvl dill_brecvl
+#define bpeek dill_bpeek
+#define bconsume dill_bconsume
 #endif
 
 /******************************************************************************/
@@ -413,6 +958,50 @@ DILL_EXPORT ssize_t dill_mrecvl(
 #define mrecvl dill_mrecvl
 #endif
 
+/******************************************************************************/
+/*  Socket statistics.                                                        */
+/*  Supported by TCP, IPC, UDP, TLS and WebSocket sockets.                    */
+/******************************************************************************/
+
+struct dill_sock_stats {
+    /* Data passed through this socket by its user. Bytestream sockets
+       count each send or receive call as a message. */
+    uint64_t bytes_in;
+    uint64_t bytes_out;
+    uint64_t msgs_in;
+    uint64_t msgs_out;
+    /* The rest is measured at the file descriptor, i.e. for sockets layered
+       on top of other sockets it comes from the bottom-most one. */
+    uint64_t wire_bytes_in;
+    uint64_t wire_bytes_out;
+    uint64_t syscalls;
+    /* Number of syscalls that failed with EAGAIN. */
+    uint64_t eagains;
+    /* Time spent waiting for the file descriptor to become readable or
+       writable. */
+    uint64_t blocked_ns;
+    /* Receive calls served fully from the rx buffer, without a syscall. */
+    uint64_t rxbuf_hits;
+    /* Receive calls that bypassed the rx buffer and read directly into
+       user's buffer. */
+    uint64_t direct_reads;
+    /* Snapshot of TCP_INFO. Set to 1 if the fields below are valid. */
+    int tcpinfo;
+    uint32_t rtt_us;
+    uint32_t rttvar_us;
+    uint32_t retransmits;
+    /* In segments. */
+    uint32_t cwnd;
+};
+
+DILL_EXPORT int dill_sock_stats(
+    int s,
+    struct dill_sock_stats *stats);
+
+#if !defined DILL_DISABLE_RAW_NAMES
+#define sock_stats dill_sock_stats
+#endif
+
 /******************************************************************************/
 /*  IP address resolution.                                                    */
 /******************************************************************************/
@@ -489,7 +1078,7 @@ DILL_EXPORT int dill_ipaddr_equal(
 
 struct dill_tcp_listener_storage {char _[56];} DILL_ALIGN;
 
-struct dill_tcp_storage {char _[72];} DILL_ALIGN;
+struct dill_tcp_storage {char _[192];} DILL_ALIGN;
 
 DILL_EXPORT int dill_tcp_listen(
     struct dill_ipaddr *addr,
@@ -520,6 +1109,14 @@ DILL_EXPORT int dill_tcp_done(
 DILL_EXPORT int dill_tcp_close(
     int s,
     int64_t deadline);
+DILL_EXPORT int dill_tcp_listener_overload(
+    int s,
+    int policy);
+/* Sets the size of the receive buffer of a connection. Zero, the default,
+   means that the size adapts to the traffic. */
+DILL_EXPORT int dill_tcp_rxbuf(
+    int s,
+    size_t size);
 DILL_EXPORT int dill_tcp_listener_fromfd(
     int fd);
 DILL_EXPORT int dill_tcp_listener_fromfd_mem(
@@ -542,6 +1139,8 @@ DILL_EXPORT int dill_tcp_fromfd_mem(
 #define tcp_connect_mem dill_tcp_connect_mem
 #define tcp_done dill_tcp_done
 #define tcp_close dill_tcp_close
+#define tcp_listener_overload dill_tcp_listener_overload
+#define tcp_rxbuf dill_tcp_rxbuf
 #define tcp_listener_fromfd dill_tcp_listener_fromfd
 #define tcp_listener_fromfd_mem dill_tcp_listener_fromfd_mem
 #define tcp_fromfd dill_tcp_fromfd
@@ -554,9 +1153,9 @@ DILL_EXPORT int dill_tcp_fromfd_mem(
 
 struct dill_ipc_listener_storage {char _[24];} DILL_ALIGN;
 
-struct dill_ipc_storage {char _[72];} DILL_ALIGN;
+struct dill_ipc_storage {char _[176];} DILL_ALIGN;
 
-struct dill_ipc_pair_storage {char _[144];} DILL_ALIGN;
+struct dill_ipc_pair_storage {char _[352];} DILL_ALIGN;
 
 DILL_EXPORT int dill_ipc_listen(
     const char *addr,
@@ -592,6 +1191,9 @@ DILL_EXPORT int dill_ipc_done(
 DILL_EXPORT int dill_ipc_close(
     int s,
     int64_t deadline);
+DILL_EXPORT int dill_ipc_listener_overload(
+    int s,
+    int policy);
 DILL_EXPORT int dill_ipc_listener_fromfd(
     int fd);
 DILL_EXPORT int dill_ipc_listener_fromfd_mem(
@@ -622,6 +1224,7 @@ DILL_EXPORT int dill_ipc_pair_mem(
 #define ipc_recvfd dill_ipc_recvfd
 #define ipc_done dill_ipc_done
 #define ipc_close dill_ipc_close
+#define ipc_listener_overload dill_ipc_listener_overload
 #define ipc_listener_fromfd dill_ipc_listener_fromfd
 #define ipc_listener_fromfd_mem dill_ipc_listener_fromfd_mem
 #define ipc_fromfd dill_ipc_fromfd
@@ -693,7 +1296,7 @@ DILL_EXPORT int dill_suffix_detach(
 /*  Each UDP packet is treated as a separate message.                         */
 /******************************************************************************/
 
-struct dill_udp_storage {char _[72];} DILL_ALIGN;
+struct dill_udp_storage {char _[184];} DILL_ALIGN;
 
 DILL_EXPORT int dill_udp_open(
     struct dill_ipaddr *local,
@@ -807,7 +1410,7 @@ DILL_EXPORT int dill_http_recvfield(
 /*  TLS protocol.                                                             */
 /******************************************************************************/
 
-struct dill_tls_storage {char _[72];} DILL_ALIGN;
+struct dill_tls_storage {char _[176];} DILL_ALIGN;
 
 DILL_EXPORT int dill_tls_attach_server(
     int s,
@@ -891,7 +1494,7 @@ DILL_EXPORT int dill_dtls_detach(
 /*  WebSockets protocol.                                                      */
 /******************************************************************************/
 
-struct dill_ws_storage {char _[176];} DILL_ALIGN;
+struct dill_ws_storage {char _[280];} DILL_ALIGN;
 
 #define DILL_WS_BINARY 0
 #define DILL_WS_TEXT 1
@@ -1113,6 +1716,41 @@ DILL_EXPORT int dill_happyeyeballs_connect(
 #define happyeyeballs_connect dill_happyeyeballs_connect
 #endif
 
+/******************************************************************************/
+/*  Prefork server.                                                           */
+/*  Distributes incoming TCP connections among multiple worker processes.     */
+/******************************************************************************/
+
+#define DILL_PREFORK_SHARED 0
+#define DILL_PREFORK_HANDOFF 1
+
+DILL_EXPORT int dill_prefork(
+    struct dill_ipaddr *addr,
+    int backlog,
+    int nworkers,
+    int flags,
+    int *id);
+DILL_EXPORT int dill_prefork_accept(
+    int s,
+    struct dill_ipaddr *addr,
+    int64_t deadline);
+DILL_EXPORT int dill_prefork_load(
+    int s,
+    int load,
+    int64_t deadline);
+DILL_EXPORT int dill_prefork_wait(
+    int s,
+    int64_t deadline);
+
+#if !defined DILL_DISABLE_RAW_NAMES
+#define PREFORK_SHARED DILL_PREFORK_SHARED
+#define PREFORK_HANDOFF DILL_PREFORK_HANDOFF
+#define prefork dill_prefork
+#define prefork_accept dill_prefork_accept
+#define prefork_load dill_prefork_load
+#define prefork_wait dill_prefork_wait
+#endif
+
 #endif
 
 #ifdef __cplusplus
@@ -60,9 +60,22 @@ struct dill_bsock_vfs {
         struct dill_iolist *first, struct dill_iolist *last, int64_t deadline);
 };
 
+/* Optional interface of bytestream sockets that buffer inbound data.
+   It allows the user to parse the data in place instead of copying it. */
+
+DILL_EXPORT extern const void *dill_bpeek_type;
+
+struct dill_bpeek_vfs {
+    int (*bpeek)(struct dill_bpeek_vfs *vfs,
+        const void **buf, size_t *len, int64_t deadline);
+    int (*bconsume)(struct dill_bpeek_vfs *vfs, size_t len);
+};
+
 #if !defined DILL_DISABLE_RAW_NAMES
 #define bsock_vfs dill_bsock_vfs
 #define bsock_type dill_bsock_type
+#define bpeek_vfs dill_bpeek_vfs
+#define bpeek_type dill_bpeek_type
 #endif
 
 /******************************************************************************/
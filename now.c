@@ -105,6 +105,41 @@ int64_t dill_now(void) {
 #endif
 }
 
+int64_t dill_nsnow(void) {
+#if defined __APPLE__
+    static mach_timebase_info_data_t dill_mtid = {0};
+    if (dill_slow(!dill_mtid.denom))
+        mach_timebase_info(&dill_mtid);
+    uint64_t ticks = mach_absolute_time();
+    return (int64_t)(ticks * dill_mtid.numer / dill_mtid.denom);
+#else
+    struct timespec ts;
+    int rc = clock_gettime(CLOCK_MONOTONIC, &ts);
+    dill_assert(rc == 0);
+    return ((int64_t)ts.tv_sec) * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+#if !defined(__x86_64__) && !defined(__i386__)
+uint64_t dill_ticks(void) {
+    return (uint64_t)dill_nsnow();
+}
+#endif
+
+double dill_ticks_scale(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    /* TSC frequency is measured against the monotonic clock. The longer
+       the context exists, the more precise the measurement is. */
+    struct dill_ctx_now *ctx = &dill_getctx->now;
+    uint64_t ticks = dill_ticks();
+    int64_t ns = dill_nsnow();
+    if(dill_slow(ticks <= ctx->init_ticks || ns <= ctx->init_ns)) return 1.0;
+    return (double)(ns - ctx->init_ns) / (double)(ticks - ctx->init_ticks);
+#else
+    return 1.0;
+#endif
+}
+
 int dill_ctx_now_init(struct dill_ctx_now *ctx) {
 #if defined __APPLE__
     mach_timebase_info(&ctx->mtid);
@@ -113,6 +148,8 @@ int dill_ctx_now_init(struct dill_ctx_now *ctx) {
     ctx->last_time = dill_mnow();
     ctx->last_tsc = __rdtsc();
 #endif
+    ctx->init_ticks = dill_ticks();
+    ctx->init_ns = dill_nsnow();
     return 0;
 }
 
@@ -31,6 +31,10 @@
 #include <mach/mach_time.h>
 #endif
 
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
 struct dill_ctx_now {
 #if defined __APPLE__
     mach_timebase_info_data_t mtid;
@@ -39,6 +43,10 @@ struct dill_ctx_now {
     int64_t last_time;
     uint64_t last_tsc;
 #endif
+    /* Ticks and nanoseconds at the time the context was initialized.
+       Used to convert ticks to nanoseconds. */
+    uint64_t init_ticks;
+    int64_t init_ns;
 };
 
 int dill_ctx_now_init(struct dill_ctx_now *ctx);
@@ -48,5 +56,19 @@ void dill_ctx_now_term(struct dill_ctx_now *ctx);
    I.e. it can be called before calling dill_ctx_now_init(). */
 int64_t dill_mnow(void);
 
+/* Monotonic time in nanoseconds. */
+int64_t dill_nsnow(void);
+
+/* Fast high-resolution timestamp, meant for measuring short intervals.
+   On x86 this is the TSC, elsewhere it's the same as dill_nsnow(). */
+#if defined(__x86_64__) || defined(__i386__)
+#define dill_ticks() ((uint64_t)__rdtsc())
+#else
+uint64_t dill_ticks(void);
+#endif
+
+/* Number of nanoseconds per tick. */
+double dill_ticks_scale(void);
+
 #endif
 
@@ -0,0 +1,114 @@
+/*
+
+  Copyright (c) 2015 Martin Sustrik
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"),
+  to deal in the Software without restriction, including without limitation
+  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+  and/or sell copies of the Software, and to permit persons to whom
+  the Software is furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included
+  in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+  IN THE SOFTWARE.
+
+*/
+
+#include <assert.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "../libdillimpl.h"
+
+static const int type1_placeholder = 0;
+static const void *type1 = &type1_placeholder;
+static const int type2_placeholder = 0;
+static const void *type2 = &type2_placeholder;
+static const int type3_placeholder = 0;
+static const void *type3 = &type3_placeholder;
+
+struct obj {
+    struct hvfs vfs;
+    int iface1;
+    int iface2;
+    int iface3;
+};
+
+static void *obj_query(struct hvfs *vfs, const void *type) {
+    struct obj *self = (struct obj*)vfs;
+    if(type == type1) return &self->iface1;
+    if(type == type2) return &self->iface2;
+    if(type == type3) return &self->iface3;
+    errno = ENOTSUP;
+    return NULL;
+}
+
+static void obj_close(struct hvfs *vfs) {
+}
+
+static void report(const char *name, long count, int64_t start, int64_t stop) {
+    long duration = (long)(stop - start);
+    long ns = (long)((double)duration * 1000000 / count);
+    printf("%-28s %ld ns\n", name, ns);
+}
+
+int main(int argc, char *argv[]) {
+    if(argc != 2) {
+        printf("usage: handle <millions-of-operations>\n");
+        return 1;
+    }
+    long count = atol(argv[1]) * 1000000;
+    struct obj obj = {{obj_query, obj_close}, 0, 0, 0};
+
+    /* Create and close a single handle. */
+    int64_t start = now();
+    long i;
+    for(i = 0; i != count; ++i) {
+        int h = hmake(&obj.vfs);
+        hclose(h);
+    }
+    report("hmake+hclose:", count, start, now());
+
+    /* Create and close lots of handles. */
+    int hndls[1000];
+    int j;
+    start = now();
+    for(i = 0; i != count / 1000; ++i) {
+        for(j = 0; j != 1000; ++j) hndls[j] = hmake(&obj.vfs);
+        for(j = 0; j != 1000; ++j) hclose(hndls[j]);
+    }
+    report("hmake+hclose (1000 live):", (count / 1000) * 1000, start, now());
+
+    /* Query for the same type. */
+    int h = hmake(&obj.vfs);
+    void *p = NULL;
+    start = now();
+    for(i = 0; i != count; ++i) p = hquery(h, type1);
+    report("hquery (single type):", count, start, now());
+    assert(p == &obj.iface1);
+
+    /* Alternate between several types like layered sockets do. */
+    start = now();
+    for(i = 0; i != count; ++i) {
+        p = hquery(h, (i % 3) == 0 ? type1 : (i % 3) == 1 ? type2 : type3);
+    }
+    report("hquery (three types):", count, start, now());
+
+    /* Transfer the ownership. */
+    start = now();
+    for(i = 0; i != count; ++i) h = hown(h);
+    report("hown:", count, start, now());
+    hclose(h);
+
+    return 0;
+}
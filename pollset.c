@@ -39,3 +39,23 @@
 #else
 #include "poll.c.inc"
 #endif
+
+int dill_pollset_wake(struct dill_list *waiters) {
+    int fired = 0;
+    int one = 0;
+    /* Triggering a clause removes all the clauses of the coroutine from
+       their lists, possibly including more items from this list. The previous
+       item stays in the list though, so continue from there. */
+    struct dill_list *prev = waiters;
+    while(dill_list_next(prev) != waiters) {
+        struct dill_list *it = dill_list_next(prev);
+        struct dill_fdclause *fdcl = dill_cont(it, struct dill_fdclause, item);
+        if(!fdcl->all) {
+            if(one) {prev = it; continue;}
+            one = 1;
+        }
+        dill_trigger(&fdcl->cl, 0);
+        fired = 1;
+    }
+    return fired;
+}
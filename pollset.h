@@ -44,11 +44,14 @@
 int dill_ctx_pollset_init(struct dill_ctx_pollset *ctx);
 void dill_ctx_pollset_term(struct dill_ctx_pollset *ctx);
 
-/* Add waiting for an in event on the fd to the list of current clauses. */
-int dill_pollset_in(struct dill_fdclause *fdcl, int id, int fd);
+/* Add waiting for an in event on the fd to the list of current clauses.
+   Any number of coroutines can wait for the same fd. If 'all' is 0, only
+   the first such waiter is resumed when the event happens. If it is 1,
+   the waiter is resumed irrespective of the other waiters. */
+int dill_pollset_in(struct dill_fdclause *fdcl, int id, int fd, int all);
 
 /* Add waiting for an out event on the fd to the list of current clauses. */
-int dill_pollset_out(struct dill_fdclause *fdcl, int id, int fd);
+int dill_pollset_out(struct dill_fdclause *fdcl, int id, int fd, int all);
 
 /* Drop any cached info about the file descriptor. */
 int dill_pollset_clean(int fd);
@@ -57,5 +60,10 @@ int dill_pollset_clean(int fd);
   1 if at least one clause was triggered. */
 int dill_pollset_poll(int timeout);
 
+/* Resume the coroutines from the list of waiters as described in
+   dill_pollset_in(). Used by the backends. Return 1 if at least one
+   coroutine was resumed, 0 otherwise. */
+int dill_pollset_wake(struct dill_list *waiters);
+
 #endif
 
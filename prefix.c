@@ -29,6 +29,7 @@
 
 #define DILL_DISABLE_RAW_NAMES
 #include "libdillimpl.h"
+#include "slab.h"
 #include "utils.h"
 
 dill_unique_id(dill_prefix_type);
@@ -96,7 +97,8 @@ error:
 
 int dill_prefix_attach(int s, size_t hdrlen, int flags) {
     int err;
-    struct dill_prefix_sock *obj = malloc(sizeof(struct dill_prefix_sock));
+    struct dill_prefix_sock *obj = dill_slab_alloc(
+        sizeof(struct dill_prefix_sock));
     if(dill_slow(!obj)) {err = ENOMEM; goto error1;}
     s = dill_prefix_attach_mem(s, hdrlen, flags,
         (struct dill_prefix_storage*)obj);
@@ -104,7 +106,7 @@ int dill_prefix_attach(int s, size_t hdrlen, int flags) {
     obj->mem = 0;
     return s;
 error2:
-    free(obj);
+    dill_slab_free(obj, sizeof(struct dill_prefix_sock));
 error1:
     if(s >= 0) dill_hclose(s);
     errno = err;
@@ -117,7 +119,7 @@ int dill_prefix_detach(int s) {
     if(dill_slow(!self)) {err = errno; goto error;}
     if(dill_slow(self->inerr || self->outerr)) {err = ECONNRESET; goto error;}
     int u = self->u;
-    if(!self->mem) free(self);
+    if(!self->mem) dill_slab_free(self, sizeof(struct dill_prefix_sock));
     return u;
 error:
     if(s >= 0) dill_hclose(s);
@@ -194,6 +196,6 @@ static void dill_prefix_hclose(struct dill_hvfs *hvfs) {
         int rc = dill_hclose(self->u);
         dill_assert(rc == 0);
     }
-    if(!self->mem) free(self);
+    if(!self->mem) dill_slab_free(self, sizeof(struct dill_prefix_sock));
 }
 
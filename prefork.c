@@ -0,0 +1,447 @@
+/*
+
+  Copyright (c) 2018 Martin Sustrik
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"),
+  to deal in the Software without restriction, including without limitation
+  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+  and/or sell copies of the Software, and to permit persons to whom
+  the Software is furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included
+  in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+  IN THE SOFTWARE.
+
+*/
+
+#include <errno.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define DILL_DISABLE_RAW_NAMES
+#include "libdillimpl.h"
+#include "alloc.h"
+#include "ctx.h"
+#include "fd.h"
+#include "utils.h"
+
+/* The supervisor process listens on the socket and forks the workers.
+   There's an IPC connection between the supervisor and each worker.
+   In the handoff mode the supervisor accepts the connections and passes
+   them to the least loaded worker via the IPC connection. In the shared mode
+   the workers accept connections from the shared listening socket themselves.
+   Either way, the workers report their load to the supervisor via the IPC
+   connection.
+
+   Given that the child process inherits all the coroutines of the parent,
+   dill_prefork() should be called from the main coroutine before any other
+   coroutines are launched. */
+
+/* How long, in milliseconds, the supervisor waits for a worker to take
+   a connection before it considers the worker stuck. */
+#define DILL_PREFORK_HANDOFF_TIMEOUT 1000
+
+dill_unique_id(dill_prefork_type);
+dill_unique_id(dill_prefork_worker_type);
+
+/******************************************************************************/
+/*  Supervisor                                                                */
+/******************************************************************************/
+
+static void *dill_prefork_hquery(struct dill_hvfs *hvfs, const void *type);
+static void dill_prefork_hclose(struct dill_hvfs *hvfs);
+
+/* Supervisor's view of a single worker process. */
+struct dill_prefork_slot {
+    pid_t pid;
+    /* Raw file descriptor while forking, IPC handle afterwards. */
+    int s;
+    /* Load as last reported by the worker, plus the connections handed
+       to it since. */
+    int load;
+    unsigned int alive : 1;
+};
+
+struct dill_prefork {
+    struct dill_hvfs hvfs;
+    /* Listening socket. -1 in shared mode. */
+    int fd;
+    int flags;
+    /* Bundle of coroutines reading load reports from the workers. */
+    int readers;
+    /* Coroutine handing the connections to the workers. -1 in shared mode. */
+    int distributor;
+    /* Worker to start the search for the least loaded worker from.
+       This way the connections are distributed in round-robin fashion
+       among equally loaded workers. */
+    int next;
+    int nworkers;
+    /* Number of allocated slots. */
+    int nslots;
+    struct dill_prefork_slot slots[];
+};
+
+static size_t dill_prefork_size(int nslots) {
+    return sizeof(struct dill_prefork) +
+        nslots * sizeof(struct dill_prefork_slot);
+}
+
+static void *dill_prefork_hquery(struct dill_hvfs *hvfs, const void *type) {
+    struct dill_prefork *self = (struct dill_prefork*)hvfs;
+    if(type == dill_prefork_type) return self;
+    errno = ENOTSUP;
+    return NULL;
+}
+
+static dill_coroutine void dill_prefork_reader(struct dill_prefork *self,
+      int i) {
+    struct dill_prefork_slot *slot = &self->slots[i];
+    while(1) {
+        uint8_t buf[4];
+        int rc = dill_brecv(slot->s, buf, sizeof(buf), -1);
+        if(dill_slow(rc < 0 && errno == ECANCELED)) return;
+        if(dill_slow(rc < 0)) break;
+        slot->load = (int)dill_getl(buf);
+    }
+    /* Worker has closed the connection. Don't hand it any more work. */
+    slot->alive = 0;
+}
+
+static dill_coroutine void dill_prefork_distributor(struct dill_prefork *self) {
+    while(1) {
+        int as = dill_fd_accept(self->fd, NULL, NULL, -1);
+        if(dill_slow(as < 0 && errno == ECANCELED)) return;
+        if(dill_slow(as < 0)) {
+            /* E.g. running out of file descriptors. Give the workers
+               a chance to close some connections. */
+            int rc = dill_msleep(dill_now() + 100);
+            if(dill_slow(rc < 0 && errno == ECANCELED)) return;
+            continue;
+        }
+        /* Find the least loaded worker. */
+        int best = -1;
+        int i;
+        for(i = 0; i != self->nworkers; ++i) {
+            int idx = (self->next + i) % self->nworkers;
+            if(!self->slots[idx].alive) continue;
+            if(best < 0 || self->slots[idx].load < self->slots[best].load)
+                best = idx;
+        }
+        if(dill_slow(best < 0)) {dill_fd_close(as); continue;}
+        self->next = (best + 1) % self->nworkers;
+        int rc = dill_ipc_sendfd(self->slots[best].s, as,
+            dill_now() + DILL_PREFORK_HANDOFF_TIMEOUT);
+        if(dill_slow(rc < 0 && errno == ECANCELED)) {
+            dill_fd_close(as);
+            return;
+        }
+        /* Either the worker is gone or it doesn't read from the IPC
+           connection (e.g. ETIMEDOUT). Don't hand it any more work. */
+        if(dill_slow(rc < 0)) {
+            self->slots[best].alive = 0;
+            dill_fd_close(as);
+            continue;
+        }
+        /* The worker owns a copy of the socket now. Don't use dill_fd_close()
+           here as that would reset the connection. */
+        close(as);
+        /* Count the connection in until the worker reports its load. */
+        self->slots[best].load++;
+    }
+}
+
+static void dill_prefork_hclose(struct dill_hvfs *hvfs) {
+    struct dill_prefork *self = (struct dill_prefork*)hvfs;
+    int rc;
+    if(self->distributor >= 0) {
+        rc = dill_hclose(self->distributor);
+        dill_assert(rc == 0);
+    }
+    rc = dill_hclose(self->readers);
+    dill_assert(rc == 0);
+    int i;
+    for(i = 0; i != self->nworkers; ++i) {
+        struct dill_prefork_slot *slot = &self->slots[i];
+        rc = dill_hclose(slot->s);
+        dill_assert(rc == 0);
+        /* Workers that haven't exited by now are terminated forcefully. */
+        if(slot->pid > 0) {
+            kill(slot->pid, SIGKILL);
+            waitpid(slot->pid, NULL, 0);
+        }
+    }
+    if(self->fd >= 0) dill_fd_close(self->fd);
+    dill_free(self, dill_prefork_size(self->nslots), DILL_ALLOC_OBJECT);
+}
+
+int dill_prefork_wait(int s, int64_t deadline) {
+    struct dill_prefork *self = dill_hquery(s, dill_prefork_type);
+    if(dill_slow(!self)) return -1;
+    /* Reader coroutines exit when the workers close the IPC connections. */
+    int rc = dill_bundle_wait(self->readers, deadline);
+    if(dill_slow(rc < 0)) return -1;
+    int i;
+    for(i = 0; i != self->nworkers; ++i) {
+        struct dill_prefork_slot *slot = &self->slots[i];
+        if(slot->pid > 0) {
+            waitpid(slot->pid, NULL, 0);
+            slot->pid = -1;
+        }
+    }
+    return 0;
+}
+
+/******************************************************************************/
+/*  Worker                                                                    */
+/******************************************************************************/
+
+static void *dill_prefork_worker_hquery(struct dill_hvfs *hvfs,
+    const void *type);
+static void dill_prefork_worker_hclose(struct dill_hvfs *hvfs);
+
+struct dill_prefork_worker {
+    struct dill_hvfs hvfs;
+    /* IPC connection to the supervisor. */
+    int s;
+    /* Shared listening socket. -1 in handoff mode. */
+    int ls;
+};
+
+static void *dill_prefork_worker_hquery(struct dill_hvfs *hvfs,
+      const void *type) {
+    struct dill_prefork_worker *self = (struct dill_prefork_worker*)hvfs;
+    if(type == dill_prefork_worker_type) return self;
+    errno = ENOTSUP;
+    return NULL;
+}
+
+static int dill_prefork_makeworker(int fd, int lfd) {
+    int err;
+    struct dill_prefork_worker *self =
+        dill_alloc(sizeof(struct dill_prefork_worker), DILL_ALLOC_OBJECT);
+    if(dill_slow(!self)) {err = ENOMEM; goto error1;}
+    self->hvfs.query = dill_prefork_worker_hquery;
+    self->hvfs.close = dill_prefork_worker_hclose;
+    self->s = dill_ipc_fromfd(fd);
+    if(dill_slow(self->s < 0)) {err = errno; goto error2;}
+    self->ls = -1;
+    if(lfd >= 0) {
+        self->ls = dill_tcp_listener_fromfd(lfd);
+        if(dill_slow(self->ls < 0)) {err = errno; goto error3;}
+    }
+    int h = dill_hmake(&self->hvfs);
+    if(dill_slow(h < 0)) {err = errno; goto error4;}
+    return h;
+error4:
+    if(self->ls >= 0) dill_hclose(self->ls);
+error3:
+    dill_hclose(self->s);
+error2:
+    dill_free(self, sizeof(struct dill_prefork_worker), DILL_ALLOC_OBJECT);
+error1:
+    errno = err;
+    return -1;
+}
+
+int dill_prefork_accept(int s, struct dill_ipaddr *addr, int64_t deadline) {
+    struct dill_prefork_worker *self =
+        dill_hquery(s, dill_prefork_worker_type);
+    if(dill_slow(!self)) return -1;
+    /* In shared mode, compete for the connections with other workers. */
+    if(self->ls >= 0) return dill_tcp_accept(self->ls, addr, deadline);
+    /* In handoff mode, get the connection from the supervisor. */
+    int fd = dill_ipc_recvfd(self->s, deadline);
+    if(dill_slow(fd < 0)) return -1;
+    if(addr) {
+        socklen_t len = sizeof(struct dill_ipaddr);
+        int rc = getpeername(fd, (struct sockaddr*)addr, &len);
+        if(dill_slow(rc < 0)) {
+            int err = errno;
+            dill_fd_close(fd);
+            errno = err;
+            return -1;
+        }
+    }
+    int as = dill_tcp_fromfd(fd);
+    if(dill_slow(as < 0)) {
+        int err = errno;
+        close(fd);
+        errno = err;
+        return -1;
+    }
+    return as;
+}
+
+int dill_prefork_load(int s, int load, int64_t deadline) {
+    struct dill_prefork_worker *self =
+        dill_hquery(s, dill_prefork_worker_type);
+    if(dill_slow(!self)) return -1;
+    if(dill_slow(load < 0)) {errno = EINVAL; return -1;}
+    uint8_t buf[4];
+    dill_putl(buf, (uint32_t)load);
+    return dill_bsend(self->s, buf, sizeof(buf), deadline);
+}
+
+static void dill_prefork_worker_hclose(struct dill_hvfs *hvfs) {
+    struct dill_prefork_worker *self = (struct dill_prefork_worker*)hvfs;
+    int rc;
+    if(self->ls >= 0) {
+        rc = dill_hclose(self->ls);
+        dill_assert(rc == 0);
+    }
+    rc = dill_hclose(self->s);
+    dill_assert(rc == 0);
+    dill_free(self, sizeof(struct dill_prefork_worker), DILL_ALLOC_OBJECT);
+}
+
+/******************************************************************************/
+/*  Forking                                                                   */
+/******************************************************************************/
+
+int dill_prefork(struct dill_ipaddr *addr, int backlog, int nworkers,
+      int flags, int *id) {
+    int err;
+    if(dill_slow(!addr || nworkers <= 0 || !id ||
+          (flags != DILL_PREFORK_SHARED && flags != DILL_PREFORK_HANDOFF))) {
+        err = EINVAL; goto error1;}
+    struct dill_prefork *self = dill_alloc(dill_prefork_size(nworkers),
+        DILL_ALLOC_OBJECT);
+    if(dill_slow(!self)) {err = ENOMEM; goto error1;}
+    self->hvfs.query = dill_prefork_hquery;
+    self->hvfs.close = dill_prefork_hclose;
+    self->flags = flags;
+    self->readers = -1;
+    self->distributor = -1;
+    self->next = 0;
+    self->nworkers = 0;
+    self->nslots = nworkers;
+    /* Open the listening socket. */
+    self->fd = socket(dill_ipaddr_family(addr), SOCK_STREAM, 0);
+    if(dill_slow(self->fd < 0)) {err = errno; goto error2;}
+    int rc = dill_fd_unblock(self->fd);
+    if(dill_slow(rc < 0)) {err = errno; goto error3;}
+    rc = bind(self->fd, dill_ipaddr_sockaddr(addr), dill_ipaddr_len(addr));
+    if(dill_slow(rc < 0)) {err = errno; goto error3;}
+    rc = listen(self->fd, backlog);
+    if(dill_slow(rc < 0)) {err = errno; goto error3;}
+    /* If the user requested an ephemeral port,
+       retrieve the port number assigned by the OS. */
+    if(dill_ipaddr_port(addr) == 0) {
+        struct dill_ipaddr baddr;
+        socklen_t len = sizeof(struct dill_ipaddr);
+        rc = getsockname(self->fd, (struct sockaddr*)&baddr, &len);
+        if(rc < 0) {err = errno; goto error3;}
+        dill_ipaddr_setport(addr, dill_ipaddr_port(&baddr));
+    }
+    /* Fork the workers. */
+    int i;
+    for(i = 0; i != nworkers; ++i) {
+        int fds[2];
+        rc = socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+        if(dill_slow(rc < 0)) {err = errno; goto error4;}
+        pid_t pid = fork();
+        if(dill_slow(pid < 0)) {
+            err = errno;
+            close(fds[0]);
+            close(fds[1]);
+            goto error4;
+        }
+        if(pid == 0) {
+            /* Worker process. Get rid of the supervisor's state. */
+            dill_ctx_atfork();
+            int j;
+            for(j = 0; j != self->nworkers; ++j)
+                close(self->slots[j].s);
+            close(fds[0]);
+            int lfd = self->fd;
+            if(flags == DILL_PREFORK_HANDOFF) {
+                close(lfd);
+                lfd = -1;
+            }
+            dill_free(self, dill_prefork_size(self->nslots),
+                DILL_ALLOC_OBJECT);
+            int h = dill_prefork_makeworker(fds[1], lfd);
+            if(dill_slow(h < 0)) _exit(1);
+            *id = i;
+            return h;
+        }
+        /* Supervisor process. */
+        close(fds[1]);
+        self->slots[i].pid = pid;
+        self->slots[i].s = fds[0];
+        self->slots[i].load = 0;
+        self->slots[i].alive = 1;
+        self->nworkers++;
+    }
+    /* All the workers are running now. Switch to the libdill handles. */
+    for(i = 0; i != nworkers; ++i) {
+        int s = dill_ipc_fromfd(self->slots[i].s);
+        if(dill_slow(s < 0)) {
+            err = errno;
+            /* Close the handles created so far, error4 takes care
+               of the remaining raw file descriptors. */
+            int j;
+            for(j = 0; j != i; ++j) {
+                dill_hclose(self->slots[j].s);
+                self->slots[j].s = -1;
+            }
+            goto error4;
+        }
+        self->slots[i].s = s;
+    }
+    self->readers = dill_bundle();
+    if(dill_slow(self->readers < 0)) {err = errno; goto error5;}
+    for(i = 0; i != nworkers; ++i) {
+        rc = dill_bundle_go(self->readers, dill_prefork_reader(self, i));
+        if(dill_slow(rc < 0)) {err = errno; goto error5;}
+    }
+    if(flags == DILL_PREFORK_HANDOFF) {
+        self->distributor = dill_go(dill_prefork_distributor(self));
+        if(dill_slow(self->distributor < 0)) {err = errno; goto error5;}
+    }
+    else {
+        /* The listening socket is used by the workers only. Don't use
+           dill_fd_close() here as it would set SO_LINGER on the socket
+           shared with the workers. */
+        close(self->fd);
+        self->fd = -1;
+    }
+    int h = dill_hmake(&self->hvfs);
+    if(dill_slow(h < 0)) {err = errno; goto error5;}
+    *id = -1;
+    return h;
+error5:
+    if(self->distributor >= 0) dill_hclose(self->distributor);
+    if(self->readers >= 0) dill_hclose(self->readers);
+    for(i = 0; i != nworkers; ++i) {
+        dill_hclose(self->slots[i].s);
+        kill(self->slots[i].pid, SIGKILL);
+        waitpid(self->slots[i].pid, NULL, 0);
+    }
+    if(self->fd >= 0) dill_fd_close(self->fd);
+    dill_free(self, dill_prefork_size(self->nslots), DILL_ALLOC_OBJECT);
+    goto error1;
+error4:
+    for(i = 0; i != self->nworkers; ++i) {
+        if(self->slots[i].s >= 0) close(self->slots[i].s);
+        kill(self->slots[i].pid, SIGKILL);
+        waitpid(self->slots[i].pid, NULL, 0);
+    }
+error3:
+    close(self->fd);
+error2:
+    dill_free(self, dill_prefork_size(self->nslots), DILL_ALLOC_OBJECT);
+error1:
+    errno = err;
+    return -1;
+}
@@ -0,0 +1,71 @@
+/*
+
+  Copyright (c) 2016 Martin Sustrik
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"),
+  to deal in the Software without restriction, including without limitation
+  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+  and/or sell copies of the Software, and to permit persons to whom
+  the Software is furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included
+  in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+  IN THE SOFTWARE.
+
+*/
+
+#ifndef DILL_PROBES_INCLUDED
+#define DILL_PROBES_INCLUDED
+
+/* USDT (user-level statically defined tracing) probes. When the library is
+   built with DILL_USDT each probe compiles into a single NOP instruction plus
+   a note in the ELF file. Tools like bpftrace or perf can patch the NOP into
+   a breakpoint at runtime, e.g.:
+
+       bpftrace -e 'usdt:./libdill.so:libdill:cr_switch { @[arg1] = count(); }'
+
+   Without DILL_USDT the probes compile into nothing at all.
+
+   Probes and their arguments:
+
+       cr_create(cr, parent)     A coroutine was launched.
+       cr_exit(cr)               A coroutine has finished.
+       cr_switch(from, to)       Execution switched to a different coroutine.
+       cr_block(cr)              A coroutine is about to block.
+       cr_unblock(cr, source)    A coroutine was made ready (DILL_WAKE_*).
+       poll_enter(timeout)       Pollset is about to be polled (ms or -1).
+       poll_exit(fired)          Pollset poll returned.
+       timer_fire(cr)            A timer expired and woke the coroutine up.
+       sock_send(proto, nbytes)  Data were sent (proto is DILL_STATS_*).
+       sock_recv(proto, nbytes)  Data were received (proto is DILL_STATS_*).
+       tls_handshake(side, rc)   A step of the initial TLS handshake.
+                                 side is 0 for client, 1 for server.
+       tls_shutdown(rc)          A step of the terminal TLS handshake.
+
+   Coroutines are identified by their serial numbers, main coroutine being 0.
+   The numbers match those used by dill_trace_dump(). */
+
+#if defined DILL_USDT
+
+#include <sys/sdt.h>
+
+#define dill_probe1(name, a) DTRACE_PROBE1(libdill, name, a)
+#define dill_probe2(name, a, b) DTRACE_PROBE2(libdill, name, a, b)
+
+#else
+
+#define dill_probe1(name, a) do {} while(0)
+#define dill_probe2(name, a, b) do {} while(0)
+
+#endif
+
+#endif
+
@@ -0,0 +1,220 @@
+/*
+
+  Copyright (c) 2016 Martin Sustrik
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"),
+  to deal in the Software without restriction, including without limitation
+  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+  and/or sell copies of the Software, and to permit persons to whom
+  the Software is furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included
+  in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+  IN THE SOFTWARE.
+
+*/
+
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#if defined DILL_THREADS
+#include <pthread.h>
+#endif
+
+#include "alloc.h"
+#include "cr.h"
+#include "ctx.h"
+#include "prof.h"
+#include "utils.h"
+
+#define DILL_DISABLE_RAW_NAMES
+#include "libdill.h"
+
+/* Number of distinct call sites that can be profiled. */
+#define DILL_PROF_NSITES 1024
+
+/* Interval timers and signal dispositions are per process, therefore only one
+   thread can be profiled at a time. */
+static struct dill_ctx_prof *volatile dill_prof_owner = NULL;
+#if defined DILL_THREADS
+static pthread_t dill_prof_thread;
+#endif
+/* Set once our signal handler is installed. */
+static int dill_prof_installed = 0;
+static struct sigaction dill_prof_oldact;
+
+int dill_ctx_prof_init(struct dill_ctx_prof *ctx) {
+    ctx->on = 0;
+    ctx->sites = NULL;
+    ctx->capacity = 0;
+    ctx->lost = 0;
+    ctx->cr = NULL;
+    return 0;
+}
+
+void dill_ctx_prof_term(struct dill_ctx_prof *ctx) {
+    if(dill_prof_owner == ctx) {
+        int rc = dill_prof_stop();
+        dill_assert(rc == 0);
+    }
+    dill_free(ctx->sites, ctx->capacity * sizeof(struct dill_prof_site),
+        DILL_ALLOC_OTHER);
+    ctx->sites = NULL;
+}
+
+static void dill_prof_handler(int signo) {
+    struct dill_ctx_prof *ctx = dill_prof_owner;
+    if(!ctx || !ctx->on) return;
+#if defined DILL_THREADS
+    /* The signal was delivered to a thread that's not being profiled. */
+    if(!pthread_equal(pthread_self(), dill_prof_thread)) return;
+#endif
+    struct dill_cr *cr = ctx->cr->r;
+    const char *file = cr->file;
+    int line = cr->line;
+    size_t mask = ctx->capacity - 1;
+    size_t pos = (((uintptr_t)file >> 3) * 31 + line) & mask;
+    size_t i;
+    for(i = 0; i != ctx->capacity; ++i) {
+        struct dill_prof_site *site = &ctx->sites[(pos + i) & mask];
+        if(site->count == 0) {
+            site->file = file;
+            site->line = line;
+            site->count = 1;
+            return;
+        }
+        if(site->file == file && site->line == line) {
+            ++site->count;
+            return;
+        }
+    }
+    ++ctx->lost;
+}
+
+static int dill_prof_settimer(int hz) {
+    struct itimerval tv;
+    tv.it_interval.tv_sec = 0;
+    tv.it_interval.tv_usec = hz ? 1000000 / hz : 0;
+    tv.it_value = tv.it_interval;
+    return setitimer(ITIMER_PROF, &tv, NULL);
+}
+
+int dill_prof_start(int hz) {
+    struct dill_ctx_prof *ctx = &dill_getctx->prof;
+    if(dill_slow(hz <= 0 || hz > 1000000)) {errno = EINVAL; return -1;}
+    if(!__sync_bool_compare_and_swap(&dill_prof_owner, NULL, ctx) &&
+          dill_prof_owner != ctx) {
+        errno = EBUSY; return -1;}
+    ctx->on = 0;
+    if(!ctx->sites) {
+        ctx->sites = dill_alloc(
+            DILL_PROF_NSITES * sizeof(struct dill_prof_site),
+            DILL_ALLOC_OTHER);
+        if(dill_slow(!ctx->sites)) {dill_prof_owner = NULL; return -1;}
+        ctx->capacity = DILL_PROF_NSITES;
+    }
+    memset(ctx->sites, 0, ctx->capacity * sizeof(struct dill_prof_site));
+    ctx->lost = 0;
+    ctx->cr = &dill_getctx->cr;
+#if defined DILL_THREADS
+    dill_prof_thread = pthread_self();
+#endif
+    if(!dill_prof_installed) {
+        struct sigaction act;
+        memset(&act, 0, sizeof(act));
+        act.sa_handler = dill_prof_handler;
+        act.sa_flags = SA_RESTART;
+        sigemptyset(&act.sa_mask);
+        int rc = sigaction(SIGPROF, &act, &dill_prof_oldact);
+        if(dill_slow(rc < 0)) {dill_prof_owner = NULL; return -1;}
+        dill_prof_installed = 1;
+    }
+    ctx->on = 1;
+    int rc = dill_prof_settimer(hz);
+    if(dill_slow(rc < 0)) {
+        int err = errno;
+        dill_prof_stop();
+        errno = err;
+        return -1;
+    }
+    return 0;
+}
+
+int dill_prof_stop(void) {
+    struct dill_ctx_prof *ctx = &dill_getctx->prof;
+    if(dill_prof_owner != ctx) return 0;
+    ctx->on = 0;
+    int rc = dill_prof_settimer(0);
+    dill_assert(rc == 0);
+    /* If there was no handler before, keep ours in place. It does nothing
+       when the profiler is off, while the default action for SIGPROF, which
+       may still be pending, is to terminate the process. */
+    if(dill_prof_oldact.sa_handler != SIG_DFL) {
+        rc = sigaction(SIGPROF, &dill_prof_oldact, NULL);
+        dill_assert(rc == 0);
+        dill_prof_installed = 0;
+    }
+    dill_prof_owner = NULL;
+    return 0;
+}
+
+static int dill_prof_write(int fd, const char *buf, size_t len) {
+    while(len) {
+        ssize_t sz = write(fd, buf, len);
+        if(dill_slow(sz < 0)) {
+            if(errno == EINTR) continue;
+            return -1;
+        }
+        buf += sz;
+        len -= sz;
+    }
+    return 0;
+}
+
+int dill_prof_dump(int fd) {
+    struct dill_ctx_prof *ctx = &dill_getctx->prof;
+    if(dill_slow(fd < 0 || !ctx->sites)) {errno = EINVAL; return -1;}
+    /* Don't let the signal handler modify the table while it's being
+       printed out. */
+    sig_atomic_t on = ctx->on;
+    ctx->on = 0;
+    int err = 0;
+    char buf[4096];
+    size_t i;
+    for(i = 0; i != ctx->capacity; ++i) {
+        struct dill_prof_site *site = &ctx->sites[i];
+        if(!site->count) continue;
+        int sz;
+        if(site->file)
+            sz = snprintf(buf, sizeof(buf), "%s:%d %llu\n", site->file,
+                site->line, (unsigned long long)site->count);
+        else
+            sz = snprintf(buf, sizeof(buf), "main %llu\n",
+                (unsigned long long)site->count);
+        if(sz >= (int)sizeof(buf)) sz = sizeof(buf) - 1;
+        int rc = dill_prof_write(fd, buf, sz);
+        if(dill_slow(rc < 0)) {err = errno; break;}
+    }
+    if(!err && ctx->lost) {
+        int sz = snprintf(buf, sizeof(buf), "[unknown] %llu\n",
+            (unsigned long long)ctx->lost);
+        int rc = dill_prof_write(fd, buf, sz);
+        if(dill_slow(rc < 0)) err = errno;
+    }
+    ctx->on = on;
+    if(dill_slow(err)) {errno = err; return -1;}
+    return 0;
+}
+
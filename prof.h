@@ -0,0 +1,62 @@
+/*
+
+  Copyright (c) 2016 Martin Sustrik
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"),
+  to deal in the Software without restriction, including without limitation
+  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+  and/or sell copies of the Software, and to permit persons to whom
+  the Software is furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included
+  in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+  IN THE SOFTWARE.
+
+*/
+
+#ifndef DILL_PROF_INCLUDED
+#define DILL_PROF_INCLUDED
+
+#include <signal.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "cr.h"
+
+/* Samples are aggregated by the place where the sampled coroutine was
+   launched. */
+struct dill_prof_site {
+    /* NULL means main coroutine. */
+    const char *file;
+    int line;
+    /* Zero means the slot is empty. */
+    uint64_t count;
+};
+
+struct dill_ctx_prof {
+    /* 1 if samples are being recorded. Accessed from the signal handler. */
+    volatile sig_atomic_t on;
+    /* Open-addressing hash table of call sites. Capacity is a power of
+       two. Allocated when the profiler is started for the first time. */
+    struct dill_prof_site *sites;
+    size_t capacity;
+    /* Number of samples that didn't fit into the table. */
+    uint64_t lost;
+    /* Coroutine context of the thread, so that the signal handler can
+       find out what coroutine is running. */
+    struct dill_ctx_cr *cr;
+};
+
+int dill_ctx_prof_init(struct dill_ctx_prof *ctx);
+void dill_ctx_prof_term(struct dill_ctx_prof *ctx);
+
+#endif
+
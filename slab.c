@@ -0,0 +1,143 @@
+/*
+
+  Copyright (c) 2016 Martin Sustrik
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"),
+  to deal in the Software without restriction, including without limitation
+  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+  and/or sell copies of the Software, and to permit persons to whom
+  the Software is furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included
+  in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+  IN THE SOFTWARE.
+
+*/
+
+#include <errno.h>
+#include <stdlib.h>
+
+#include "alloc.h"
+#include "ctx.h"
+#include "slab.h"
+#include "utils.h"
+
+#define DILL_DISABLE_RAW_NAMES
+#include "libdill.h"
+
+/* Object storage is cached per thread. Given that handles can't be passed
+   between threads, the objects are always deallocated by the thread that
+   allocated them, so there's no need for synchronization. */
+
+/* Default maximum number of unused objects per size class. */
+#define DILL_SLAB_DEFAULTCAP 256
+
+/* Returns the index of the size class for the given size or -1 if the object
+   is too large to be cached. */
+static int dill_slab_class(size_t size) {
+    int i;
+    size_t sz = 1 << DILL_SLAB_MINSHIFT;
+    for(i = 0; i != DILL_SLAB_NCLASSES; ++i, sz <<= 1)
+        if(size <= sz) return i;
+    return -1;
+}
+
+/* Returns the size of the objects in the size class. */
+static size_t dill_slab_size(int c) {
+    return (size_t)1 << (c + DILL_SLAB_MINSHIFT);
+}
+
+int dill_ctx_slab_init(struct dill_ctx_slab *ctx) {
+    ctx->cap = DILL_SLAB_DEFAULTCAP;
+    int i;
+    for(i = 0; i != DILL_SLAB_NCLASSES; ++i) {
+        struct dill_slab_class *cls = &ctx->classes[i];
+        dill_slist_init(&cls->cache);
+        cls->count = 0;
+        cls->allocs = 0;
+        cls->hits = 0;
+        cls->frees = 0;
+    }
+    return 0;
+}
+
+/* Deallocates the cached objects above the limit. */
+static void dill_slab_trim(struct dill_ctx_slab *ctx, int c, int limit) {
+    struct dill_slab_class *cls = &ctx->classes[c];
+    while(cls->count > limit) {
+        dill_free(dill_slist_pop(&cls->cache), dill_slab_size(c),
+            DILL_ALLOC_OBJECT);
+        --cls->count;
+    }
+}
+
+void dill_ctx_slab_term(struct dill_ctx_slab *ctx) {
+    int i;
+    for(i = 0; i != DILL_SLAB_NCLASSES; ++i)
+        dill_slab_trim(ctx, i, 0);
+}
+
+void *dill_slab_alloc(size_t size) {
+    int c = dill_slab_class(size);
+    if(dill_slow(c < 0)) return dill_alloc(size, DILL_ALLOC_OBJECT);
+    struct dill_slab_class *cls = &dill_getctx->slab.classes[c];
+    ++cls->allocs;
+    if(dill_fast(cls->count)) {
+        ++cls->hits;
+        --cls->count;
+        return dill_slist_pop(&cls->cache);
+    }
+    /* Allocate the full size of the class so that the object can be reused
+       for any size within the class. */
+    return dill_alloc(dill_slab_size(c), DILL_ALLOC_OBJECT);
+}
+
+void dill_slab_free(void *ptr, size_t size) {
+    if(dill_slow(!ptr)) return;
+    int c = dill_slab_class(size);
+    if(dill_slow(c < 0)) {dill_free(ptr, size, DILL_ALLOC_OBJECT); return;}
+    struct dill_ctx_slab *ctx = &dill_getctx->slab;
+    struct dill_slab_class *cls = &ctx->classes[c];
+    ++cls->frees;
+    if(dill_slow(cls->count >= ctx->cap)) {
+        dill_free(ptr, dill_slab_size(c), DILL_ALLOC_OBJECT);
+        return;
+    }
+    dill_slist_push(&cls->cache, (struct dill_slist*)ptr);
+    ++cls->count;
+}
+
+int dill_slab_setcap(int cap) {
+    if(dill_slow(cap < 0)) {errno = EINVAL; return -1;}
+    struct dill_ctx_slab *ctx = &dill_getctx->slab;
+    ctx->cap = cap;
+    int i;
+    for(i = 0; i != DILL_SLAB_NCLASSES; ++i)
+        dill_slab_trim(ctx, i, cap);
+    return 0;
+}
+
+int dill_slab_stats(struct dill_slab_stats *stats, int nstats) {
+    if(dill_slow(nstats < 0 || (nstats > 0 && !stats))) {
+        errno = EINVAL; return -1;}
+    struct dill_ctx_slab *ctx = &dill_getctx->slab;
+    int i;
+    for(i = 0; i != DILL_SLAB_NCLASSES && i != nstats; ++i) {
+        struct dill_slab_class *cls = &ctx->classes[i];
+        stats[i].size = dill_slab_size(i);
+        stats[i].cached = cls->count;
+        stats[i].cap = ctx->cap;
+        stats[i].allocs = cls->allocs;
+        stats[i].hits = cls->hits;
+        stats[i].frees = cls->frees;
+    }
+    return DILL_SLAB_NCLASSES;
+}
@@ -0,0 +1,65 @@
+/*
+
+  Copyright (c) 2016 Martin Sustrik
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"),
+  to deal in the Software without restriction, including without limitation
+  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+  and/or sell copies of the Software, and to permit persons to whom
+  the Software is furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included
+  in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+  IN THE SOFTWARE.
+
+*/
+
+#ifndef DILL_SLAB_INCLUDED
+#define DILL_SLAB_INCLUDED
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "slist.h"
+
+/* Objects are cached in size classes of 64, 128, ..., 2048 bytes. */
+#define DILL_SLAB_MINSHIFT 6
+#define DILL_SLAB_NCLASSES 6
+
+struct dill_slab_class {
+    /* Unused objects, LIFO so that the most recently used, and thus most
+       likely cache-hot, object is reused first. */
+    struct dill_slist cache;
+    int count;
+    uint64_t allocs;
+    uint64_t hits;
+    uint64_t frees;
+};
+
+struct dill_ctx_slab {
+    /* Maximum number of unused objects cached per size class. */
+    int cap;
+    struct dill_slab_class classes[DILL_SLAB_NCLASSES];
+};
+
+int dill_ctx_slab_init(struct dill_ctx_slab *ctx);
+void dill_ctx_slab_term(struct dill_ctx_slab *ctx);
+
+/* Allocates an object of the given size. Objects that don't fit into any
+   size class are allocated directly by malloc(). Sets errno to ENOMEM
+   on failure. */
+void *dill_slab_alloc(size_t size);
+
+/* Deallocates an object. 'size' must be the same as was passed to
+   dill_slab_alloc(). */
+void dill_slab_free(void *ptr, size_t size);
+
+#endif
@@ -0,0 +1,95 @@
+/*
+
+  Copyright (c) 2016 Martin Sustrik
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"),
+  to deal in the Software without restriction, including without limitation
+  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+  and/or sell copies of the Software, and to permit persons to whom
+  the Software is furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included
+  in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+  IN THE SOFTWARE.
+
+*/
+
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <string.h>
+#include <sys/socket.h>
+
+#define DILL_DISABLE_RAW_NAMES
+#include "libdillimpl.h"
+#include "now.h"
+#include "sockstats.h"
+#include "utils.h"
+
+dill_unique_id(dill_sockstats_type);
+
+void dill_sockstats_init(struct dill_sockstats *st, int fd, int u) {
+    memset(st, 0, sizeof(struct dill_sockstats));
+    st->lower = u >= 0 ? dill_hquery(u, dill_sockstats_type) : NULL;
+    st->fd = fd;
+}
+
+int dill_sockstats_fdin(struct dill_sockstats *st, int fd, int64_t deadline) {
+    uint64_t start = dill_ticks();
+    int rc = dill_fdin(fd, deadline);
+    st->blocked += dill_ticks() - start;
+    return rc;
+}
+
+int dill_sockstats_fdout(struct dill_sockstats *st, int fd, int64_t deadline) {
+    uint64_t start = dill_ticks();
+    int rc = dill_fdout(fd, deadline);
+    st->blocked += dill_ticks() - start;
+    return rc;
+}
+
+int dill_sock_stats(int s, struct dill_sock_stats *stats) {
+    if(dill_slow(!stats)) {errno = EINVAL; return -1;}
+    struct dill_sockstats *st = dill_hquery(s, dill_sockstats_type);
+    if(dill_slow(!st)) return -1;
+    memset(stats, 0, sizeof(struct dill_sock_stats));
+    stats->bytes_in = st->bytes_in;
+    stats->bytes_out = st->bytes_out;
+    stats->msgs_in = st->msgs_in;
+    stats->msgs_out = st->msgs_out;
+    /* Everything else is measured at the file descriptor, i.e. at the
+       bottom-most layer of the protocol stack. */
+    while(st->lower) st = st->lower;
+    stats->wire_bytes_in = st->wire_in;
+    stats->wire_bytes_out = st->wire_out;
+    stats->syscalls = st->syscalls;
+    stats->eagains = st->eagains;
+    stats->blocked_ns = (uint64_t)((double)st->blocked * dill_ticks_scale());
+    stats->rxbuf_hits = st->rxbuf_hits;
+    stats->direct_reads = st->direct_reads;
+#if defined __linux__ && defined TCP_INFO
+    if(st->fd >= 0) {
+        struct tcp_info ti;
+        socklen_t tilen = sizeof(ti);
+        /* Fails for anything else than TCP sockets. */
+        int rc = getsockopt(st->fd, IPPROTO_TCP, TCP_INFO, &ti, &tilen);
+        if(rc == 0) {
+            stats->tcpinfo = 1;
+            stats->rtt_us = ti.tcpi_rtt;
+            stats->rttvar_us = ti.tcpi_rttvar;
+            stats->retransmits = ti.tcpi_total_retrans;
+            stats->cwnd = ti.tcpi_snd_cwnd;
+        }
+    }
+#endif
+    return 0;
+}
+
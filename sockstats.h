@@ -0,0 +1,64 @@
+/*
+
+  Copyright (c) 2016 Martin Sustrik
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"),
+  to deal in the Software without restriction, including without limitation
+  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+  and/or sell copies of the Software, and to permit persons to whom
+  the Software is furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included
+  in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+  IN THE SOFTWARE.
+
+*/
+
+#ifndef DILL_SOCKSTATS_INCLUDED
+#define DILL_SOCKSTATS_INCLUDED
+
+#include <stdint.h>
+
+/* Per-socket counters. Sockets that support dill_sock_stats() embed this
+   structure and return it from their hquery() function when asked for
+   dill_sockstats_type. */
+struct dill_sockstats {
+    /* Counters of the socket this one is layered on top of. NULL for
+       sockets that own a file descriptor. */
+    struct dill_sockstats *lower;
+    /* Underlying file descriptor, -1 for layered sockets. */
+    int fd;
+    uint64_t bytes_in;
+    uint64_t bytes_out;
+    uint64_t msgs_in;
+    uint64_t msgs_out;
+    /* Bytes actually transferred through the file descriptor. */
+    uint64_t wire_in;
+    uint64_t wire_out;
+    uint64_t syscalls;
+    uint64_t eagains;
+    /* Time spent waiting for the file descriptor, in ticks. */
+    uint64_t blocked;
+    uint64_t rxbuf_hits;
+    uint64_t direct_reads;
+};
+
+extern const void *dill_sockstats_type;
+
+/* If u is a valid handle its counters are used as the lower layer. */
+void dill_sockstats_init(struct dill_sockstats *st, int fd, int u);
+/* Same as dill_fdin() and dill_fdout() but account the time spent
+   waiting. */
+int dill_sockstats_fdin(struct dill_sockstats *st, int fd, int64_t deadline);
+int dill_sockstats_fdout(struct dill_sockstats *st, int fd, int64_t deadline);
+
+#endif
+
@@ -30,10 +30,14 @@
 #include <unistd.h>
 #include <sys/mman.h>
 
+#include "alloc.h"
 #include "stack.h"
 #include "utils.h"
 #include "ctx.h"
 
+#define DILL_DISABLE_RAW_NAMES
+#include "libdill.h"
+
 /* The stacks are cached. The advantage of this is twofold. First, caching is
    faster than malloc(). Second, it results in fewer calls to
    mprotect(). */
@@ -42,6 +46,8 @@
 static size_t dill_stack_size = 256 * 1024;
 /* Maximum number of unused cached stacks. Must be at least 1. */
 static int dill_max_cached_stacks = 64;
+/* By default, stack use is measured for one in this many coroutines. */
+#define DILL_STACK_EVERY 64
 
 /* Returns the smallest value that's greater than val and is a multiple of unit. */
 static size_t dill_align(size_t val, size_t unit) {
@@ -58,9 +64,29 @@ static size_t dill_page_size(void) {
     return (size_t)pgsz;
 }
 
+/* Size of the memory block allocated for a single stack. */
+static size_t dill_stack_allocsize(void) {
+#if (HAVE_POSIX_MEMALIGN && HAVE_MPROTECT) & !defined DILL_NOGUARD
+    /* The stack is memory-page-aligned. One extra page is used as a stack
+       overflow guard. */
+    return dill_align(dill_stack_size, dill_page_size()) + dill_page_size();
+#else
+    return dill_stack_size;
+#endif
+}
+
 int dill_ctx_stack_init(struct dill_ctx_stack *ctx) {
     ctx->count = 0;
     dill_slist_init(&ctx->cache);
+#if defined HAVE_MINCORE && !defined DILL_CENSUS
+    ctx->every = DILL_STACK_EVERY;
+#else
+    ctx->every = 0;
+#endif
+    ctx->countdown = ctx->every;
+    ctx->sites = NULL;
+    ctx->nsites = 0;
+    ctx->capacity = 0;
     return 0;
 }
 
@@ -72,12 +98,15 @@ void dill_ctx_stack_term(struct dill_ctx_stack *ctx) {
         void *ptr = ((uint8_t*)(it + 1)) - dill_stack_size - dill_page_size();
         int rc = mprotect(ptr, dill_page_size(), PROT_READ|PROT_WRITE);
         dill_assert(rc == 0);
-        free(ptr);
+        dill_free(ptr, dill_stack_allocsize(), DILL_ALLOC_STACK);
 #else
         void *ptr = ((uint8_t*)(it + 1)) - dill_stack_size;
-        free(ptr);
+        dill_free(ptr, dill_stack_allocsize(), DILL_ALLOC_STACK);
 #endif
     }
+    dill_free(ctx->sites, ctx->capacity * sizeof(struct dill_stack_site),
+        DILL_ALLOC_OTHER);
+    ctx->sites = NULL;
 }
 
 void *dill_allocstack(size_t *stack_size) {
@@ -94,31 +123,23 @@ void *dill_allocstack(size_t *stack_size) {
 #if (HAVE_POSIX_MEMALIGN && HAVE_MPROTECT) & !defined DILL_NOGUARD
     /* Allocate the stack so that it's memory-page-aligned.
        Add one page as a stack overflow guard. */
-    size_t sz = dill_align(dill_stack_size, dill_page_size()) +
-        dill_page_size();
-    uint8_t *ptr;
-    int rc = posix_memalign((void**)&ptr, dill_page_size(), sz);
-    if(dill_slow(rc != 0)) {
-        errno = rc;
-        return NULL;
-    }
+    uint8_t *ptr = dill_alloc_aligned(dill_stack_allocsize(),
+        dill_page_size(), DILL_ALLOC_STACK);
+    if(dill_slow(!ptr)) return NULL;
     /* The bottom page is used as a stack guard. This way a stack overflow will
        cause a segfault instead of randomly overwriting the heap. */
-    rc = mprotect(ptr, dill_page_size(), PROT_NONE);
+    int rc = mprotect(ptr, dill_page_size(), PROT_NONE);
     if(dill_slow(rc != 0)) {
         int err = errno;
-        free(ptr);
+        dill_free(ptr, dill_stack_allocsize(), DILL_ALLOC_STACK);
         errno = err;
         return NULL;
     }
     top = ptr + dill_page_size() + dill_stack_size;
 #else
     /* Simple allocation without a guard page. */
-    uint8_t *ptr = malloc(dill_stack_size);
-    if(dill_slow(!ptr)) {
-        errno = ENOMEM;
-        return NULL;
-    }
+    uint8_t *ptr = dill_alloc(dill_stack_allocsize(), DILL_ALLOC_STACK);
+    if(dill_slow(!ptr)) return NULL;
     top = ptr + dill_stack_size;
 #endif
     return top;
@@ -137,10 +158,10 @@ void dill_freestack(void *stack) {
         void *ptr = ((uint8_t*)(old + 1)) - dill_stack_size - dill_page_size();
         int rc = mprotect(ptr, dill_page_size(), PROT_READ|PROT_WRITE);
         dill_assert(rc == 0);
-        free(ptr);
+        dill_free(ptr, dill_stack_allocsize(), DILL_ALLOC_STACK);
 #else
         void *ptr = ((uint8_t*)(old + 1)) - dill_stack_size;
-        free(ptr);
+        dill_free(ptr, dill_stack_allocsize(), DILL_ALLOC_STACK);
 #endif
     }
     /* Put the stack into the cache. */
@@ -148,3 +169,154 @@ void dill_freestack(void *stack) {
     ++ctx->count;
 }
 
+/******************************************************************************/
+/*  High-water mark sampling.                                                 */
+/******************************************************************************/
+
+/* Unlike census, which fills the entire stack with a pattern and scans it
+   afterwards, the sampling works at page granularity. Pages of the stack that
+   are not yet in use are returned to the OS when the coroutine starts. When
+   it finishes, mincore() tells which of them were faulted back in.
+   Returning the pages to the OS zeroes them and thus wipes out the census
+   pattern, so in census builds the sampling is not available. */
+
+int dill_stack_hwmark(void *stack, void *used) {
+#if defined HAVE_MINCORE
+    struct dill_ctx_stack *ctx = &dill_getctx->stack;
+    if(dill_fast(ctx->every == 0 || --ctx->countdown > 0)) return 0;
+    ctx->countdown = ctx->every;
+    uint8_t *bottom = ((uint8_t*)stack) - dill_stack_size;
+    uint8_t *top = (uint8_t*)((uintptr_t)used & ~(dill_page_size() - 1));
+    if(dill_slow(top <= bottom)) return 0;
+    int rc = madvise(bottom, top - bottom, MADV_DONTNEED);
+    return rc == 0;
+#else
+    return 0;
+#endif
+}
+
+static struct dill_stack_site *dill_stack_site(struct dill_ctx_stack *ctx,
+      const char *file, int line) {
+    /* Keep the table at most half full. */
+    if(ctx->nsites * 2 >= ctx->capacity) {
+        size_t capacity = ctx->capacity ? ctx->capacity * 2 : 64;
+        struct dill_stack_site *sites = dill_alloc(
+            capacity * sizeof(struct dill_stack_site), DILL_ALLOC_OTHER);
+        if(dill_slow(!sites)) return NULL;
+        memset(sites, 0, capacity * sizeof(struct dill_stack_site));
+        struct dill_stack_site *old = ctx->sites;
+        size_t oldcapacity = ctx->capacity;
+        ctx->sites = sites;
+        ctx->capacity = capacity;
+        ctx->nsites = 0;
+        size_t i;
+        for(i = 0; i != oldcapacity; ++i) {
+            if(!old[i].file) continue;
+            struct dill_stack_site *site = dill_stack_site(ctx, old[i].file,
+                old[i].line);
+            *site = old[i];
+        }
+        dill_free(old, oldcapacity * sizeof(struct dill_stack_site),
+            DILL_ALLOC_OTHER);
+    }
+    size_t mask = ctx->capacity - 1;
+    size_t pos = (((uintptr_t)file >> 3) * 31 + line) & mask;
+    while(1) {
+        struct dill_stack_site *site = &ctx->sites[pos];
+        if(!site->file) {
+            site->file = file;
+            site->line = line;
+            ++ctx->nsites;
+            return site;
+        }
+        if(site->file == file && site->line == line) return site;
+        pos = (pos + 1) & mask;
+    }
+}
+
+void dill_stack_hwrecord(void *stack, void *used, const char *file,
+      int line) {
+#if defined HAVE_MINCORE
+    struct dill_ctx_stack *ctx = &dill_getctx->stack;
+    size_t pgsz = dill_page_size();
+    uint8_t *bottom = ((uint8_t*)stack) - dill_stack_size;
+    uint8_t *top = (uint8_t*)((uintptr_t)used & ~(pgsz - 1));
+    /* Find the lowest page that was touched. Query in batches so that
+       the result vector fits on the stack. */
+    uint8_t *lowest = top;
+    unsigned char vec[64];
+    uint8_t *pos = bottom;
+    while(pos < top) {
+        size_t npages = (top - pos) / pgsz;
+        if(npages > sizeof(vec)) npages = sizeof(vec);
+        int rc = mincore(pos, npages * pgsz, (void*)vec);
+        if(dill_slow(rc < 0)) return;
+        size_t i;
+        for(i = 0; i != npages; ++i) {
+            if(vec[i] & 1) {
+                lowest = pos + i * pgsz;
+                break;
+            }
+        }
+        if(lowest != top) break;
+        pos += npages * pgsz;
+    }
+    size_t size = ((uint8_t*)stack) - lowest;
+    struct dill_stack_site *site = dill_stack_site(ctx, file, line);
+    if(dill_slow(!site)) return;
+    ++site->samples;
+    if(size > site->max) site->max = size;
+    size_t b = (size + pgsz - 1) / pgsz - 1;
+    if(b >= DILL_STACK_NBUCKETS) b = DILL_STACK_NBUCKETS - 1;
+    ++site->buckets[b];
+#endif
+}
+
+int dill_stack_sample(int every) {
+    if(dill_slow(every < 0)) {errno = EINVAL; return -1;}
+#if !defined HAVE_MINCORE || defined DILL_CENSUS
+    if(dill_slow(every > 0)) {errno = ENOTSUP; return -1;}
+#endif
+    struct dill_ctx_stack *ctx = &dill_getctx->stack;
+    ctx->every = every;
+    ctx->countdown = every;
+    return 0;
+}
+
+/* Returns the number of bytes used by at least 'pct' percent of
+   the sampled coroutines. */
+static size_t dill_stack_percentile(struct dill_stack_site *site, int pct) {
+    uint64_t limit = (site->samples * pct + 99) / 100;
+    uint64_t sum = 0;
+    int i;
+    for(i = 0; i != DILL_STACK_NBUCKETS - 1; ++i) {
+        sum += site->buckets[i];
+        if(sum >= limit) break;
+    }
+    size_t size = (i + 1) * dill_page_size();
+    return size < site->max ? size : site->max;
+}
+
+int dill_stack_stats(struct dill_stack_stats *stats, int nstats) {
+    if(dill_slow(nstats < 0 || (nstats > 0 && !stats))) {
+        errno = EINVAL; return -1;}
+    struct dill_ctx_stack *ctx = &dill_getctx->stack;
+    int n = 0;
+    size_t i;
+    for(i = 0; i != ctx->capacity; ++i) {
+        struct dill_stack_site *site = &ctx->sites[i];
+        if(!site->file) continue;
+        if(n < nstats) {
+            stats[n].file = site->file;
+            stats[n].line = site->line;
+            stats[n].samples = site->samples;
+            stats[n].max = site->max;
+            stats[n].p50 = dill_stack_percentile(site, 50);
+            stats[n].p90 = dill_stack_percentile(site, 90);
+            stats[n].p99 = dill_stack_percentile(site, 99);
+        }
+        ++n;
+    }
+    return n;
+}
+
@@ -26,9 +26,24 @@
 #define DILL_STACK_INCLUDED
 
 #include <stddef.h>
+#include <stdint.h>
 
 #include "slist.h"
 
+/* Number of buckets in the histogram of stack use. Bucket i counts
+   coroutines that have used i+1 memory pages. The last bucket also counts
+   all the coroutines that have used more. */
+#define DILL_STACK_NBUCKETS 64
+
+struct dill_stack_site {
+    /* NULL if the slot is empty. */
+    const char *file;
+    int line;
+    uint64_t samples;
+    size_t max;
+    uint64_t buckets[DILL_STACK_NBUCKETS];
+};
+
 /* A stack of unused coroutine stacks. This allows for extra-fast allocation
    of a new stack. The LIFO nature of this structure minimises cache misses.
    When the stack is cached its dill_qlist_item is placed on its top rather
@@ -36,6 +51,15 @@
 struct dill_ctx_stack {
     int count;
     struct dill_slist cache;
+    /* High-water marks are measured for one in 'every' coroutines.
+       Zero means that sampling is switched off. */
+    int every;
+    int countdown;
+    /* Open-addressing hash table of go() call sites. Capacity is a power
+       of two. */
+    struct dill_stack_site *sites;
+    size_t nsites;
+    size_t capacity;
 };
 
 int dill_ctx_stack_init(struct dill_ctx_stack *ctx);
@@ -48,4 +72,14 @@ void *dill_allocstack(size_t *stack_size);
 /* Deallocates a stack. The argument is pointer to the top of the stack. */
 void dill_freestack(void *stack);
 
+/* Decides whether the high-water mark of a stack allocated by
+   dill_allocstack() should be measured. If so, returns 1. 'used' is
+   the lowest address of the stack that's already in use. */
+int dill_stack_hwmark(void *stack, void *used);
+
+/* Measures the high-water mark of a stack that was picked for sampling by
+   dill_stack_hwmark() and attributes it to the go() call site. */
+void dill_stack_hwrecord(void *stack, void *used, const char *file,
+    int line);
+
 #endif
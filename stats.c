@@ -0,0 +1,209 @@
+/*
+
+  Copyright (c) 2016 Martin Sustrik
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"),
+  to deal in the Software without restriction, including without limitation
+  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+  and/or sell copies of the Software, and to permit persons to whom
+  the Software is furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included
+  in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+  IN THE SOFTWARE.
+
+*/
+
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "cr.h"
+#include "ctx.h"
+#include "utils.h"
+
+#define DILL_DISABLE_RAW_NAMES
+#include "libdill.h"
+
+int dill_stats(struct dill_stats *stats) {
+    if(dill_slow(!stats)) {errno = EINVAL; return -1;}
+    struct dill_ctx *ctx = dill_getctx;
+    memset(stats, 0, sizeof(struct dill_stats));
+    stats->coroutines = ctx->cr.ncrs;
+    struct dill_slist *it;
+    for(it = dill_slist_next(&ctx->cr.ready.slist); it != &ctx->cr.ready.slist;
+          it = dill_slist_next(it))
+        ++stats->ready;
+    stats->switches_total = ctx->cr.switches;
+    stats->polls_total = ctx->cr.polls;
+    stats->poll_ns_total = (uint64_t)((double)ctx->cr.poll_ticks *
+        dill_ticks_scale());
+    stats->poll_events_total = ctx->pollset.nevents;
+    stats->pollset_ctls_total = ctx->pollset.nctls;
+    stats->timers_armed_total = ctx->cr.timers_armed;
+    stats->timers_fired_total = ctx->cr.timers_fired;
+    stats->timers_canceled_total =
+        ctx->cr.timers_removed - ctx->cr.timers_fired;
+    stats->cached_stacks = ctx->stack.count;
+    stats->handles = ctx->handle.nused;
+    stats->lag_ns = (uint64_t)((double)ctx->cr.lag * dill_ticks_scale());
+    if(stats->lag_ns < (uint64_t)ctx->cr.poll_lag * 1000000)
+        stats->lag_ns = (uint64_t)ctx->cr.poll_lag * 1000000;
+    stats->rejected_total = ctx->cr.rejected;
+#if defined DILL_SOCKETS
+    stats->rxbufs = ctx->fd.nused;
+    memcpy(stats->bytes_sent_total, ctx->fd.sent, sizeof(ctx->fd.sent));
+    memcpy(stats->bytes_received_total, ctx->fd.received,
+        sizeof(ctx->fd.received));
+#endif
+    return 0;
+}
+
+int dill_wakehist(int source, struct dill_wakehist *hist) {
+    if(dill_slow(source < 0 || source >= DILL_WAKE_NSOURCES || !hist)) {
+        errno = EINVAL; return -1;}
+    struct dill_lathist *lh = &dill_getctx->cr.wakehists[source];
+    double scale = dill_ticks_scale();
+    hist->count = lh->count;
+    hist->sum_ns = (uint64_t)((double)lh->sum * scale);
+    hist->max_ns = (uint64_t)((double)lh->max * scale);
+    int i;
+    for(i = 0; i != DILL_WAKEHIST_NBUCKETS; ++i) {
+        uint64_t bound = dill_lathist_bound(i);
+        hist->bounds_ns[i] = bound == UINT64_MAX ? UINT64_MAX :
+            (uint64_t)((double)bound * scale);
+        hist->counts[i] = lh->buckets[i];
+    }
+    return 0;
+}
+
+int dill_wakehist_reset(void) {
+    struct dill_ctx_cr *ctx = &dill_getctx->cr;
+    memset(ctx->wakehists, 0, sizeof(ctx->wakehists));
+    return 0;
+}
+
+/******************************************************************************/
+/*  Prometheus text format.                                                   */
+/******************************************************************************/
+
+struct dill_stats_out {
+    char *buf;
+    size_t len;
+    size_t pos;
+};
+
+static int dill_stats_print(struct dill_stats_out *out, const char *fmt, ...)
+    __attribute__((format(printf, 2, 3)));
+
+static int dill_stats_print(struct dill_stats_out *out, const char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    int sz = vsnprintf(out->buf + out->pos, out->len - out->pos, fmt, ap);
+    va_end(ap);
+    dill_assert(sz >= 0);
+    if(dill_slow((size_t)sz >= out->len - out->pos)) {
+        errno = ENOBUFS; return -1;}
+    out->pos += sz;
+    return 0;
+}
+
+static int dill_stats_metric(struct dill_stats_out *out, const char *name,
+      const char *type, const char *help, uint64_t val) {
+    return dill_stats_print(out, "# HELP libdill_%s %s\n"
+        "# TYPE libdill_%s %s\nlibdill_%s %llu\n", name, help, name, type,
+        name, (unsigned long long)val);
+}
+
+static int dill_stats_bytes(struct dill_stats_out *out, const char *name,
+      const char *help, const uint64_t *vals) {
+    static const char *types[DILL_STATS_NSOCKTYPES] = {"tcp", "ipc", "udp"};
+    int rc = dill_stats_print(out, "# HELP libdill_%s %s\n"
+        "# TYPE libdill_%s counter\n", name, help, name);
+    if(dill_slow(rc < 0)) return -1;
+    int i;
+    for(i = 0; i != DILL_STATS_NSOCKTYPES; ++i) {
+        rc = dill_stats_print(out, "libdill_%s{type=\"%s\"} %llu\n", name,
+            types[i], (unsigned long long)vals[i]);
+        if(dill_slow(rc < 0)) return -1;
+    }
+    return 0;
+}
+
+ssize_t dill_stats_prometheus(const struct dill_stats *stats, char *buf,
+      size_t len) {
+    if(dill_slow(!stats || (!buf && len))) {errno = EINVAL; return -1;}
+    if(dill_slow(!len)) {errno = ENOBUFS; return -1;}
+    struct dill_stats_out out = {buf, len, 0};
+    buf[0] = 0;
+    int rc = dill_stats_metric(&out, "coroutines", "gauge",
+        "Number of running coroutines.", stats->coroutines);
+    if(dill_slow(rc < 0)) return -1;
+    rc = dill_stats_metric(&out, "ready_coroutines", "gauge",
+        "Number of coroutines waiting for the CPU.", stats->ready);
+    if(dill_slow(rc < 0)) return -1;
+    rc = dill_stats_metric(&out, "context_switches_total", "counter",
+        "Number of context switches.", stats->switches_total);
+    if(dill_slow(rc < 0)) return -1;
+    rc = dill_stats_metric(&out, "polls_total", "counter",
+        "Number of polls for events.", stats->polls_total);
+    if(dill_slow(rc < 0)) return -1;
+    rc = dill_stats_print(&out, "# HELP libdill_poll_seconds_total "
+        "Time spent polling for events.\n"
+        "# TYPE libdill_poll_seconds_total counter\n"
+        "libdill_poll_seconds_total %.9f\n",
+        (double)stats->poll_ns_total / 1e9);
+    if(dill_slow(rc < 0)) return -1;
+    rc = dill_stats_metric(&out, "poll_events_total", "counter",
+        "Number of events reported by polls.", stats->poll_events_total);
+    if(dill_slow(rc < 0)) return -1;
+    rc = dill_stats_metric(&out, "pollset_ctls_total", "counter",
+        "Number of changes to the kernel-side pollset.",
+        stats->pollset_ctls_total);
+    if(dill_slow(rc < 0)) return -1;
+    rc = dill_stats_metric(&out, "timers_armed_total", "counter",
+        "Number of armed timers.", stats->timers_armed_total);
+    if(dill_slow(rc < 0)) return -1;
+    rc = dill_stats_metric(&out, "timers_fired_total", "counter",
+        "Number of expired timers.", stats->timers_fired_total);
+    if(dill_slow(rc < 0)) return -1;
+    rc = dill_stats_metric(&out, "timers_canceled_total", "counter",
+        "Number of timers canceled before expiring.",
+        stats->timers_canceled_total);
+    if(dill_slow(rc < 0)) return -1;
+    rc = dill_stats_metric(&out, "cached_stacks", "gauge",
+        "Number of unused coroutine stacks.", stats->cached_stacks);
+    if(dill_slow(rc < 0)) return -1;
+    rc = dill_stats_metric(&out, "handles", "gauge",
+        "Number of open handles.", stats->handles);
+    if(dill_slow(rc < 0)) return -1;
+    rc = dill_stats_metric(&out, "rx_buffers", "gauge",
+        "Number of socket receive buffers in use.", stats->rxbufs);
+    if(dill_slow(rc < 0)) return -1;
+    rc = dill_stats_print(&out, "# HELP libdill_lag_seconds "
+        "Scheduler lag.\n"
+        "# TYPE libdill_lag_seconds gauge\n"
+        "libdill_lag_seconds %.9f\n", (double)stats->lag_ns / 1e9);
+    if(dill_slow(rc < 0)) return -1;
+    rc = dill_stats_metric(&out, "rejected_connections_total", "counter",
+        "Number of connections rejected because of overload.",
+        stats->rejected_total);
+    if(dill_slow(rc < 0)) return -1;
+    rc = dill_stats_bytes(&out, "sent_bytes_total", "Number of bytes sent.",
+        stats->bytes_sent_total);
+    if(dill_slow(rc < 0)) return -1;
+    rc = dill_stats_bytes(&out, "received_bytes_total",
+        "Number of bytes received.", stats->bytes_received_total);
+    if(dill_slow(rc < 0)) return -1;
+    return out.pos;
+}
+
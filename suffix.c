@@ -29,6 +29,7 @@
 
 #define DILL_DISABLE_RAW_NAMES
 #include "libdillimpl.h"
+#include "slab.h"
 #include "utils.h"
 
 dill_unique_id(dill_suffix_type);
@@ -100,7 +101,8 @@ error:
 
 int dill_suffix_attach(int s, const void *suffix, size_t suffixlen) {
     int err;
-    struct dill_suffix_sock *obj = malloc(sizeof(struct dill_suffix_sock));
+    struct dill_suffix_sock *obj = dill_slab_alloc(
+        sizeof(struct dill_suffix_sock));
     if(dill_slow(!obj)) {err = ENOMEM; goto error1;}
     s = dill_suffix_attach_mem(s, suffix, suffixlen,
         (struct dill_suffix_storage*)obj);
@@ -108,7 +110,7 @@ int dill_suffix_attach(int s, const void *suffix, size_t suffixlen) {
     obj->mem = 0;
     return s;
 error2:
-    free(obj);
+    dill_slab_free(obj, sizeof(struct dill_suffix_sock));
 error1:
     if(s >= 0) dill_hclose(s);
     errno = err;
@@ -121,7 +123,7 @@ int dill_suffix_detach(int s, int64_t deadline) {
     if(dill_slow(!self)) {err = errno; goto error;}
     if(dill_slow(self->inerr || self->outerr)) {err = ECONNRESET; goto error;}
     int u = self->u;
-    if(!self->mem) free(self);
+    if(!self->mem) dill_slab_free(self, sizeof(struct dill_suffix_sock));
     return u;
 error:
     if(s >= 0) dill_hclose(s);
@@ -143,11 +145,76 @@ static int dill_suffix_msendl(struct dill_msock_vfs *mvfs,
     return 0;
 }
 
+/* Moves len bytes to the iolist. Advances the iolist accordingly. */
+static int dill_suffix_copy(struct dill_iolist *it, const uint8_t *data,
+      size_t len) {
+    while(len) {
+        if(!it->iol_len) {
+            if(dill_slow(!it->iol_next)) {errno = EMSGSIZE; return -1;}
+            *it = *it->iol_next;
+            continue;
+        }
+        size_t n = len < it->iol_len ? len : it->iol_len;
+        if(it->iol_base) {
+            memcpy(it->iol_base, data, n);
+            it->iol_base = ((uint8_t*)it->iol_base) + n;
+        }
+        it->iol_len -= n;
+        data += n;
+        len -= n;
+    }
+    return 0;
+}
+
+/* Same as dill_suffix_mrecvl() except that the suffix is searched for in
+   place, in the rx buffer of the underlying socket. */
+static ssize_t dill_suffix_mrecvl_peek(struct dill_suffix_sock *self,
+      struct dill_bpeek_vfs *pvfs, struct dill_iolist *first,
+      int64_t deadline) {
+    struct dill_iolist it = {NULL, SIZE_MAX, NULL, 0};
+    if(first) it = *first;
+    size_t sz = 0;
+    while(1) {
+        const void *buf;
+        size_t len;
+        int rc = pvfs->bpeek(pvfs, &buf, &len, deadline);
+        if(dill_slow(rc < 0)) return -1;
+        const uint8_t *data = buf;
+        /* Data past the last position where the suffix can start are left
+           in the buffer. They'll be checked once more data arrive. */
+        size_t pos = 0;
+        int found = 0;
+        while(pos + self->suffixlen <= len) {
+            const uint8_t *p = memchr(data + pos, self->suffix[0],
+                len - self->suffixlen + 1 - pos);
+            if(!p) {pos = len - self->suffixlen + 1; break;}
+            pos = p - data;
+            if(memcmp(p, self->suffix, self->suffixlen) == 0) {
+                found = 1; break;}
+            pos++;
+        }
+        rc = dill_suffix_copy(&it, data, pos);
+        if(dill_slow(rc < 0)) return -1;
+        rc = pvfs->bconsume(pvfs, found ? pos + self->suffixlen : pos);
+        if(dill_slow(rc < 0)) return -1;
+        sz += pos;
+        if(found) return sz;
+    }
+}
+
 static ssize_t dill_suffix_mrecvl(struct dill_msock_vfs *mvfs,
       struct dill_iolist *first, struct dill_iolist *last, int64_t deadline) {
     struct dill_suffix_sock *self = dill_cont(mvfs, struct dill_suffix_sock,
         mvfs);
     if(dill_slow(self->inerr)) {errno = ECONNRESET; return -1;}
+    /* If the underlying socket buffers inbound data, avoid reading it
+       byte by byte. */
+    struct dill_bpeek_vfs *pvfs = dill_hquery(self->u, dill_bpeek_type);
+    if(pvfs) {
+        ssize_t sz = dill_suffix_mrecvl_peek(self, pvfs, first, deadline);
+        if(dill_slow(sz < 0)) self->inerr = 1;
+        return sz;
+    }
     /* First fill in the temporary buffer. */
     struct dill_iolist iol = {self->buf, self->suffixlen, NULL, 0};
     int rc = self->uvfs->brecvl(self->uvfs, &iol, &iol, deadline);
@@ -186,6 +253,6 @@ static void dill_suffix_hclose(struct dill_hvfs *hvfs) {
         int rc = dill_hclose(self->u);
         dill_assert(rc == 0);
     }
-    if(!self->mem) free(self);
+    if(!self->mem) dill_slab_free(self, sizeof(struct dill_suffix_sock));
 }
 
@@ -0,0 +1,466 @@
+/*
+
+  Copyright (c) 2018 Martin Sustrik
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"),
+  to deal in the Software without restriction, including without limitation
+  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+  and/or sell copies of the Software, and to permit persons to whom
+  the Software is furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included
+  in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+  IN THE SOFTWARE.
+
+*/
+
+#include <limits.h>
+#include <stdlib.h>
+
+#include "cr.h"
+#include "list.h"
+#include "slab.h"
+#include "utils.h"
+
+#define DILL_DISABLE_RAW_NAMES
+#include "libdillimpl.h"
+
+/* Synchronization primitives for coroutines running in the same thread.
+   Blocked coroutines are queued in FIFO order. Whenever possible, the resource
+   is handed off directly to the first waiting coroutine rather than being
+   released and re-acquired, so that a coroutine that comes later can't barge
+   in ahead of those already waiting. */
+
+dill_unique_id(dill_mutex_type);
+dill_unique_id(dill_sem_type);
+dill_unique_id(dill_cond_type);
+dill_unique_id(dill_rwlock_type);
+dill_unique_id(dill_waitgroup_type);
+
+/******************************************************************************/
+/*  Helpers.                                                                  */
+/******************************************************************************/
+
+/* Part common to all the synchronization objects. */
+struct dill_sync {
+    /* Table of virtual functions. */
+    struct dill_hvfs vfs;
+    /* Coroutines blocked on the object, in FIFO order. */
+    struct dill_list waiters;
+    /* Type of the object, as used by dill_hquery(). */
+    const void *type;
+    /* Size of the object, as passed to dill_slab_alloc(). 0 if the object
+       was created with one of the _mem functions. */
+    size_t size;
+};
+
+struct dill_syncclause {
+    struct dill_clause cl;
+    /* An item in dill_sync::waiters list. */
+    struct dill_list item;
+    struct dill_sync *obj;
+    /* Read-write lock only: 1 if waiting for the write lock. */
+    unsigned int write : 1;
+    /* 1 if the clause was triggered by the object itself, as opposed to
+       a timeout or cancellation. */
+    unsigned int granted : 1;
+};
+
+static void *dill_sync_query(struct dill_hvfs *vfs, const void *type);
+static void dill_sync_close(struct dill_hvfs *vfs);
+static void dill_rwlock_dispatch(struct dill_sync *obj);
+
+static int dill_sync_init(struct dill_sync *self, const void *type) {
+    self->vfs.query = dill_sync_query;
+    self->vfs.close = dill_sync_close;
+    dill_list_init(&self->waiters);
+    self->type = type;
+    self->size = 0;
+    return dill_hmake(&self->vfs);
+}
+
+static void *dill_sync_query(struct dill_hvfs *vfs, const void *type) {
+    struct dill_sync *self = (struct dill_sync*)vfs;
+    if(dill_fast(type == self->type)) return self;
+    errno = ENOTSUP;
+    return NULL;
+}
+
+/* Resumes the waiting coroutine. */
+static void dill_sync_grant(struct dill_syncclause *scl, int err) {
+    scl->granted = 1;
+    dill_trigger(&scl->cl, err);
+}
+
+static void dill_sync_close(struct dill_hvfs *vfs) {
+    struct dill_sync *self = (struct dill_sync*)vfs;
+    /* Resume the remaining waiters with EBADF error. */
+    while(!dill_list_empty(&self->waiters)) {
+        struct dill_syncclause *scl = dill_cont(dill_list_next(&self->waiters),
+            struct dill_syncclause, item);
+        dill_sync_grant(scl, EBADF);
+    }
+    if(self->size) dill_slab_free(self, self->size);
+}
+
+static void dill_sync_cancel(struct dill_clause *cl) {
+    struct dill_syncclause *scl = dill_cont(cl, struct dill_syncclause, cl);
+    dill_list_erase(&scl->item);
+    /* A read-write lock waiter that gives up may unblock the waiters
+       queued behind it. */
+    if(!scl->granted && scl->obj->type == dill_rwlock_type)
+        dill_rwlock_dispatch(scl->obj);
+}
+
+/* Blocks the current coroutine until it is resumed by dill_sync_grant(). */
+static int dill_sync_wait(struct dill_sync *self, int write,
+      int64_t deadline) {
+    if(dill_slow(deadline == 0)) {errno = ETIMEDOUT; return -1;}
+    struct dill_syncclause scl;
+    dill_list_insert(&scl.item, &self->waiters);
+    scl.obj = self;
+    scl.write = write;
+    scl.granted = 0;
+    dill_waitfor(&scl.cl, 0, dill_sync_cancel, DILL_CLAUSE_SYNC);
+    struct dill_tmclause tmcl;
+    dill_timer(&tmcl, 1, deadline);
+    int id = dill_wait();
+    if(dill_slow(id < 0)) return -1;
+    if(dill_slow(id == 1)) {errno = ETIMEDOUT; return -1;}
+    if(dill_slow(errno != 0)) return -1;
+    return 0;
+}
+
+/* Resumes the first waiting coroutine, if any. Returns 0 if there was none. */
+static int dill_sync_handoff(struct dill_sync *self) {
+    if(dill_list_empty(&self->waiters)) return 0;
+    dill_sync_grant(dill_cont(dill_list_next(&self->waiters),
+        struct dill_syncclause, item), 0);
+    return 1;
+}
+
+/******************************************************************************/
+/*  Mutex.                                                                    */
+/******************************************************************************/
+
+struct dill_mutex {
+    struct dill_sync sync;
+    unsigned int locked : 1;
+};
+
+DILL_CT_ASSERT(sizeof(struct dill_mutex_storage) >= sizeof(struct dill_mutex));
+
+int dill_mutex_mem(struct dill_mutex_storage *mem) {
+    if(dill_slow(!mem)) {errno = EINVAL; return -1;}
+    struct dill_mutex *self = (struct dill_mutex*)mem;
+    self->locked = 0;
+    return dill_sync_init(&self->sync, dill_mutex_type);
+}
+
+int dill_mutex(void) {
+    int err;
+    struct dill_mutex *self = dill_slab_alloc(sizeof(struct dill_mutex));
+    if(dill_slow(!self)) {err = ENOMEM; goto error1;}
+    int h = dill_mutex_mem((struct dill_mutex_storage*)self);
+    if(dill_slow(h < 0)) {err = errno; goto error2;}
+    self->sync.size = sizeof(struct dill_mutex);
+    return h;
+error2:
+    dill_slab_free(self, sizeof(struct dill_mutex));
+error1:
+    errno = err;
+    return -1;
+}
+
+int dill_mutex_lock(int h, int64_t deadline) {
+    int rc = dill_canblock();
+    if(dill_slow(rc < 0)) return -1;
+    struct dill_mutex *self = dill_hquery(h, dill_mutex_type);
+    if(dill_slow(!self)) return -1;
+    if(dill_fast(!self->locked)) {self->locked = 1; return 0;}
+    /* The mutex will be handed off to us by dill_mutex_unlock(). */
+    return dill_sync_wait(&self->sync, 0, deadline);
+}
+
+int dill_mutex_unlock(int h) {
+    struct dill_mutex *self = dill_hquery(h, dill_mutex_type);
+    if(dill_slow(!self)) return -1;
+    if(dill_slow(!self->locked)) {errno = EPERM; return -1;}
+    if(!dill_sync_handoff(&self->sync)) self->locked = 0;
+    return 0;
+}
+
+/******************************************************************************/
+/*  Semaphore.                                                                */
+/******************************************************************************/
+
+struct dill_sem {
+    struct dill_sync sync;
+    int value;
+};
+
+DILL_CT_ASSERT(sizeof(struct dill_sem_storage) >= sizeof(struct dill_sem));
+
+int dill_sem_mem(struct dill_sem_storage *mem, int value) {
+    if(dill_slow(!mem || value < 0)) {errno = EINVAL; return -1;}
+    struct dill_sem *self = (struct dill_sem*)mem;
+    self->value = value;
+    return dill_sync_init(&self->sync, dill_sem_type);
+}
+
+int dill_sem(int value) {
+    int err;
+    struct dill_sem *self = dill_slab_alloc(sizeof(struct dill_sem));
+    if(dill_slow(!self)) {err = ENOMEM; goto error1;}
+    int h = dill_sem_mem((struct dill_sem_storage*)self, value);
+    if(dill_slow(h < 0)) {err = errno; goto error2;}
+    self->sync.size = sizeof(struct dill_sem);
+    return h;
+error2:
+    dill_slab_free(self, sizeof(struct dill_sem));
+error1:
+    errno = err;
+    return -1;
+}
+
+int dill_sem_acquire(int h, int64_t deadline) {
+    int rc = dill_canblock();
+    if(dill_slow(rc < 0)) return -1;
+    struct dill_sem *self = dill_hquery(h, dill_sem_type);
+    if(dill_slow(!self)) return -1;
+    /* If there are waiters the value is zero. */
+    if(dill_fast(self->value > 0)) {--self->value; return 0;}
+    return dill_sync_wait(&self->sync, 0, deadline);
+}
+
+int dill_sem_release(int h) {
+    struct dill_sem *self = dill_hquery(h, dill_sem_type);
+    if(dill_slow(!self)) return -1;
+    if(dill_sync_handoff(&self->sync)) return 0;
+    if(dill_slow(self->value == INT_MAX)) {errno = EOVERFLOW; return -1;}
+    ++self->value;
+    return 0;
+}
+
+/******************************************************************************/
+/*  Condition variable.                                                       */
+/******************************************************************************/
+
+struct dill_cond {
+    struct dill_sync sync;
+};
+
+DILL_CT_ASSERT(sizeof(struct dill_cond_storage) >= sizeof(struct dill_cond));
+
+int dill_cond_mem(struct dill_cond_storage *mem) {
+    if(dill_slow(!mem)) {errno = EINVAL; return -1;}
+    struct dill_cond *self = (struct dill_cond*)mem;
+    return dill_sync_init(&self->sync, dill_cond_type);
+}
+
+int dill_cond(void) {
+    int err;
+    struct dill_cond *self = dill_slab_alloc(sizeof(struct dill_cond));
+    if(dill_slow(!self)) {err = ENOMEM; goto error1;}
+    int h = dill_cond_mem((struct dill_cond_storage*)self);
+    if(dill_slow(h < 0)) {err = errno; goto error2;}
+    self->sync.size = sizeof(struct dill_cond);
+    return h;
+error2:
+    dill_slab_free(self, sizeof(struct dill_cond));
+error1:
+    errno = err;
+    return -1;
+}
+
+int dill_cond_wait(int h, int mutex, int64_t deadline) {
+    int rc = dill_canblock();
+    if(dill_slow(rc < 0)) return -1;
+    struct dill_cond *self = dill_hquery(h, dill_cond_type);
+    if(dill_slow(!self)) return -1;
+    rc = dill_mutex_unlock(mutex);
+    if(dill_slow(rc < 0)) return -1;
+    rc = dill_sync_wait(&self->sync, 0, deadline);
+    int err = errno;
+    /* Re-acquire the mutex irrespective of whether the wait succeeded.
+       If the coroutine is being canceled the mutex is not re-acquired. */
+    int rc2 = dill_mutex_lock(mutex, -1);
+    if(dill_slow(rc2 < 0)) return -1;
+    errno = err;
+    return rc;
+}
+
+int dill_cond_signal(int h) {
+    struct dill_cond *self = dill_hquery(h, dill_cond_type);
+    if(dill_slow(!self)) return -1;
+    dill_sync_handoff(&self->sync);
+    return 0;
+}
+
+int dill_cond_broadcast(int h) {
+    struct dill_cond *self = dill_hquery(h, dill_cond_type);
+    if(dill_slow(!self)) return -1;
+    while(dill_sync_handoff(&self->sync));
+    return 0;
+}
+
+/******************************************************************************/
+/*  Read-write lock.                                                          */
+/******************************************************************************/
+
+struct dill_rwlock {
+    struct dill_sync sync;
+    /* Number of coroutines holding the read lock. */
+    int readers;
+    /* 1 if a coroutine holds the write lock. */
+    unsigned int writer : 1;
+};
+
+DILL_CT_ASSERT(sizeof(struct dill_rwlock_storage) >=
+    sizeof(struct dill_rwlock));
+
+int dill_rwlock_mem(struct dill_rwlock_storage *mem) {
+    if(dill_slow(!mem)) {errno = EINVAL; return -1;}
+    struct dill_rwlock *self = (struct dill_rwlock*)mem;
+    self->readers = 0;
+    self->writer = 0;
+    return dill_sync_init(&self->sync, dill_rwlock_type);
+}
+
+int dill_rwlock(void) {
+    int err;
+    struct dill_rwlock *self = dill_slab_alloc(sizeof(struct dill_rwlock));
+    if(dill_slow(!self)) {err = ENOMEM; goto error1;}
+    int h = dill_rwlock_mem((struct dill_rwlock_storage*)self);
+    if(dill_slow(h < 0)) {err = errno; goto error2;}
+    self->sync.size = sizeof(struct dill_rwlock);
+    return h;
+error2:
+    dill_slab_free(self, sizeof(struct dill_rwlock));
+error1:
+    errno = err;
+    return -1;
+}
+
+/* Grants the lock to as many waiters from the head of the queue as possible.
+   A writer at the head of the queue blocks the readers behind it so that
+   writers don't starve. */
+static void dill_rwlock_dispatch(struct dill_sync *obj) {
+    struct dill_rwlock *self = (struct dill_rwlock*)obj;
+    while(!self->writer && !dill_list_empty(&self->sync.waiters)) {
+        struct dill_syncclause *scl = dill_cont(
+            dill_list_next(&self->sync.waiters), struct dill_syncclause, item);
+        if(scl->write) {
+            if(self->readers) break;
+            self->writer = 1;
+        }
+        else {
+            ++self->readers;
+        }
+        dill_sync_grant(scl, 0);
+    }
+}
+
+int dill_rwlock_rdlock(int h, int64_t deadline) {
+    int rc = dill_canblock();
+    if(dill_slow(rc < 0)) return -1;
+    struct dill_rwlock *self = dill_hquery(h, dill_rwlock_type);
+    if(dill_slow(!self)) return -1;
+    if(dill_fast(!self->writer && dill_list_empty(&self->sync.waiters))) {
+        ++self->readers;
+        return 0;
+    }
+    return dill_sync_wait(&self->sync, 0, deadline);
+}
+
+int dill_rwlock_wrlock(int h, int64_t deadline) {
+    int rc = dill_canblock();
+    if(dill_slow(rc < 0)) return -1;
+    struct dill_rwlock *self = dill_hquery(h, dill_rwlock_type);
+    if(dill_slow(!self)) return -1;
+    if(dill_fast(!self->writer && !self->readers &&
+          dill_list_empty(&self->sync.waiters))) {
+        self->writer = 1;
+        return 0;
+    }
+    return dill_sync_wait(&self->sync, 1, deadline);
+}
+
+int dill_rwlock_unlock(int h) {
+    struct dill_rwlock *self = dill_hquery(h, dill_rwlock_type);
+    if(dill_slow(!self)) return -1;
+    if(self->writer) self->writer = 0;
+    else if(dill_fast(self->readers)) --self->readers;
+    else {errno = EPERM; return -1;}
+    dill_rwlock_dispatch(&self->sync);
+    return 0;
+}
+
+/******************************************************************************/
+/*  Wait group.                                                               */
+/******************************************************************************/
+
+struct dill_waitgroup {
+    struct dill_sync sync;
+    /* Number of outstanding tasks. */
+    int count;
+};
+
+DILL_CT_ASSERT(sizeof(struct dill_waitgroup_storage) >=
+    sizeof(struct dill_waitgroup));
+
+int dill_waitgroup_mem(struct dill_waitgroup_storage *mem) {
+    if(dill_slow(!mem)) {errno = EINVAL; return -1;}
+    struct dill_waitgroup *self = (struct dill_waitgroup*)mem;
+    self->count = 0;
+    return dill_sync_init(&self->sync, dill_waitgroup_type);
+}
+
+int dill_waitgroup(void) {
+    int err;
+    struct dill_waitgroup *self = dill_slab_alloc(
+        sizeof(struct dill_waitgroup));
+    if(dill_slow(!self)) {err = ENOMEM; goto error1;}
+    int h = dill_waitgroup_mem((struct dill_waitgroup_storage*)self);
+    if(dill_slow(h < 0)) {err = errno; goto error2;}
+    self->sync.size = sizeof(struct dill_waitgroup);
+    return h;
+error2:
+    dill_slab_free(self, sizeof(struct dill_waitgroup));
+error1:
+    errno = err;
+    return -1;
+}
+
+int dill_waitgroup_add(int h, int delta) {
+    struct dill_waitgroup *self = dill_hquery(h, dill_waitgroup_type);
+    if(dill_slow(!self)) return -1;
+    if(dill_slow(delta < 0 ? self->count < -delta :
+          self->count > INT_MAX - delta)) {
+        errno = EINVAL; return -1;}
+    self->count += delta;
+    /* All the tasks are done. Resume all the waiters. */
+    if(!self->count) while(dill_sync_handoff(&self->sync));
+    return 0;
+}
+
+int dill_waitgroup_done(int h) {
+    return dill_waitgroup_add(h, -1);
+}
+
+int dill_waitgroup_wait(int h, int64_t deadline) {
+    int rc = dill_canblock();
+    if(dill_slow(rc < 0)) return -1;
+    struct dill_waitgroup *self = dill_hquery(h, dill_waitgroup_type);
+    if(dill_slow(!self)) return -1;
+    if(!self->count) return 0;
+    return dill_sync_wait(&self->sync, 0, deadline);
+}
@@ -28,7 +28,12 @@
 
 #define DILL_DISABLE_RAW_NAMES
 #include "libdillimpl.h"
+#include "ctx.h"
 #include "fd.h"
+#include "iol.h"
+#include "probes.h"
+#include "slab.h"
+#include "sockstats.h"
 #include "utils.h"
 
 dill_unique_id(dill_tcp_type);
@@ -44,12 +49,17 @@ static int dill_tcp_bsendl(struct dill_bsock_vfs *bvfs,
     struct dill_iolist *first, struct dill_iolist *last, int64_t deadline);
 static int dill_tcp_brecvl(struct dill_bsock_vfs *bvfs,
     struct dill_iolist *first, struct dill_iolist *last, int64_t deadline);
+static int dill_tcp_bpeek(struct dill_bpeek_vfs *pvfs,
+    const void **buf, size_t *len, int64_t deadline);
+static int dill_tcp_bconsume(struct dill_bpeek_vfs *pvfs, size_t len);
 
 struct dill_tcp_conn {
     struct dill_hvfs hvfs;
     struct dill_bsock_vfs bvfs;
+    struct dill_bpeek_vfs pvfs;
     int fd;
     struct dill_fd_rxbuf rxbuf;
+    struct dill_sockstats stats;
     unsigned int rbusy : 1;
     unsigned int sbusy : 1;
     unsigned int indone : 1;
@@ -64,7 +74,9 @@ DILL_CHECK_STORAGE(dill_tcp_conn, dill_tcp_storage)
 static void *dill_tcp_hquery(struct dill_hvfs *hvfs, const void *type) {
     struct dill_tcp_conn *self = (struct dill_tcp_conn*)hvfs;
     if(type == dill_bsock_type) return &self->bvfs;
+    if(type == dill_bpeek_type) return &self->pvfs;
     if(type == dill_tcp_type) return self;
+    if(type == dill_sockstats_type) return &self->stats;
     errno = ENOTSUP;
     return NULL;
 }
@@ -76,8 +88,11 @@ static int dill_tcp_makeconn(int fd, void *mem) {
     self->hvfs.close = dill_tcp_hclose;
     self->bvfs.bsendl = dill_tcp_bsendl;
     self->bvfs.brecvl = dill_tcp_brecvl;
+    self->pvfs.bpeek = dill_tcp_bpeek;
+    self->pvfs.bconsume = dill_tcp_bconsume;
     self->fd = fd;
     dill_fd_initrxbuf(&self->rxbuf);
+    dill_sockstats_init(&self->stats, fd, -1);
     self->rbusy = 0;
     self->sbusy = 0;
     self->indone = 0;
@@ -113,14 +128,14 @@ error1:
 
 int dill_tcp_fromfd(int fd) {
     int err;
-    struct dill_tcp_conn *obj = malloc(sizeof(struct dill_tcp_conn));
+    struct dill_tcp_conn *obj = dill_slab_alloc(sizeof(struct dill_tcp_conn));
     if(dill_slow(!obj)) {err = ENOMEM; goto error1;}
     int s = dill_tcp_fromfd_mem(fd, (struct dill_tcp_storage*)obj);
     if (dill_slow(s < 0)) {err = errno; goto error2;}
     obj->mem = 0;
     return s;
 error2:
-    free(obj);
+    dill_slab_free(obj, sizeof(struct dill_tcp_conn));
 error1:
     errno = err;
     return -1;
@@ -153,14 +168,14 @@ error1:
 
 int dill_tcp_connect(const struct dill_ipaddr *addr, int64_t deadline) {
     int err;
-    struct dill_tcp_conn *obj = malloc(sizeof(struct dill_tcp_conn));
+    struct dill_tcp_conn *obj = dill_slab_alloc(sizeof(struct dill_tcp_conn));
     if(dill_slow(!obj)) {err = ENOMEM; goto error1;}
     int s = dill_tcp_connect_mem(addr, (struct dill_tcp_storage*)obj, deadline);
     if(dill_slow(s < 0)) {err = errno; goto error2;}
     obj->mem = 0;
     return s;
 error2:
-    free(obj);
+    dill_slab_free(obj, sizeof(struct dill_tcp_conn));
 error1:
     errno = err;
     return -1;
@@ -174,9 +189,15 @@ static int dill_tcp_bsendl(struct dill_bsock_vfs *bvfs,
     if(dill_slow(self->outdone)) {errno = EPIPE; return -1;}
     if(dill_slow(self->outerr)) {errno = ECONNRESET; return -1;}
     self->sbusy = 1;
-    ssize_t sz = dill_fd_send(self->fd, first, last, deadline);
+    ssize_t sz = dill_fd_send(self->fd, &self->stats, first, last, deadline);
     self->sbusy = 0;
-    if(dill_fast(sz >= 0)) return sz;
+    if(dill_fast(sz >= 0)) {
+        dill_getctx->fd.sent[DILL_STATS_TCP] += sz;
+        self->stats.bytes_out += sz;
+        self->stats.msgs_out++;
+        dill_probe2(sock_send, DILL_STATS_TCP, sz);
+        return 0;
+    }
     self->outerr = 1;
     return -1;
 }
@@ -188,7 +209,33 @@ static int dill_tcp_brecvl(struct dill_bsock_vfs *bvfs,
     if(dill_slow(self->indone)) {errno = EPIPE; return -1;}
     if(dill_slow(self->inerr)) {errno = ECONNRESET; return -1;}
     self->rbusy = 1;
-    int rc = dill_fd_recv(self->fd, &self->rxbuf, first, last, deadline);
+    int rc = dill_fd_recv(self->fd, &self->rxbuf, &self->stats, first, last,
+        deadline);
+    self->rbusy = 0;
+    if(dill_fast(rc == 0)) {
+        size_t nbytes;
+        rc = dill_iolcheck(first, last, NULL, &nbytes);
+        dill_assert(rc == 0);
+        dill_getctx->fd.received[DILL_STATS_TCP] += nbytes;
+        self->stats.bytes_in += nbytes;
+        self->stats.msgs_in++;
+        dill_probe2(sock_recv, DILL_STATS_TCP, nbytes);
+        return 0;
+    }
+    if(errno == EPIPE) self->indone = 1;
+    else self->inerr = 1;
+    return -1;
+}
+
+static int dill_tcp_bpeek(struct dill_bpeek_vfs *pvfs,
+      const void **buf, size_t *len, int64_t deadline) {
+    struct dill_tcp_conn *self = dill_cont(pvfs, struct dill_tcp_conn, pvfs);
+    if(dill_slow(self->rbusy)) {errno = EBUSY; return -1;}
+    if(dill_slow(self->indone)) {errno = EPIPE; return -1;}
+    if(dill_slow(self->inerr)) {errno = ECONNRESET; return -1;}
+    self->rbusy = 1;
+    int rc = dill_fd_peek(self->fd, &self->rxbuf, &self->stats, buf, len,
+        deadline);
     self->rbusy = 0;
     if(dill_fast(rc == 0)) return 0;
     if(errno == EPIPE) self->indone = 1;
@@ -196,6 +243,18 @@ static int dill_tcp_brecvl(struct dill_bsock_vfs *bvfs,
     return -1;
 }
 
+static int dill_tcp_bconsume(struct dill_bpeek_vfs *pvfs, size_t len) {
+    struct dill_tcp_conn *self = dill_cont(pvfs, struct dill_tcp_conn, pvfs);
+    if(dill_slow(self->rbusy)) {errno = EBUSY; return -1;}
+    int rc = dill_fd_consume(&self->rxbuf, len);
+    if(dill_slow(rc < 0)) return -1;
+    dill_getctx->fd.received[DILL_STATS_TCP] += len;
+    dill_probe2(sock_recv, DILL_STATS_TCP, len);
+    self->stats.bytes_in += len;
+    self->stats.msgs_in++;
+    return 0;
+}
+
 int dill_tcp_done(int s, int64_t deadline) {
     struct dill_tcp_conn *self = dill_hquery(s, dill_tcp_type);
     if(dill_slow(!self)) return -1;
@@ -212,6 +271,12 @@ int dill_tcp_done(int s, int64_t deadline) {
     return 0;
 }
 
+int dill_tcp_rxbuf(int s, size_t size) {
+    struct dill_tcp_conn *self = dill_hquery(s, dill_tcp_type);
+    if(dill_slow(!self)) return -1;
+    return dill_fd_setrxbuf(&self->rxbuf, size);
+}
+
 int dill_tcp_close(int s, int64_t deadline) {
     int err;
     /* Listener socket needs no special treatment. */
@@ -245,7 +310,7 @@ static void dill_tcp_hclose(struct dill_hvfs *hvfs) {
     struct dill_tcp_conn *self = (struct dill_tcp_conn*)hvfs;
     dill_fd_close(self->fd);
     dill_fd_termrxbuf(&self->rxbuf);
-    if(!self->mem) free(self);
+    if(!self->mem) dill_slab_free(self, sizeof(struct dill_tcp_conn));
 }
 
 /******************************************************************************/
@@ -260,6 +325,8 @@ struct dill_tcp_listener {
     int fd;
     struct dill_ipaddr addr;
     unsigned int mem : 1;
+    /* One of DILL_OVERLOAD_* constants. */
+    unsigned int overload : 2;
 };
 
 DILL_CHECK_STORAGE(dill_tcp_listener, dill_tcp_listener_storage)
@@ -271,6 +338,7 @@ static int dill_tcp_makelistener(int fd, void *mem) {
     self->hvfs.close = dill_tcp_listener_hclose;
     self->fd = fd;
     self->mem = 1;
+    self->overload = DILL_OVERLOAD_IGNORE;
     /* Create the handle. */
     return dill_hmake(&self->hvfs);
 }
@@ -283,9 +351,19 @@ static void *dill_tcp_listener_hquery(struct dill_hvfs *hvfs,
     return NULL;
 }
 
+int dill_tcp_listener_overload(int s, int policy) {
+    if(dill_slow(policy < DILL_OVERLOAD_IGNORE ||
+          policy > DILL_OVERLOAD_REJECT)) {errno = EINVAL; return -1;}
+    struct dill_tcp_listener *self = dill_hquery(s, dill_tcp_listener_type);
+    if(dill_slow(!self)) return -1;
+    self->overload = policy;
+    return 0;
+}
+
 int dill_tcp_listener_fromfd(int fd) {
     int err;
-    struct dill_tcp_listener *obj = malloc(sizeof(struct dill_tcp_listener));
+    struct dill_tcp_listener *obj = dill_slab_alloc(
+        sizeof(struct dill_tcp_listener));
     if(dill_slow(!obj)) {err = ENOMEM; goto error1;}
     int s = dill_tcp_listener_fromfd_mem(fd,
         (struct dill_tcp_listener_storage*)obj);
@@ -293,7 +371,7 @@ int dill_tcp_listener_fromfd(int fd) {
     obj->mem = 0;
     return s;
 error2:
-    free(obj);
+    dill_slab_free(obj, sizeof(struct dill_tcp_listener));
 error1:
     errno = err;
     return -1;
@@ -358,7 +436,8 @@ error1:
 
 int dill_tcp_listen(struct dill_ipaddr *addr, int backlog) {
     int err;
-    struct dill_tcp_listener *obj = malloc(sizeof(struct dill_tcp_listener));
+    struct dill_tcp_listener *obj = dill_slab_alloc(
+        sizeof(struct dill_tcp_listener));
     if(dill_slow(!obj)) {err = ENOMEM; goto error1;}
     int ls = dill_tcp_listen_mem(addr, backlog,
         (struct dill_tcp_listener_storage*)obj);
@@ -366,7 +445,7 @@ int dill_tcp_listen(struct dill_ipaddr *addr, int backlog) {
     obj->mem = 0;
     return ls;
 error2:
-    free(obj);
+    dill_slab_free(obj, sizeof(struct dill_tcp_listener));
 error1:
     errno = err;
     return -1;
@@ -381,8 +460,8 @@ int dill_tcp_accept_mem(int s, struct dill_ipaddr *addr,
     if(dill_slow(!lst)) {err = errno; goto error1;}
     /* Try to get new connection in a non-blocking way. */
     socklen_t addrlen = sizeof(struct dill_ipaddr);
-    int as = dill_fd_accept(lst->fd, (struct sockaddr*)addr, &addrlen,
-        deadline);
+    int as = dill_fd_admit(lst->fd, (struct sockaddr*)addr, &addrlen,
+        lst->overload, deadline);
     if(dill_slow(as < 0)) {err = errno; goto error1;}
     /* Set it to non-blocking mode. */
     int rc = dill_fd_unblock(as);
@@ -400,7 +479,7 @@ error1:
 
 int dill_tcp_accept(int s, struct dill_ipaddr *addr, int64_t deadline) {
     int err;
-    struct dill_tcp_conn *obj = malloc(sizeof(struct dill_tcp_conn));
+    struct dill_tcp_conn *obj = dill_slab_alloc(sizeof(struct dill_tcp_conn));
     if(dill_slow(!obj)) {err = ENOMEM; goto error1;}
     int as = dill_tcp_accept_mem(s, addr, (struct dill_tcp_storage*)obj,
         deadline);
@@ -408,7 +487,7 @@ int dill_tcp_accept(int s, struct dill_ipaddr *addr, int64_t deadline) {
     obj->mem = 0;
     return as;
 error2:
-    free(obj);
+    dill_slab_free(obj, sizeof(struct dill_tcp_conn));
 error1:
     errno = err;
     return -1;
@@ -417,6 +496,6 @@ error1:
 static void dill_tcp_listener_hclose(struct dill_hvfs *hvfs) {
     struct dill_tcp_listener *self = (struct dill_tcp_listener*)hvfs;
     dill_fd_close(self->fd);
-    if(!self->mem) free(self);
+    if(!self->mem) dill_slab_free(self, sizeof(struct dill_tcp_listener));
 }
 
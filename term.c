@@ -30,6 +30,7 @@
 #define DILL_DISABLE_RAW_NAMES
 #include <libdillimpl.h>
 #include "iol.h"
+#include "slab.h"
 #include "utils.h"
 
 #define DILL_MAX_TERMINATOR_LENGTH 32
@@ -101,14 +102,14 @@ error:
 
 int dill_term_attach(int s, const void *buf, size_t len) {
     int err;
-    struct dill_term_sock *obj = malloc(sizeof(struct dill_term_sock));
+    struct dill_term_sock *obj = dill_slab_alloc(sizeof(struct dill_term_sock));
     if(dill_slow(!obj)) {err = ENOMEM; goto error1;}
     s = dill_term_attach_mem(s, buf, len, (struct dill_term_storage*)obj);
     if(dill_slow(s < 0)) {err = errno; goto error2;}
     obj->mem = 0;
     return s;
 error2:
-    free(obj);
+    dill_slab_free(obj, sizeof(struct dill_term_sock));
 error1:
     if(s >= 0) dill_hclose(s);
     errno = err;
@@ -145,7 +146,7 @@ int dill_term_detach(int s, int64_t deadline) {
         }
     }
     int u = self->u;
-    if(!self->mem) free(self);
+    if(!self->mem) dill_slab_free(self, sizeof(struct dill_term_sock));
     return u;
 error:;
     int rc = dill_hclose(s);
@@ -196,6 +197,6 @@ static void dill_term_hclose(struct dill_hvfs *hvfs) {
         int rc = dill_hclose(self->u);
         dill_assert(rc == 0);
     }
-    if(!self->mem) free(self);
+    if(!self->mem) dill_slab_free(self, sizeof(struct dill_term_sock));
 }
 
@@ -0,0 +1,132 @@
+/*
+
+  Copyright (c) 2016 Martin Sustrik
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"),
+  to deal in the Software without restriction, including without limitation
+  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+  and/or sell copies of the Software, and to permit persons to whom
+  the Software is furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included
+  in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+  IN THE SOFTWARE.
+
+*/
+
+#include <unistd.h>
+
+#include "assert.h"
+#include "../libdill.h"
+
+#define TESTADDR "admission.test"
+
+/* Hogs the CPU without yielding. */
+static void spin(int ms) {
+    int64_t deadline = now() + ms;
+    volatile uint64_t n = 0;
+    while(now() < deadline) ++n;
+}
+
+/* Keeps the thread busy, making other coroutines wait for the CPU. */
+coroutine void hog(void) {
+    while(1) {
+        spin(5);
+        int rc = yield();
+        if(rc < 0 && errno == ECANCELED) return;
+        errno_assert(rc == 0);
+    }
+}
+
+/* Waits until the lag drops below the target. */
+static void calm_down(void) {
+    int i;
+    for(i = 0; i != 1000 && overloaded(); ++i) {
+        int rc = msleep(now() + 1);
+        errno_assert(rc == 0);
+    }
+    assert(!overloaded());
+}
+
+int main(void) {
+    /* Invalid arguments. */
+    int rc = overload_target(0);
+    assert(rc == -1 && errno == EINVAL);
+    unlink(TESTADDR);
+    int ls = ipc_listen(TESTADDR, 10);
+    errno_assert(ls >= 0);
+    rc = ipc_listener_overload(ls, 3);
+    assert(rc == -1 && errno == EINVAL);
+
+    /* Idle thread is not overloaded. */
+    rc = overload_target(2);
+    errno_assert(rc == 0);
+    assert(!overloaded());
+
+    /* Coroutines waiting for the CPU make the thread overloaded. */
+    int b = bundle();
+    errno_assert(b >= 0);
+    rc = bundle_go(b, hog());
+    errno_assert(rc == 0);
+    rc = bundle_go(b, hog());
+    errno_assert(rc == 0);
+    int i;
+    for(i = 0; i != 100 && !overloaded(); ++i) {
+        rc = yield();
+        errno_assert(rc == 0);
+    }
+    assert(overloaded());
+
+    /* Throttling listener leaves the connection in the backlog. */
+    rc = ipc_listener_overload(ls, OVERLOAD_THROTTLE);
+    errno_assert(rc == 0);
+    int c1 = ipc_connect(TESTADDR, -1);
+    errno_assert(c1 >= 0);
+    int s = ipc_accept(ls, now() + 20);
+    assert(s == -1 && errno == ETIMEDOUT);
+
+    /* Rejecting listener closes the connection straight away. */
+    rc = ipc_listener_overload(ls, OVERLOAD_REJECT);
+    errno_assert(rc == 0);
+    s = ipc_accept(ls, now() + 20);
+    assert(s == -1 && errno == ETIMEDOUT);
+    char c;
+    rc = brecv(c1, &c, 1, now() + 1000);
+    assert(rc == -1 && (errno == EPIPE || errno == ECONNRESET));
+    struct stats st;
+    rc = stats(&st);
+    errno_assert(rc == 0);
+    assert(st.rejected_total == 1);
+    assert(st.lag_ns > 2000000);
+
+    /* Once the load is gone, connections are accepted again. */
+    rc = ipc_listener_overload(ls, OVERLOAD_THROTTLE);
+    errno_assert(rc == 0);
+    rc = hclose(b);
+    errno_assert(rc == 0);
+    calm_down();
+    int c2 = ipc_connect(TESTADDR, -1);
+    errno_assert(c2 >= 0);
+    s = ipc_accept(ls, now() + 1000);
+    errno_assert(s >= 0);
+    rc = hclose(s);
+    errno_assert(rc == 0);
+    rc = hclose(c2);
+    errno_assert(rc == 0);
+    rc = hclose(c1);
+    errno_assert(rc == 0);
+
+    rc = hclose(ls);
+    errno_assert(rc == 0);
+    unlink(TESTADDR);
+    return 0;
+}
+
@@ -0,0 +1,137 @@
+/*
+
+  Copyright (c) 2018 Martin Sustrik
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"),
+  to deal in the Software without restriction, including without limitation
+  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+  and/or sell copies of the Software, and to permit persons to whom
+  the Software is furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included
+  in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+  IN THE SOFTWARE.
+
+*/
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "assert.h"
+#include "../libdill.h"
+
+#define NKINDS 8
+#define HDRSIZE 64
+
+/* Each block is prefixed by a header recording its size and kind so that
+   the arguments passed to the free function can be checked. The header is
+   padded so that the requested alignment is preserved. */
+struct header {
+    void *base;
+    size_t size;
+    int kind;
+};
+
+static size_t allocated[NKINDS];
+static size_t freed[NKINDS];
+static int opaque;
+
+static void *test_alloc(void *o, size_t size, size_t align, int kind) {
+    assert(o == &opaque);
+    assert(kind >= 0 && kind < NKINDS);
+    size_t pad = align > HDRSIZE ? align : HDRSIZE;
+    void *base;
+    int rc = posix_memalign(&base, pad, size + pad);
+    if(rc != 0) return NULL;
+    char *ptr = (char*)base + pad;
+    struct header *hdr = (struct header*)(ptr - sizeof(struct header));
+    hdr->base = base;
+    hdr->size = size;
+    hdr->kind = kind;
+    allocated[kind] += size;
+    return ptr;
+}
+
+static void test_free(void *o, void *ptr, size_t size, int kind) {
+    assert(o == &opaque);
+    struct header *hdr =
+        (struct header*)((char*)ptr - sizeof(struct header));
+    assert(hdr->size == size);
+    assert(hdr->kind == kind);
+    freed[kind] += size;
+    free(hdr->base);
+}
+
+coroutine void worker(int ch) {
+    int val;
+    int rc = chrecv(ch, &val, sizeof(val), -1);
+    errno_assert(rc == 0);
+}
+
+int main(void) {
+    /* Invalid allocators. */
+    struct allocator a = {NULL, test_free, &opaque};
+    int rc = set_allocator(&a);
+    assert(rc == -1 && errno == EINVAL);
+    a.alloc = test_alloc;
+    a.free = NULL;
+    rc = set_allocator(&a);
+    assert(rc == -1 && errno == EINVAL);
+
+    /* Install the allocator before libdill allocates anything. */
+    a.free = test_free;
+    rc = set_allocator(&a);
+    errno_assert(rc == 0);
+
+    /* Don't cache objects so that they are deallocated straight away. */
+    rc = slab_setcap(0);
+    errno_assert(rc == 0);
+
+    int ch[2];
+    rc = chmake(ch);
+    errno_assert(rc == 0);
+    assert(allocated[ALLOC_HANDLES] > 0);
+    assert(allocated[ALLOC_POLLSET] > 0);
+    int b = bundle();
+    errno_assert(b >= 0);
+    rc = bundle_go(b, worker(ch[0]));
+    errno_assert(rc == 0);
+    assert(allocated[ALLOC_STACK] > 0);
+    assert(allocated[ALLOC_OBJECT] > 0);
+    int val = 42;
+    rc = chsend(ch[1], &val, sizeof(val), -1);
+    errno_assert(rc == 0);
+    rc = bundle_wait(b, -1);
+    errno_assert(rc == 0);
+    rc = hclose(b);
+    errno_assert(rc == 0);
+    rc = hclose(ch[1]);
+    errno_assert(rc == 0);
+    rc = hclose(ch[0]);
+    errno_assert(rc == 0);
+    assert(allocated[ALLOC_OBJECT] == freed[ALLOC_OBJECT]);
+
+    /* Buffered channels. */
+    rc = chmake_buffered(ch, sizeof(int), 16);
+    errno_assert(rc == 0);
+    assert(allocated[ALLOC_CHANBUF] >= 2 * 16 * sizeof(int));
+    rc = hclose(ch[0]);
+    errno_assert(rc == 0);
+    rc = hclose(ch[1]);
+    errno_assert(rc == 0);
+    assert(allocated[ALLOC_CHANBUF] == freed[ALLOC_CHANBUF]);
+
+    /* Once anything was allocated, the allocator can't be changed. */
+    rc = set_allocator(NULL);
+    assert(rc == -1 && errno == EBUSY);
+
+    return 0;
+}
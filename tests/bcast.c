@@ -0,0 +1,212 @@
+/*
+
+  Copyright (c) 2018 Martin Sustrik
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"),
+  to deal in the Software without restriction, including without limitation
+  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+  and/or sell copies of the Software, and to permit persons to whom
+  the Software is furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included
+  in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+  IN THE SOFTWARE.
+
+*/
+
+
+#include "assert.h"
+#include "../libdill.h"
+
+static int received = 0;
+
+coroutine void subscriber(int sub, int expected) {
+    int val;
+    int rc = bcast_recv(sub, &val, sizeof(val), -1);
+    errno_assert(rc == 0);
+    assert(val == expected);
+    ++received;
+}
+
+coroutine void failing_subscriber(int sub, int err) {
+    int val;
+    int rc = bcast_recv(sub, &val, sizeof(val), -1);
+    assert(rc == -1 && errno == err);
+}
+
+int main(void) {
+    int val;
+    int i;
+
+    /* Invalid arguments. */
+    int bc = bcast(sizeof(int), 0);
+    assert(bc == -1 && errno == EINVAL);
+    bc = bcast(sizeof(int), 4);
+    errno_assert(bc >= 0);
+    int rc = bcast_subscribe(bc, 0, 77);
+    assert(rc == -1 && errno == EINVAL);
+    char c = 0;
+    rc = bcast_send(bc, &c, sizeof(c));
+    assert(rc == -1 && errno == EMSGSIZE);
+
+    /* Subscribers see only the messages published after subscribing. */
+    val = 1;
+    rc = bcast_send(bc, &val, sizeof(val));
+    errno_assert(rc == 0);
+    int s1 = bcast_subscribe(bc, 0, 0);
+    errno_assert(s1 >= 0);
+    int s2 = bcast_subscribe(bc, 0, 0);
+    errno_assert(s2 >= 0);
+    rc = bcast_recv(s1, &val, sizeof(val), 0);
+    assert(rc == -1 && errno == ETIMEDOUT);
+    rc = bcast_recv(s1, &val, sizeof(val), now() + 10);
+    assert(rc == -1 && errno == ETIMEDOUT);
+    rc = bcast_recv(s1, &c, sizeof(c), 0);
+    assert(rc == -1 && errno == EMSGSIZE);
+
+    /* Each subscriber gets every message. */
+    for(i = 0; i != 3; ++i) {
+        rc = bcast_send(bc, &i, sizeof(i));
+        errno_assert(rc == 0);
+    }
+    for(i = 0; i != 3; ++i) {
+        rc = bcast_recv(s1, &val, sizeof(val), 0);
+        assert(rc == 0);
+        assert(val == i);
+    }
+    for(i = 0; i != 3; ++i) {
+        rc = bcast_recv(s2, &val, sizeof(val), 0);
+        assert(rc == 0);
+        assert(val == i);
+    }
+
+    /* Lagging subscriber skips to the oldest message within the bound. */
+    int s3 = bcast_subscribe(bc, 2, 0);
+    errno_assert(s3 >= 0);
+    for(i = 0; i != 5; ++i) {
+        rc = bcast_send(bc, &i, sizeof(i));
+        errno_assert(rc == 0);
+    }
+    rc = bcast_recv(s3, &val, sizeof(val), 0);
+    assert(rc == 3);
+    assert(val == 3);
+    rc = bcast_recv(s3, &val, sizeof(val), 0);
+    assert(rc == 0);
+    assert(val == 4);
+    /* The bound is capped by the capacity of the channel. */
+    rc = bcast_recv(s1, &val, sizeof(val), 0);
+    assert(rc == 1);
+    assert(val == 1);
+
+    /* Lagging subscriber skips to the newest message. */
+    int s4 = bcast_subscribe(bc, 1, BCAST_LATEST);
+    errno_assert(s4 >= 0);
+    for(i = 0; i != 3; ++i) {
+        rc = bcast_send(bc, &i, sizeof(i));
+        errno_assert(rc == 0);
+    }
+    rc = bcast_recv(s4, &val, sizeof(val), 0);
+    assert(rc == 2);
+    assert(val == 2);
+    rc = hclose(s4);
+    errno_assert(rc == 0);
+    rc = hclose(s3);
+    errno_assert(rc == 0);
+    rc = hclose(s2);
+    errno_assert(rc == 0);
+    rc = hclose(s1);
+    errno_assert(rc == 0);
+
+    /* All blocked subscribers are woken up by a single message. */
+    int subs[100];
+    int b = bundle();
+    errno_assert(b >= 0);
+    for(i = 0; i != 100; ++i) {
+        subs[i] = bcast_subscribe(bc, 0, 0);
+        errno_assert(subs[i] >= 0);
+        rc = bundle_go(b, subscriber(subs[i], 42));
+        errno_assert(rc == 0);
+    }
+    rc = msleep(now() + 10);
+    errno_assert(rc == 0);
+    val = 42;
+    rc = bcast_send(bc, &val, sizeof(val));
+    errno_assert(rc == 0);
+    rc = bundle_wait(b, now() + 1000);
+    errno_assert(rc == 0);
+    assert(received == 100);
+    for(i = 0; i != 100; ++i) {
+        rc = hclose(subs[i]);
+        errno_assert(rc == 0);
+    }
+
+    /* Closing a blocked subscriber. */
+    s1 = bcast_subscribe(bc, 0, 0);
+    errno_assert(s1 >= 0);
+    rc = bundle_go(b, failing_subscriber(s1, EBADF));
+    errno_assert(rc == 0);
+    rc = msleep(now() + 10);
+    errno_assert(rc == 0);
+    rc = hclose(s1);
+    errno_assert(rc == 0);
+    rc = bundle_wait(b, now() + 1000);
+    errno_assert(rc == 0);
+
+    /* Closing the publisher. Subscribers can still receive pending
+       messages. */
+    s1 = bcast_subscribe(bc, 0, 0);
+    errno_assert(s1 >= 0);
+    val = 7;
+    rc = bcast_send(bc, &val, sizeof(val));
+    errno_assert(rc == 0);
+    s2 = bcast_subscribe(bc, 0, 0);
+    errno_assert(s2 >= 0);
+    rc = bundle_go(b, failing_subscriber(s2, EPIPE));
+    errno_assert(rc == 0);
+    rc = msleep(now() + 10);
+    errno_assert(rc == 0);
+    rc = hclose(bc);
+    errno_assert(rc == 0);
+    rc = bundle_wait(b, now() + 1000);
+    errno_assert(rc == 0);
+    rc = bcast_recv(s1, &val, sizeof(val), -1);
+    assert(rc == 0);
+    assert(val == 7);
+    rc = bcast_recv(s1, &val, sizeof(val), -1);
+    assert(rc == -1 && errno == EPIPE);
+    rc = hclose(s2);
+    errno_assert(rc == 0);
+    rc = hclose(s1);
+    errno_assert(rc == 0);
+
+    /* Closing the subscriber and the publisher after the subscriber was
+       woken up but before it got to run. */
+    bc = bcast(sizeof(int), 4);
+    errno_assert(bc >= 0);
+    s1 = bcast_subscribe(bc, 0, 0);
+    errno_assert(s1 >= 0);
+    rc = bundle_go(b, failing_subscriber(s1, EBADF));
+    errno_assert(rc == 0);
+    rc = msleep(now() + 10);
+    errno_assert(rc == 0);
+    rc = bcast_send(bc, &val, sizeof(val));
+    errno_assert(rc == 0);
+    rc = hclose(s1);
+    errno_assert(rc == 0);
+    rc = hclose(bc);
+    errno_assert(rc == 0);
+    rc = bundle_wait(b, now() + 1000);
+    errno_assert(rc == 0);
+    rc = hclose(b);
+    errno_assert(rc == 0);
+
+    return 0;
+}
@@ -0,0 +1,146 @@
+/*
+
+  Copyright (c) 2016 Martin Sustrik
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"),
+  to deal in the Software without restriction, including without limitation
+  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+  and/or sell copies of the Software, and to permit persons to whom
+  the Software is furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included
+  in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+  IN THE SOFTWARE.
+
+*/
+#include <string.h>
+
+#include "assert.h"
+#include "../libdill.h"
+
+coroutine void client(int port) {
+    struct ipaddr addr;
+    int rc = ipaddr_local(&addr, NULL, port, 0);
+    errno_assert(rc == 0);
+    int s = tcp_connect(&addr, -1);
+    errno_assert(s >= 0);
+    rc = bsend(s, "Hello, world!", 13, -1);
+    errno_assert(rc == 0);
+    rc = msleep(now() + 50);
+    errno_assert(rc == 0);
+    rc = bsend(s, "AB", 2, -1);
+    errno_assert(rc == 0);
+    rc = msleep(now() + 50);
+    errno_assert(rc == 0);
+    rc = bsend(s, "CD", 2, -1);
+    errno_assert(rc == 0);
+    s = suffix_attach(s, "\r\n", 2);
+    errno_assert(s >= 0);
+    rc = msend(s, "foo", 3, -1);
+    errno_assert(rc == 0);
+    rc = msend(s, "barbaz", 6, -1);
+    errno_assert(rc == 0);
+    /* Wait till the peer closes the connection. */
+    char buf[1];
+    ssize_t sz = mrecv(s, buf, sizeof(buf), -1);
+    assert(sz < 0);
+    rc = hclose(s);
+    errno_assert(rc == 0);
+}
+
+int main(void) {
+    struct ipaddr addr;
+    int rc = ipaddr_local(&addr, NULL, 0, 0);
+    errno_assert(rc == 0);
+    int ls = tcp_listen(&addr, 10);
+    errno_assert(ls >= 0);
+    int cr = go(client(ipaddr_port(&addr)));
+    errno_assert(cr >= 0);
+    int s = tcp_accept(ls, NULL, -1);
+    errno_assert(s >= 0);
+
+    /* Invalid arguments. */
+    const void *buf;
+    size_t len;
+    rc = bpeek(ls, &buf, &len, -1);
+    assert(rc == -1 && errno == ENOTSUP);
+    rc = bpeek(s, NULL, &len, -1);
+    assert(rc == -1 && errno == EINVAL);
+    rc = bconsume(s, 1);
+    assert(rc == -1 && errno == EINVAL);
+
+    /* Data are borrowed from the rx buffer and consumed in parts. */
+    rc = bpeek(s, &buf, &len, -1);
+    errno_assert(rc == 0);
+    assert(len == 13 && memcmp(buf, "Hello, world!", 13) == 0);
+    rc = bconsume(s, 7);
+    errno_assert(rc == 0);
+    struct sock_stats st;
+    rc = sock_stats(s, &st);
+    errno_assert(rc == 0);
+    uint64_t syscalls = st.syscalls;
+    rc = bpeek(s, &buf, &len, -1);
+    errno_assert(rc == 0);
+    assert(len == 6 && memcmp(buf, "world!", 6) == 0);
+    rc = sock_stats(s, &st);
+    errno_assert(rc == 0);
+    assert(st.syscalls == syscalls);
+    assert(st.bytes_in == 7);
+    rc = bconsume(s, 7);
+    assert(rc == -1 && errno == EINVAL);
+    /* Regular receive takes the rest from the rx buffer. */
+    char data[6];
+    rc = brecv(s, data, sizeof(data), -1);
+    errno_assert(rc == 0);
+    assert(memcmp(data, "world!", 6) == 0);
+
+    /* Peeking again without consuming waits for more data. */
+    rc = bpeek(s, &buf, &len, -1);
+    errno_assert(rc == 0);
+    assert(len == 2 && memcmp(buf, "AB", 2) == 0);
+    rc = bpeek(s, &buf, &len, -1);
+    errno_assert(rc == 0);
+    assert(len >= 4 && memcmp(buf, "ABCD", 4) == 0);
+    rc = bconsume(s, 4);
+    errno_assert(rc == 0);
+
+    /* SUFFIX protocol parses the messages in place. */
+    s = suffix_attach(s, "\r\n", 2);
+    errno_assert(s >= 0);
+    char msg[16];
+    ssize_t sz = mrecv(s, msg, sizeof(msg), -1);
+    errno_assert(sz == 3);
+    assert(memcmp(msg, "foo", 3) == 0);
+    sz = mrecv(s, msg, 3, -1);
+    assert(sz == -1 && errno == EMSGSIZE);
+    rc = hclose(s);
+    errno_assert(rc == 0);
+    rc = bundle_wait(cr, -1);
+    errno_assert(rc == 0);
+    rc = hclose(cr);
+    errno_assert(rc == 0);
+
+    /* Sockets without rx buffer don't support peeking. */
+    int p[2];
+    rc = ipc_pair(p);
+    errno_assert(rc == 0);
+    rc = bpeek(p[0], &buf, &len, -1);
+    assert(rc == -1 && errno == ENOTSUP);
+    rc = hclose(p[1]);
+    errno_assert(rc == 0);
+    rc = hclose(p[0]);
+    errno_assert(rc == 0);
+
+    rc = hclose(ls);
+    errno_assert(rc == 0);
+    return 0;
+}
+
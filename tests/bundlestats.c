@@ -0,0 +1,121 @@
+/*
+
+  Copyright (c) 2016 Martin Sustrik
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"),
+  to deal in the Software without restriction, including without limitation
+  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+  and/or sell copies of the Software, and to permit persons to whom
+  the Software is furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included
+  in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+  IN THE SOFTWARE.
+
+*/
+
+#include <time.h>
+
+#include "assert.h"
+#include "../libdill.h"
+
+#define MS 1000000ULL
+
+coroutine void spinner(int ms) {
+    clock_t deadline = clock() + (clock_t)ms * CLOCKS_PER_SEC / 1000;
+    volatile uint64_t n = 0;
+    while(clock() < deadline) ++n;
+}
+
+coroutine void sleeper(int ms) {
+    int rc = msleep(now() + ms);
+    errno_assert(rc == 0);
+}
+
+coroutine void receiver(int ch) {
+    int val;
+    int rc = chrecv(ch, &val, sizeof(val), now() + 1000);
+    errno_assert(rc == 0);
+}
+
+int main(void) {
+    /* Invalid arguments. */
+    int b = bundle();
+    errno_assert(b >= 0);
+    int rc = bundle_stats(b, NULL);
+    assert(rc == -1 && errno == EINVAL);
+    int ch[2];
+    rc = chmake(ch);
+    errno_assert(rc == 0);
+    struct bundle_stats stats;
+    rc = bundle_stats(ch[0], &stats);
+    assert(rc == -1 && errno == ENOTSUP);
+
+    /* Empty bundle. */
+    rc = bundle_stats(b, &stats);
+    errno_assert(rc == 0);
+    assert(stats.coroutines == 0);
+    assert(stats.switches == 0);
+    assert(stats.cpu_ns == 0);
+
+    /* CPU time of both running and finished coroutines is accounted for. */
+    rc = bundle_go(b, spinner(50));
+    errno_assert(rc == 0);
+    rc = bundle_go(b, sleeper(100));
+    errno_assert(rc == 0);
+    rc = bundle_stats(b, &stats);
+    errno_assert(rc == 0);
+    assert(stats.coroutines == 1);
+    assert(stats.cpu_ns >= 40 * MS);
+    rc = bundle_wait(b, -1);
+    errno_assert(rc == 0);
+    rc = bundle_stats(b, &stats);
+    errno_assert(rc == 0);
+    assert(stats.coroutines == 0);
+    assert(stats.switches >= 3);
+    /* The spinner burns CPU time for 50ms, but on a loaded machine it can
+       take arbitrarily long wall-clock time, so there's no upper bound. */
+    assert(stats.cpu_ns >= 40 * MS);
+    assert(stats.blocked_ns[WAIT_TIMER] >= 80 * MS);
+    assert(stats.blocked_ns[WAIT_CHAN] == 0);
+    rc = hclose(b);
+    errno_assert(rc == 0);
+
+    /* Blocked time is broken down by what the coroutine waits for. */
+    int h = go(receiver(ch[0]));
+    errno_assert(h >= 0);
+    rc = msleep(now() + 50);
+    errno_assert(rc == 0);
+    rc = bundle_stats(h, &stats);
+    errno_assert(rc == 0);
+    assert(stats.coroutines == 1);
+    assert(stats.blocked_ns[WAIT_CHAN] >= 40 * MS);
+    int val = 42;
+    rc = chsend(ch[1], &val, sizeof(val), -1);
+    errno_assert(rc == 0);
+    rc = bundle_wait(h, -1);
+    errno_assert(rc == 0);
+    rc = bundle_stats(h, &stats);
+    errno_assert(rc == 0);
+    assert(stats.coroutines == 0);
+    assert(stats.blocked_ns[WAIT_CHAN] >= 40 * MS);
+    assert(stats.blocked_ns[WAIT_TIMER] == 0);
+    assert(stats.cpu_ns < 40 * MS);
+    rc = hclose(h);
+    errno_assert(rc == 0);
+
+    rc = hclose(ch[1]);
+    errno_assert(rc == 0);
+    rc = hclose(ch[0]);
+    errno_assert(rc == 0);
+    return 0;
+}
+
@@ -0,0 +1,225 @@
+/*
+
+  Copyright (c) 2018 Martin Sustrik
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"),
+  to deal in the Software without restriction, including without limitation
+  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+  and/or sell copies of the Software, and to permit persons to whom
+  the Software is furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included
+  in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+  IN THE SOFTWARE.
+
+*/
+
+
+#include "assert.h"
+#include "../libdill.h"
+
+coroutine void sender(int ch, int val) {
+    int rc = chsend(ch, &val, sizeof(val), -1);
+    errno_assert(rc == 0);
+}
+
+coroutine void receiver(int ch, int expected) {
+    int val;
+    int rc = chrecv(ch, &val, sizeof(val), -1);
+    errno_assert(rc == 0);
+    assert(val == expected);
+}
+
+int main(void) {
+    int val;
+
+    /* Zero capacity yields an unbuffered channel. */
+    int ch[2];
+    int rc = chmake_buffered(ch, sizeof(int), 0);
+    errno_assert(rc == 0);
+    val = 1;
+    rc = chsend(ch[0], &val, sizeof(val), 0);
+    assert(rc == -1 && errno == ETIMEDOUT);
+    rc = hclose(ch[1]);
+    errno_assert(rc == 0);
+    rc = hclose(ch[0]);
+    errno_assert(rc == 0);
+
+    /* Sending doesn't block until the buffer is full. Messages are received
+       in FIFO order. */
+    rc = chmake_buffered(ch, sizeof(int), 3);
+    errno_assert(rc == 0);
+    int i;
+    for(i = 0; i != 3; ++i) {
+        rc = chsend(ch[0], &i, sizeof(i), 0);
+        errno_assert(rc == 0);
+    }
+    rc = chsend(ch[0], &i, sizeof(i), 0);
+    assert(rc == -1 && errno == ETIMEDOUT);
+    rc = chsend(ch[0], &i, sizeof(i), now() + 10);
+    assert(rc == -1 && errno == ETIMEDOUT);
+    for(i = 0; i != 3; ++i) {
+        rc = chrecv(ch[1], &val, sizeof(val), 0);
+        errno_assert(rc == 0);
+        assert(val == i);
+    }
+    rc = chrecv(ch[1], &val, sizeof(val), 0);
+    assert(rc == -1 && errno == ETIMEDOUT);
+
+    /* The buffers wrap around and the directions are independent. */
+    for(i = 0; i != 10; ++i) {
+        rc = chsend(ch[0], &i, sizeof(i), 0);
+        errno_assert(rc == 0);
+        int j = 100 + i;
+        rc = chsend(ch[1], &j, sizeof(j), 0);
+        errno_assert(rc == 0);
+        rc = chrecv(ch[1], &val, sizeof(val), 0);
+        errno_assert(rc == 0);
+        assert(val == i);
+        rc = chrecv(ch[0], &val, sizeof(val), 0);
+        errno_assert(rc == 0);
+        assert(val == 100 + i);
+    }
+
+    /* Message size must match the element size. */
+    char c = 0;
+    rc = chsend(ch[0], &c, sizeof(c), 0);
+    assert(rc == -1 && errno == EMSGSIZE);
+    rc = chrecv(ch[1], &c, sizeof(c), 0);
+    assert(rc == -1 && errno == EMSGSIZE);
+    val = 7;
+    rc = chsend(ch[0], &val, sizeof(val), 0);
+    errno_assert(rc == 0);
+    rc = chrecv(ch[1], &c, sizeof(c), 0);
+    assert(rc == -1 && errno == EMSGSIZE);
+    rc = chrecv(ch[1], &val, sizeof(val), 0);
+    errno_assert(rc == 0);
+    assert(val == 7);
+
+    /* Blocked receiver gets the message directly. */
+    int b = bundle();
+    errno_assert(b >= 0);
+    rc = bundle_go(b, receiver(ch[1], 42));
+    errno_assert(rc == 0);
+    rc = msleep(now() + 10);
+    errno_assert(rc == 0);
+    val = 42;
+    rc = chsend(ch[0], &val, sizeof(val), 0);
+    errno_assert(rc == 0);
+    rc = bundle_wait(b, -1);
+    errno_assert(rc == 0);
+
+    /* When the buffer is full senders block. Receiving a message moves
+       the message of the first blocked sender to the buffer. */
+    for(i = 0; i != 3; ++i) {
+        rc = chsend(ch[0], &i, sizeof(i), 0);
+        errno_assert(rc == 0);
+    }
+    rc = bundle_go(b, sender(ch[0], 3));
+    errno_assert(rc == 0);
+    rc = msleep(now() + 10);
+    errno_assert(rc == 0);
+    rc = bundle_go(b, sender(ch[0], 4));
+    errno_assert(rc == 0);
+    rc = msleep(now() + 10);
+    errno_assert(rc == 0);
+    for(i = 0; i != 5; ++i) {
+        rc = chrecv(ch[1], &val, sizeof(val), -1);
+        errno_assert(rc == 0);
+        assert(val == i);
+    }
+    rc = bundle_wait(b, -1);
+    errno_assert(rc == 0);
+
+    /* Buffered messages can be received after chdone(). */
+    for(i = 0; i != 2; ++i) {
+        rc = chsend(ch[0], &i, sizeof(i), 0);
+        errno_assert(rc == 0);
+    }
+    rc = chdone(ch[0]);
+    errno_assert(rc == 0);
+    rc = chsend(ch[0], &i, sizeof(i), 0);
+    assert(rc == -1 && errno == EPIPE);
+    for(i = 0; i != 2; ++i) {
+        rc = chrecv(ch[1], &val, sizeof(val), 0);
+        errno_assert(rc == 0);
+        assert(val == i);
+    }
+    rc = chrecv(ch[1], &val, sizeof(val), 0);
+    assert(rc == -1 && errno == EPIPE);
+    rc = hclose(ch[1]);
+    errno_assert(rc == 0);
+    rc = hclose(ch[0]);
+    errno_assert(rc == 0);
+
+    /* choose() on a buffered channel. */
+    rc = chmake_buffered(ch, sizeof(int), 2);
+    errno_assert(rc == 0);
+    struct chclause cls[] = {
+        {CHRECV, ch[1], &val, sizeof(val)},
+        {CHSEND, ch[0], &i, sizeof(i)}
+    };
+    i = 5;
+    rc = choose(cls, 2, 0);
+    assert(rc == 1 && errno == 0);
+    rc = choose(cls, 2, 0);
+    assert(rc == 0 && errno == 0);
+    assert(val == 5);
+    rc = choose(cls, 1, 0);
+    assert(rc == -1 && errno == ETIMEDOUT);
+    rc = choose(&cls[1], 1, 0);
+    assert(rc == 0 && errno == 0);
+    rc = choose(&cls[1], 1, 0);
+    assert(rc == 0 && errno == 0);
+    rc = choose(&cls[1], 1, 0);
+    assert(rc == -1 && errno == ETIMEDOUT);
+    rc = bundle_go(b, receiver(ch[1], 5));
+    errno_assert(rc == 0);
+    rc = choose(&cls[1], 1, -1);
+    assert(rc == 0 && errno == 0);
+    rc = bundle_wait(b, -1);
+    errno_assert(rc == 0);
+
+    /* Select set tracks the state of the buffer. */
+    int s = chselect();
+    errno_assert(s >= 0);
+    rc = chselect_add(s, &cls[0]);
+    assert(rc == 0);
+    rc = chselect_wait(s, 0);
+    assert(rc == 0 && errno == 0);
+    assert(val == 5);
+    rc = chselect_wait(s, 0);
+    assert(rc == 0 && errno == 0);
+    assert(val == 5);
+    rc = chselect_wait(s, 0);
+    assert(rc == -1 && errno == ETIMEDOUT);
+    rc = chselect_add(s, &cls[1]);
+    assert(rc == 1);
+    rc = chselect_wait(s, 0);
+    assert(rc == 1 && errno == 0);
+    rc = chselect_rm(s, 1);
+    errno_assert(rc == 0);
+    rc = chselect_wait(s, 0);
+    assert(rc == 0 && errno == 0);
+    rc = chselect_wait(s, 0);
+    assert(rc == -1 && errno == ETIMEDOUT);
+    rc = hclose(s);
+    errno_assert(rc == 0);
+
+    rc = hclose(b);
+    errno_assert(rc == 0);
+    rc = hclose(ch[1]);
+    errno_assert(rc == 0);
+    rc = hclose(ch[0]);
+    errno_assert(rc == 0);
+
+    return 0;
+}
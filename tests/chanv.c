@@ -0,0 +1,171 @@
+/*
+
+  Copyright (c) 2018 Martin Sustrik
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"),
+  to deal in the Software without restriction, including without limitation
+  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+  and/or sell copies of the Software, and to permit persons to whom
+  the Software is furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included
+  in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+  IN THE SOFTWARE.
+
+*/
+
+
+#include "assert.h"
+#include "../libdill.h"
+
+coroutine void batch_sender(int ch, int first, int count) {
+    int vals[16];
+    int i;
+    for(i = 0; i != count; ++i) vals[i] = first + i;
+    ssize_t sz = chsendv(ch, vals, sizeof(int), count, -1);
+    errno_assert(sz >= 0);
+    assert(sz == count);
+}
+
+coroutine void batch_receiver(int ch, int first, int count) {
+    int vals[16];
+    ssize_t sz = chrecvv(ch, vals, sizeof(int), 16, -1);
+    errno_assert(sz >= 0);
+    assert(sz == count);
+    int i;
+    for(i = 0; i != count; ++i) assert(vals[i] == first + i);
+}
+
+coroutine void mismatched_receiver(int ch) {
+    int vals[16];
+    ssize_t sz = chrecvv(ch, vals, sizeof(int), 16, -1);
+    assert(sz == -1 && errno == EMSGSIZE);
+}
+
+int main(void) {
+    int vals[16];
+    int i;
+
+    /* Invalid arguments. */
+    int ch[2];
+    int rc = chmake(ch);
+    errno_assert(rc == 0);
+    ssize_t sz = chsendv(ch[0], vals, sizeof(int), 0, -1);
+    assert(sz == -1 && errno == EINVAL);
+    sz = chrecvv(ch[1], NULL, sizeof(int), 1, -1);
+    assert(sz == -1 && errno == EINVAL);
+    sz = chrecvv(ch[1], vals, sizeof(int), 16, 0);
+    assert(sz == -1 && errno == ETIMEDOUT);
+
+    /* Blocked batch receiver gets the whole batch in one go. */
+    int b = bundle();
+    errno_assert(b >= 0);
+    rc = bundle_go(b, batch_receiver(ch[1], 0, 10));
+    errno_assert(rc == 0);
+    rc = msleep(now() + 10);
+    errno_assert(rc == 0);
+    for(i = 0; i != 10; ++i) vals[i] = i;
+    sz = chsendv(ch[0], vals, sizeof(int), 10, -1);
+    assert(sz == 10);
+    rc = bundle_wait(b, -1);
+    errno_assert(rc == 0);
+
+    /* Blocked batch sender is drained by several receives. */
+    rc = bundle_go(b, batch_sender(ch[0], 100, 8));
+    errno_assert(rc == 0);
+    rc = msleep(now() + 10);
+    errno_assert(rc == 0);
+    sz = chrecvv(ch[1], vals, sizeof(int), 16, -1);
+    assert(sz == 8);
+    for(i = 0; i != 8; ++i) assert(vals[i] == 100 + i);
+    rc = bundle_wait(b, -1);
+    errno_assert(rc == 0);
+
+    /* Batch receive collects messages from multiple blocked senders. */
+    rc = bundle_go(b, batch_sender(ch[0], 0, 4));
+    errno_assert(rc == 0);
+    rc = bundle_go(b, batch_sender(ch[0], 4, 4));
+    errno_assert(rc == 0);
+    rc = msleep(now() + 10);
+    errno_assert(rc == 0);
+    sz = chrecvv(ch[1], vals, sizeof(int), 16, -1);
+    assert(sz == 8);
+    for(i = 0; i != 8; ++i) assert(vals[i] == i);
+    rc = bundle_wait(b, -1);
+    errno_assert(rc == 0);
+
+    /* Size mismatch. */
+    rc = bundle_go(b, mismatched_receiver(ch[1]));
+    errno_assert(rc == 0);
+    rc = msleep(now() + 10);
+    errno_assert(rc == 0);
+    char c[4];
+    sz = chsendv(ch[0], c, 1, 4, -1);
+    assert(sz == -1 && errno == EMSGSIZE);
+    rc = hclose(b);
+    errno_assert(rc == 0);
+    rc = hclose(ch[1]);
+    errno_assert(rc == 0);
+    rc = hclose(ch[0]);
+    errno_assert(rc == 0);
+
+    /* Batch operations on a buffered channel. */
+    rc = chmake_buffered(ch, sizeof(int), 5);
+    errno_assert(rc == 0);
+    for(i = 0; i != 8; ++i) vals[i] = i;
+    sz = chsendv(ch[0], vals, sizeof(int), 8, 0);
+    assert(sz == 5);
+    sz = chsendv(ch[0], vals, sizeof(int), 8, 0);
+    assert(sz == -1 && errno == ETIMEDOUT);
+    sz = chrecvv(ch[1], vals, sizeof(int), 3, 0);
+    assert(sz == 3);
+    for(i = 0; i != 3; ++i) assert(vals[i] == i);
+    sz = chrecvv(ch[1], vals, sizeof(int), 16, 0);
+    assert(sz == 2);
+    assert(vals[0] == 3 && vals[1] == 4);
+
+    /* Receiving from a full buffer refills it from the blocked sender. */
+    for(i = 0; i != 5; ++i) vals[i] = i;
+    sz = chsendv(ch[0], vals, sizeof(int), 5, 0);
+    assert(sz == 5);
+    b = bundle();
+    errno_assert(b >= 0);
+    rc = bundle_go(b, batch_sender(ch[0], 5, 3));
+    errno_assert(rc == 0);
+    rc = msleep(now() + 10);
+    errno_assert(rc == 0);
+    sz = chrecvv(ch[1], vals, sizeof(int), 3, 0);
+    assert(sz == 3);
+    rc = bundle_wait(b, -1);
+    errno_assert(rc == 0);
+    sz = chrecvv(ch[1], vals, sizeof(int), 16, 0);
+    assert(sz == 5);
+    for(i = 0; i != 5; ++i) assert(vals[i] == 3 + i);
+
+    /* Buffered messages are still available after chdone(). */
+    sz = chsendv(ch[0], vals, sizeof(int), 2, 0);
+    assert(sz == 2);
+    rc = chdone(ch[0]);
+    errno_assert(rc == 0);
+    sz = chrecvv(ch[1], vals, sizeof(int), 16, 0);
+    assert(sz == 2);
+    sz = chrecvv(ch[1], vals, sizeof(int), 16, 0);
+    assert(sz == -1 && errno == EPIPE);
+
+    rc = hclose(b);
+    errno_assert(rc == 0);
+    rc = hclose(ch[1]);
+    errno_assert(rc == 0);
+    rc = hclose(ch[0]);
+    errno_assert(rc == 0);
+
+    return 0;
+}
@@ -23,6 +23,8 @@
 */
 
 #include <stdio.h>
+#include <sys/socket.h>
+#include <unistd.h>
 
 #include "assert.h"
 #include "../libdill.h"
@@ -397,6 +399,58 @@ int main() {
     rc = hclose(ch25[0]);
     errno_assert(rc == 0);
 
+    /* Mixing file descriptors and channels. */
+    int fds[2];
+    rc = socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+    errno_assert(rc == 0);
+    int ch26[2];
+    rc = chmake(ch26);
+    errno_assert(rc == 0);
+    struct chclause cls21[] = {
+        {CHRECV, ch26[1], &val, sizeof(val)},
+        {FDIN, fds[0], NULL, 0}
+    };
+    rc = choose(cls21, 2, 0);
+    choose_assert(-1, ETIMEDOUT);
+    rc = choose(cls21, 2, now() + 50);
+    choose_assert(-1, ETIMEDOUT);
+    ssize_t sz = send(fds[1], "A", 1, 0);
+    errno_assert(sz == 1);
+    rc = choose(cls21, 2, -1);
+    choose_assert(1, 0);
+    char c;
+    sz = recv(fds[0], &c, 1, 0);
+    errno_assert(sz == 1);
+    int hndl20 = go(sender3(ch26[0], 555, now() + 50));
+    errno_assert(hndl20 >= 0);
+    rc = choose(cls21, 2, -1);
+    choose_assert(0, 0);
+    assert(val == 555);
+    rc = hclose(hndl20);
+    errno_assert(rc == 0);
+    struct chclause cls22[] = {
+        {CHRECV, ch26[1], &val, sizeof(val)},
+        {FDOUT, fds[0], NULL, 0}
+    };
+    rc = choose(cls22, 2, 0);
+    choose_assert(1, 0);
+    struct chclause cls23[] = {
+        {FDIN, fds[0], NULL, 0},
+        {FDIN, 1000, NULL, 0}
+    };
+    rc = choose(cls23, 2, -1);
+    choose_assert(1, EBADF);
+    rc = hclose(ch26[1]);
+    errno_assert(rc == 0);
+    rc = hclose(ch26[0]);
+    errno_assert(rc == 0);
+    rc = fdclean(fds[0]);
+    errno_assert(rc == 0);
+    rc = fdclean(fds[1]);
+    errno_assert(rc == 0);
+    close(fds[0]);
+    close(fds[1]);
+
     return 0;
 }
 
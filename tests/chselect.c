@@ -0,0 +1,235 @@
+/*
+
+  Copyright (c) 2018 Martin Sustrik
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"),
+  to deal in the Software without restriction, including without limitation
+  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+  and/or sell copies of the Software, and to permit persons to whom
+  the Software is furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included
+  in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+  IN THE SOFTWARE.
+
+*/
+
+#include "assert.h"
+#include "../libdill.h"
+
+coroutine void sender(int ch, int val, int64_t deadline) {
+    int rc = msleep(deadline);
+    errno_assert(rc == 0);
+    rc = chsend(ch, &val, sizeof(val), -1);
+    errno_assert(rc == 0);
+}
+
+coroutine void receiver(int ch, int expected) {
+    int val;
+    int rc = chrecv(ch, &val, sizeof(val), -1);
+    errno_assert(rc == 0);
+    assert(val == expected);
+}
+
+coroutine void waiter(int s, int64_t deadline) {
+    int rc = chselect_wait(s, deadline);
+    assert(rc == -1 && errno == ETIMEDOUT);
+}
+
+coroutine void closed(int s, int64_t deadline) {
+    int rc = chselect_wait(s, deadline);
+    assert(rc == -1 && errno == EBADF);
+}
+
+int main(void) {
+    int val;
+
+    /* Empty select set. */
+    int s = chselect();
+    errno_assert(s >= 0);
+    int rc = chselect_wait(s, 0);
+    assert(rc == -1 && errno == ETIMEDOUT);
+    rc = chselect_wait(s, now() + 10);
+    assert(rc == -1 && errno == ETIMEDOUT);
+
+    /* Invalid arguments. */
+    int ch[2];
+    rc = chmake(ch);
+    errno_assert(rc == 0);
+    struct chclause cl = {FDIN, ch[0], &val, sizeof(val)};
+    rc = chselect_add(s, &cl);
+    assert(rc == -1 && errno == EINVAL);
+    rc = chselect_rm(s, 0);
+    assert(rc == -1 && errno == EINVAL);
+    rc = hclose(ch[1]);
+    errno_assert(rc == 0);
+    rc = hclose(ch[0]);
+    errno_assert(rc == 0);
+
+    /* Lots of channels, only few of them are active. */
+    int chs[100][2];
+    int vals[100];
+    int i;
+    for(i = 0; i != 100; ++i) {
+        rc = chmake(chs[i]);
+        errno_assert(rc == 0);
+        struct chclause cl = {CHRECV, chs[i][1], &vals[i], sizeof(int)};
+        rc = chselect_add(s, &cl);
+        assert(rc == i);
+    }
+    int b = bundle();
+    errno_assert(b >= 0);
+    rc = bundle_go(b, sender(chs[10][0], 10, now() + 10));
+    errno_assert(rc == 0);
+    rc = bundle_go(b, sender(chs[90][0], 90, now() + 30));
+    errno_assert(rc == 0);
+    rc = chselect_wait(s, -1);
+    assert(rc == 10 && errno == 0);
+    assert(vals[10] == 10);
+    rc = chselect_wait(s, -1);
+    assert(rc == 90 && errno == 0);
+    assert(vals[90] == 90);
+    rc = chselect_wait(s, 0);
+    assert(rc == -1 && errno == ETIMEDOUT);
+
+    /* Items ready before the wait are served in round-robin fashion. */
+    rc = bundle_go(b, sender(chs[5][0], 5, 0));
+    errno_assert(rc == 0);
+    rc = bundle_go(b, sender(chs[6][0], 6, 0));
+    errno_assert(rc == 0);
+    rc = msleep(now() + 10);
+    errno_assert(rc == 0);
+    rc = chselect_wait(s, 0);
+    assert(rc == 5 && errno == 0);
+    assert(vals[5] == 5);
+    rc = chselect_wait(s, 0);
+    assert(rc == 6 && errno == 0);
+    assert(vals[6] == 6);
+    rc = bundle_wait(b, -1);
+    errno_assert(rc == 0);
+
+    /* Removed item is not reported and its ID gets reused. */
+    rc = chselect_rm(s, 20);
+    errno_assert(rc == 0);
+    rc = bundle_go(b, sender(chs[20][0], 20, 0));
+    errno_assert(rc == 0);
+    rc = chselect_wait(s, now() + 10);
+    assert(rc == -1 && errno == ETIMEDOUT);
+    struct chclause cl2 = {CHRECV, chs[20][1], &vals[20], sizeof(int)};
+    rc = chselect_add(s, &cl2);
+    assert(rc == 20);
+    rc = chselect_wait(s, 0);
+    assert(rc == 20 && errno == 0);
+    assert(vals[20] == 20);
+
+    /* Sending. */
+    int ch2[2];
+    rc = chmake(ch2);
+    errno_assert(rc == 0);
+    val = 333;
+    struct chclause cl3 = {CHSEND, ch2[0], &val, sizeof(val)};
+    int id = chselect_add(s, &cl3);
+    assert(id == 100);
+    rc = bundle_go(b, receiver(ch2[1], 333));
+    errno_assert(rc == 0);
+    rc = chselect_wait(s, -1);
+    assert(rc == 100 && errno == 0);
+
+    /* Done channel. */
+    rc = chdone(chs[30][0]);
+    errno_assert(rc == 0);
+    rc = chselect_wait(s, 0);
+    assert(rc == 30 && errno == EPIPE);
+    rc = chselect_rm(s, 30);
+    errno_assert(rc == 0);
+
+    /* Closed channel. */
+    rc = hclose(ch2[1]);
+    errno_assert(rc == 0);
+    rc = hclose(ch2[0]);
+    errno_assert(rc == 0);
+    rc = chselect_wait(s, 0);
+    assert(rc == 100 && errno == EBADF);
+
+    rc = bundle_wait(b, -1);
+    errno_assert(rc == 0);
+    rc = hclose(b);
+    errno_assert(rc == 0);
+    rc = hclose(s);
+    errno_assert(rc == 0);
+
+    /* Channel activity after the waiter timed out but before it got to
+       run must not try to wake it up again. */
+    s = chselect();
+    errno_assert(s >= 0);
+    rc = chmake(ch);
+    errno_assert(rc == 0);
+    struct chclause cl4 = {CHRECV, ch[1], &val, sizeof(val)};
+    rc = chselect_add(s, &cl4);
+    errno_assert(rc == 0);
+    int64_t deadline = now() + 50;
+    int cr = go(waiter(s, deadline));
+    errno_assert(cr >= 0);
+    /* Make both the waiter's and our timer expire in the same poll, ours
+       first. */
+    while(now() <= deadline + 1);
+    rc = msleep(deadline - 1);
+    errno_assert(rc == 0);
+    rc = chsend(ch[0], &val, sizeof(val), now() + 10);
+    assert(rc == -1 && errno == ETIMEDOUT);
+    rc = bundle_wait(cr, -1);
+    errno_assert(rc == 0);
+    rc = hclose(cr);
+    errno_assert(rc == 0);
+    rc = hclose(s);
+    errno_assert(rc == 0);
+    rc = hclose(ch[1]);
+    errno_assert(rc == 0);
+    rc = hclose(ch[0]);
+    errno_assert(rc == 0);
+
+    /* Closing the set resumes the coroutine waiting on it. */
+    for(i = 0; i != 2; ++i) {
+        s = chselect();
+        errno_assert(s >= 0);
+        rc = chmake(ch);
+        errno_assert(rc == 0);
+        cl4.ch = ch[1];
+        rc = chselect_add(s, &cl4);
+        errno_assert(rc == 0);
+        cr = go(closed(s, i ? now() + 50 : -1));
+        errno_assert(cr >= 0);
+        rc = yield();
+        errno_assert(rc == 0);
+        rc = hclose(s);
+        errno_assert(rc == 0);
+        rc = bundle_wait(cr, now() + 100);
+        errno_assert(rc == 0);
+        /* Give the deadline a chance to expire. */
+        rc = msleep(now() + 100);
+        errno_assert(rc == 0);
+        rc = hclose(cr);
+        errno_assert(rc == 0);
+        rc = hclose(ch[1]);
+        errno_assert(rc == 0);
+        rc = hclose(ch[0]);
+        errno_assert(rc == 0);
+    }
+
+    for(i = 0; i != 100; ++i) {
+        rc = hclose(chs[i][1]);
+        errno_assert(rc == 0);
+        rc = hclose(chs[i][0]);
+        errno_assert(rc == 0);
+    }
+
+    return 0;
+}
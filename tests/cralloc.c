@@ -0,0 +1,99 @@
+/*
+
+  Copyright (c) 2018 Martin Sustrik
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"),
+  to deal in the Software without restriction, including without limitation
+  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+  and/or sell copies of the Software, and to permit persons to whom
+  the Software is furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included
+  in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+  IN THE SOFTWARE.
+
+*/
+
+#include <stdint.h>
+#include <string.h>
+
+#include "assert.h"
+#include "../libdill.h"
+
+static void *first;
+
+coroutine void allocator(int n, size_t size) {
+    int i;
+    for(i = 0; i != n; ++i) {
+        uint8_t *p = cr_alloc(size);
+        errno_assert(p);
+        assert(((uintptr_t)p & 15) == 0);
+        memset(p, i, size);
+        if(i == 0) first = p;
+    }
+    /* Blocks don't overlap. */
+    assert(*(uint8_t*)first == 0);
+}
+
+coroutine void blocked(int ch) {
+    void *p = cr_alloc(100);
+    errno_assert(p);
+    int val;
+    int rc = chrecv(ch, &val, sizeof(val), -1);
+    assert(rc == -1 && errno == ECANCELED);
+}
+
+int main(void) {
+    /* Invalid arguments. */
+    void *p = cr_alloc(0);
+    assert(!p && errno == EINVAL);
+
+    /* Allocation from the main coroutine. */
+    p = cr_alloc(10);
+    errno_assert(p);
+    assert(((uintptr_t)p & 15) == 0);
+
+    /* Small blocks spanning several chunks. */
+    int h = go(allocator(1000, 24));
+    errno_assert(h >= 0);
+    int rc = hclose(h);
+    errno_assert(rc == 0);
+    void *prev = first;
+
+    /* Chunks of a finished coroutine are reused. */
+    h = go(allocator(1, 24));
+    errno_assert(h >= 0);
+    rc = hclose(h);
+    errno_assert(rc == 0);
+    assert(first == prev);
+
+    /* Big blocks. */
+    h = go(allocator(10, 100000));
+    errno_assert(h >= 0);
+    rc = hclose(h);
+    errno_assert(rc == 0);
+
+    /* Memory is released when a blocked coroutine is canceled. */
+    int ch[2];
+    rc = chmake(ch);
+    errno_assert(rc == 0);
+    h = go(blocked(ch[0]));
+    errno_assert(h >= 0);
+    rc = hclose(h);
+    errno_assert(rc == 0);
+    rc = hclose(ch[1]);
+    errno_assert(rc == 0);
+    rc = hclose(ch[0]);
+    errno_assert(rc == 0);
+
+    return 0;
+}
+
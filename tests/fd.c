@@ -39,6 +39,21 @@ coroutine void cancel(int fd) {
     assert(rc == -1 && errno == ECANCELED);
 }
 
+coroutine void waitone(int fd, int *count) {
+    int rc = fdin(fd, -1);
+    errno_assert(rc == 0);
+    char c;
+    ssize_t sz = read(fd, &c, 1);
+    errno_assert(sz == 1);
+    ++*count;
+}
+
+coroutine void waitall(int fd, int *count) {
+    int rc = fdin_all(fd, -1);
+    errno_assert(rc == 0);
+    ++*count;
+}
+
 coroutine void trigger(int fd, int64_t deadline) {
     int rc = msleep(deadline);
     errno_assert(rc == 0);
@@ -152,6 +167,61 @@ int main() {
     rc = close(pp[1]);
     assert(rc == 0);
 
+    /* Multiple coroutines waiting for the same fd. With wake-one waiters
+       each event resumes a single coroutine. */
+    rc = pipe(pp);
+    assert(rc == 0);
+    int count = 0;
+    int b = bundle();
+    errno_assert(b >= 0);
+    int i;
+    for(i = 0; i != 3; ++i) {
+        rc = bundle_go(b, waitone(pp[0], &count));
+        errno_assert(rc == 0);
+    }
+    rc = msleep(now() + 20);
+    errno_assert(rc == 0);
+    rc = fdclean(pp[0]);
+    assert(rc == -1 && errno == EBUSY);
+    nbytes = write(pp[1], "A", 1);
+    assert(nbytes == 1);
+    rc = msleep(now() + 20);
+    errno_assert(rc == 0);
+    assert(count == 1);
+    nbytes = write(pp[1], "BC", 2);
+    assert(nbytes == 2);
+    rc = bundle_wait(b, now() + 1000);
+    errno_assert(rc == 0);
+    assert(count == 3);
+    rc = hclose(b);
+    errno_assert(rc == 0);
+
+    /* Wake-all waiters are all resumed by a single event. */
+    count = 0;
+    b = bundle();
+    errno_assert(b >= 0);
+    for(i = 0; i != 3; ++i) {
+        rc = bundle_go(b, waitall(pp[0], &count));
+        errno_assert(rc == 0);
+    }
+    rc = msleep(now() + 20);
+    errno_assert(rc == 0);
+    nbytes = write(pp[1], "A", 1);
+    assert(nbytes == 1);
+    rc = bundle_wait(b, now() + 1000);
+    errno_assert(rc == 0);
+    assert(count == 3);
+    rc = hclose(b);
+    errno_assert(rc == 0);
+    rc = fdclean(pp[0]);
+    errno_assert(rc == 0);
+    rc = fdclean(pp[1]);
+    errno_assert(rc == 0);
+    rc = close(pp[0]);
+    assert(rc == 0);
+    rc = close(pp[1]);
+    assert(rc == 0);
+
     return 0;
 }
 
@@ -0,0 +1,130 @@
+/*
+
+  Copyright (c) 2018 Martin Sustrik
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"),
+  to deal in the Software without restriction, including without limitation
+  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+  and/or sell copies of the Software, and to permit persons to whom
+  the Software is furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included
+  in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+  IN THE SOFTWARE.
+
+*/
+
+
+#include "assert.h"
+#include "../libdill.h"
+
+coroutine void fulfiller(struct future *f, int val, int64_t deadline) {
+    int rc = msleep(deadline);
+    errno_assert(rc == 0);
+    rc = future_set(f, &val, sizeof(val));
+    errno_assert(rc == 0);
+}
+
+coroutine void failer(struct future *f, int err, int64_t deadline) {
+    int rc = msleep(deadline);
+    errno_assert(rc == 0);
+    rc = future_fail(f, err);
+    errno_assert(rc == 0);
+}
+
+int main(void) {
+    int val;
+    int i;
+
+    /* Invalid arguments. */
+    struct future f;
+    int rc = future_init(&f, NULL, sizeof(val));
+    assert(rc == -1 && errno == EINVAL);
+
+    /* Future fulfilled before waiting. */
+    rc = future_init(&f, &val, sizeof(val));
+    errno_assert(rc == 0);
+    rc = future_wait(&f, 0);
+    assert(rc == -1 && errno == ETIMEDOUT);
+    rc = future_wait(&f, now() + 10);
+    assert(rc == -1 && errno == ETIMEDOUT);
+    i = 11;
+    rc = future_set(&f, &i, sizeof(i));
+    errno_assert(rc == 0);
+    rc = future_set(&f, &i, sizeof(i));
+    assert(rc == -1 && errno == EALREADY);
+    rc = future_wait(&f, 0);
+    errno_assert(rc == 0);
+    assert(val == 11);
+
+    /* Future fulfilled by a coroutine. */
+    rc = future_init(&f, &val, sizeof(val));
+    errno_assert(rc == 0);
+    int b = bundle();
+    errno_assert(b >= 0);
+    rc = bundle_go(b, fulfiller(&f, 42, now() + 10));
+    errno_assert(rc == 0);
+    rc = future_wait(&f, -1);
+    errno_assert(rc == 0);
+    assert(val == 42);
+
+    /* Failure and size mismatch are reported to the waiter. */
+    rc = future_init(&f, &val, sizeof(val));
+    errno_assert(rc == 0);
+    rc = bundle_go(b, failer(&f, ECONNREFUSED, now() + 10));
+    errno_assert(rc == 0);
+    rc = future_wait(&f, -1);
+    assert(rc == -1 && errno == ECONNREFUSED);
+    rc = future_init(&f, &val, sizeof(val));
+    errno_assert(rc == 0);
+    char c = 0;
+    rc = future_set(&f, &c, sizeof(c));
+    assert(rc == -1 && errno == EMSGSIZE);
+    rc = future_wait(&f, 0);
+    assert(rc == -1 && errno == EMSGSIZE);
+
+    /* Waiting for any of multiple futures. */
+    struct future fs[10];
+    struct future *pfs[10];
+    int vals[10];
+    for(i = 0; i != 10; ++i) {
+        rc = future_init(&fs[i], &vals[i], sizeof(int));
+        errno_assert(rc == 0);
+        pfs[i] = &fs[i];
+    }
+    rc = future_waitany(pfs, 10, 0);
+    assert(rc == -1 && errno == ETIMEDOUT);
+    rc = bundle_go(b, fulfiller(&fs[7], 7, now() + 10));
+    errno_assert(rc == 0);
+    rc = future_waitany(pfs, 10, -1);
+    assert(rc == 7 && errno == 0);
+    assert(vals[7] == 7);
+
+    /* Waiting for all of multiple futures. */
+    for(i = 0; i != 10; ++i) {
+        if(i == 7) continue;
+        rc = bundle_go(b, fulfiller(&fs[i], i, now() + 10 - i));
+        errno_assert(rc == 0);
+    }
+    rc = future_waitall(pfs, 10, now() + 1000);
+    errno_assert(rc == 0);
+    for(i = 0; i != 10; ++i) {
+        rc = future_wait(pfs[i], 0);
+        errno_assert(rc == 0);
+        assert(vals[i] == i);
+    }
+    rc = bundle_wait(b, -1);
+    errno_assert(rc == 0);
+    rc = hclose(b);
+    errno_assert(rc == 0);
+
+    return 0;
+}
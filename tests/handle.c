@@ -26,6 +26,12 @@
 #include "../libdillimpl.h"
 
 static int status = 0;
+static int nqueries = 0;
+
+static const int type1_placeholder = 0;
+static const void *type1 = &type1_placeholder;
+static const int type2_placeholder = 0;
+static const void *type2 = &type2_placeholder;
 
 struct test {
     struct hvfs vfs;
@@ -33,6 +39,9 @@ struct test {
 
 static void *test_query(struct hvfs *vfs, const void *type) {
     status = 1;
+    ++nqueries;
+    if(type == type1) return &type1;
+    if(type == type2) return &type2;
     return &status;
 }
 
@@ -67,6 +76,48 @@ int main(void) {
     rc = hclose(ch[1]);
     errno_assert(rc == 0);
 
+    /* Queries for different types are cached independently. */
+    h = hmake(&t.vfs);
+    errno_assert(h >= 0);
+    nqueries = 0;
+    int i;
+    for(i = 0; i != 10; ++i) {
+        p = hquery(h, type1);
+        assert(p == &type1);
+        p = hquery(h, type2);
+        assert(p == &type2);
+    }
+    assert(nqueries == 2);
+    /* The cache survives the transfer of ownership. */
+    h = hown(h);
+    errno_assert(h >= 0);
+    p = hquery(h, type1);
+    assert(p == &type1);
+    assert(nqueries == 2);
+    rc = hclose(h);
+    errno_assert(rc == 0);
+
+    /* Lots of handles, spanning multiple chunks of the handle table. */
+    int hndls[2000];
+    for(i = 0; i != 2000; ++i) {
+        hndls[i] = hmake(&t.vfs);
+        errno_assert(hndls[i] >= 0);
+    }
+    for(i = 0; i != 2000; i += 2) {
+        rc = hclose(hndls[i]);
+        errno_assert(rc == 0);
+    }
+    for(i = 1; i < 2000; i += 2) {
+        p = hquery(hndls[i], type1);
+        assert(p == &type1);
+    }
+    p = hquery(hndls[0], type1);
+    assert(!p && errno == EBADF);
+    for(i = 1; i < 2000; i += 2) {
+        rc = hclose(hndls[i]);
+        errno_assert(rc == 0);
+    }
+
     return 0;
 }
 
@@ -0,0 +1,120 @@
+/*
+
+  Copyright (c) 2018 Martin Sustrik
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"),
+  to deal in the Software without restriction, including without limitation
+  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+  and/or sell copies of the Software, and to permit persons to whom
+  the Software is furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included
+  in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+  IN THE SOFTWARE.
+
+*/
+
+#include "assert.h"
+#include "../libdill.h"
+
+/* Serve a single connection, report the load and exit. */
+static void worker(int s, int id) {
+    int as = prefork_accept(s, NULL, -1);
+    errno_assert(as >= 0);
+    int rc = prefork_load(s, 1, -1);
+    errno_assert(rc == 0);
+    char c = (char)id;
+    rc = bsend(as, &c, 1, -1);
+    errno_assert(rc == 0);
+    /* Wait till the client closes the connection. */
+    rc = brecv(as, &c, 1, -1);
+    errno_assert(rc == -1 && (errno == EPIPE || errno == ECONNRESET));
+    rc = hclose(as);
+    errno_assert(rc == 0);
+    rc = hclose(s);
+    errno_assert(rc == 0);
+}
+
+static char request(struct ipaddr *addr) {
+    int s = tcp_connect(addr, -1);
+    errno_assert(s >= 0);
+    char c;
+    int rc = brecv(s, &c, 1, -1);
+    errno_assert(rc == 0);
+    rc = hclose(s);
+    errno_assert(rc == 0);
+    return c;
+}
+
+int main(void) {
+    struct ipaddr addr;
+    int rc = ipaddr_local(&addr, "127.0.0.1", 0, 0);
+    errno_assert(rc == 0);
+
+    /* Test invalid arguments. */
+    int id;
+    int s = prefork(&addr, 10, 0, PREFORK_HANDOFF, &id);
+    errno_assert(s == -1 && errno == EINVAL);
+    s = prefork(&addr, 10, 2, 7, &id);
+    errno_assert(s == -1 && errno == EINVAL);
+
+    /* Handoff mode. Supervisor hands the connections to the least loaded
+       worker. With equal load the connections are distributed
+       in round-robin fashion. */
+    s = prefork(&addr, 10, 2, PREFORK_HANDOFF, &id);
+    errno_assert(s >= 0);
+    if(id >= 0) {
+        worker(s, id);
+        return 0;
+    }
+    char c = request(&addr);
+    assert(c == 0);
+    c = request(&addr);
+    assert(c == 1);
+    rc = prefork_wait(s, now() + 1000);
+    errno_assert(rc == 0);
+    rc = hclose(s);
+    errno_assert(rc == 0);
+
+    /* Shared mode. Workers compete for connections on the shared
+       listening socket. */
+    rc = ipaddr_local(&addr, "127.0.0.1", 0, 0);
+    errno_assert(rc == 0);
+    s = prefork(&addr, 10, 2, PREFORK_SHARED, &id);
+    errno_assert(s >= 0);
+    if(id >= 0) {
+        worker(s, id);
+        return 0;
+    }
+    char c1 = request(&addr);
+    char c2 = request(&addr);
+    assert(c1 + c2 == 1);
+    rc = prefork_wait(s, now() + 1000);
+    errno_assert(rc == 0);
+    rc = hclose(s);
+    errno_assert(rc == 0);
+
+    /* Closing the supervisor terminates the workers. */
+    rc = ipaddr_local(&addr, "127.0.0.1", 0, 0);
+    errno_assert(rc == 0);
+    s = prefork(&addr, 10, 2, PREFORK_HANDOFF, &id);
+    errno_assert(s >= 0);
+    if(id >= 0) {
+        rc = msleep(-1);
+        return 0;
+    }
+    rc = prefork_wait(s, now() + 50);
+    errno_assert(rc == -1 && errno == ETIMEDOUT);
+    rc = hclose(s);
+    errno_assert(rc == 0);
+
+    return 0;
+}
@@ -0,0 +1,100 @@
+/*
+
+  Copyright (c) 2016 Martin Sustrik
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"),
+  to deal in the Software without restriction, including without limitation
+  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+  and/or sell copies of the Software, and to permit persons to whom
+  the Software is furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included
+  in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+  IN THE SOFTWARE.
+
+*/
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "assert.h"
+#include "../libdill.h"
+
+/* Burns CPU for the specified number of milliseconds. */
+coroutine void worker(int ms) {
+    clock_t deadline = clock() + (clock_t)ms * CLOCKS_PER_SEC / 1000;
+    volatile uint64_t n = 0;
+    while(clock() < deadline) ++n;
+}
+
+int main(void) {
+    /* Invalid arguments. */
+    int rc = prof_dump(1);
+    assert(rc == -1 && errno == EINVAL);
+    rc = prof_start(0);
+    assert(rc == -1 && errno == EINVAL);
+    /* Stopping a profiler that's not running is a no-op. */
+    rc = prof_stop();
+    errno_assert(rc == 0);
+
+    rc = prof_start(1000);
+    errno_assert(rc == 0);
+    int goline = __LINE__ + 1;
+    int h = go(worker(300));
+    errno_assert(h >= 0);
+    rc = hclose(h);
+    errno_assert(rc == 0);
+    rc = prof_stop();
+    errno_assert(rc == 0);
+
+    char path[] = "/tmp/libdill-prof-XXXXXX";
+    int fd = mkstemp(path);
+    errno_assert(fd >= 0);
+    rc = unlink(path);
+    errno_assert(rc == 0);
+    rc = prof_dump(fd);
+    errno_assert(rc == 0);
+    off_t sz = lseek(fd, 0, SEEK_END);
+    errno_assert(sz > 0);
+    char *buf = malloc(sz + 1);
+    assert(buf);
+    ssize_t nbytes = pread(fd, buf, sz, 0);
+    assert(nbytes == sz);
+    buf[sz] = 0;
+    rc = close(fd);
+    errno_assert(rc == 0);
+    /* The samples are attributed to the go() call site. */
+    char site[256];
+    snprintf(site, sizeof(site), "%s:%d ", __FILE__, goline);
+    char *line = strstr(buf, site);
+    assert(line);
+    assert(atoi(line + strlen(site)) > 0);
+    assert(buf[sz - 1] == '\n');
+    free(buf);
+
+    /* The profiler can be restarted. */
+    rc = prof_start(100);
+    errno_assert(rc == 0);
+    rc = prof_stop();
+    errno_assert(rc == 0);
+    fd = open("/dev/null", O_WRONLY);
+    errno_assert(fd >= 0);
+    rc = prof_dump(fd);
+    errno_assert(rc == 0);
+    rc = close(fd);
+    errno_assert(rc == 0);
+    return 0;
+}
+
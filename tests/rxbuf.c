@@ -0,0 +1,127 @@
+/*
+
+  Copyright (c) 2016 Martin Sustrik
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"),
+  to deal in the Software without restriction, including without limitation
+  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+  and/or sell copies of the Software, and to permit persons to whom
+  the Software is furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included
+  in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+  IN THE SOFTWARE.
+
+*/
+#include <string.h>
+
+#include "assert.h"
+#include "../libdill.h"
+
+#define DATASIZE 32000
+
+coroutine void sender(int port) {
+    struct ipaddr addr;
+    int rc = ipaddr_local(&addr, NULL, port, 0);
+    errno_assert(rc == 0);
+    int s = tcp_connect(&addr, -1);
+    errno_assert(s >= 0);
+    static char buf[DATASIZE];
+    memset(buf, 'A', sizeof(buf));
+    rc = bsend(s, buf, sizeof(buf), -1);
+    errno_assert(rc == 0);
+    char c;
+    rc = brecv(s, &c, 1, -1);
+    errno_assert(rc == 0);
+    rc = hclose(s);
+    errno_assert(rc == 0);
+}
+
+/* Receives the data sent by the sender in chunks of the specified size and
+   returns the resulting socket statistics. */
+static void receive(int ls, int port, size_t rxbuf, size_t chunk,
+      struct sock_stats *st) {
+    int cr = go(sender(port));
+    errno_assert(cr >= 0);
+    int s = tcp_accept(ls, NULL, -1);
+    errno_assert(s >= 0);
+    int rc = tcp_rxbuf(s, rxbuf);
+    errno_assert(rc == 0);
+    /* Let all the data arrive. */
+    rc = msleep(now() + 50);
+    errno_assert(rc == 0);
+    char buf[DATASIZE];
+    size_t received = 0;
+    while(received < DATASIZE) {
+        size_t len = DATASIZE - received < chunk ?
+            DATASIZE - received : chunk;
+        rc = brecv(s, buf, len, -1);
+        errno_assert(rc == 0);
+        received += len;
+    }
+    rc = sock_stats(s, st);
+    errno_assert(rc == 0);
+    assert(st->bytes_in == DATASIZE);
+    rc = bsend(s, "A", 1, -1);
+    errno_assert(rc == 0);
+    rc = bundle_wait(cr, -1);
+    errno_assert(rc == 0);
+    rc = hclose(cr);
+    errno_assert(rc == 0);
+    rc = hclose(s);
+    errno_assert(rc == 0);
+}
+
+int main(void) {
+    struct ipaddr addr;
+    int rc = ipaddr_local(&addr, NULL, 0, 0);
+    errno_assert(rc == 0);
+    int ls = tcp_listen(&addr, 10);
+    errno_assert(ls >= 0);
+    int port = ipaddr_port(&addr);
+
+    /* Buffer of fixed size needs a syscall per buffer-full of data. */
+    struct sock_stats fixed;
+    receive(ls, port, 1984, 100, &fixed);
+    assert(fixed.syscalls >= DATASIZE / 1984);
+    assert(fixed.direct_reads == 0);
+
+    /* Adaptive buffer grows when it keeps being filled up. */
+    struct sock_stats adaptive;
+    receive(ls, port, 0, 100, &adaptive);
+    assert(adaptive.syscalls < fixed.syscalls);
+    assert(adaptive.direct_reads == 0);
+
+    /* Reads larger than a fixed buffer bypass it. */
+    receive(ls, port, 1984, 3000, &fixed);
+    assert(fixed.direct_reads == (DATASIZE + 2999) / 3000);
+    assert(fixed.rxbuf_hits == 0);
+
+    /* Adaptive buffer grows to accommodate them after a few reads. */
+    receive(ls, port, 0, 3000, &adaptive);
+    assert(adaptive.direct_reads < fixed.direct_reads);
+    assert(adaptive.rxbuf_hits > 0);
+
+    /* Invalid arguments. */
+    rc = tcp_rxbuf(ls, 0);
+    assert(rc == -1 && errno == ENOTSUP);
+    int s = tcp_connect(&addr, -1);
+    errno_assert(s >= 0);
+    rc = tcp_rxbuf(s, 1000000);
+    assert(rc == -1 && errno == EINVAL);
+    rc = hclose(s);
+    errno_assert(rc == 0);
+
+    rc = hclose(ls);
+    errno_assert(rc == 0);
+    return 0;
+}
+
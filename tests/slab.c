@@ -0,0 +1,109 @@
+/*
+
+  Copyright (c) 2018 Martin Sustrik
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"),
+  to deal in the Software without restriction, including without limitation
+  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+  and/or sell copies of the Software, and to permit persons to whom
+  the Software is furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included
+  in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+  IN THE SOFTWARE.
+
+*/
+
+
+#include "assert.h"
+#include "../libdill.h"
+
+static struct slab_stats *find_class(struct slab_stats *stats, int n,
+      size_t size) {
+    int i;
+    for(i = 0; i != n; ++i)
+        if(stats[i].size >= size) return &stats[i];
+    assert(0);
+    return NULL;
+}
+
+int main(void) {
+    struct slab_stats stats[16];
+
+    /* Invalid arguments. */
+    int rc = slab_setcap(-1);
+    assert(rc == -1 && errno == EINVAL);
+    rc = slab_stats(NULL, 1);
+    assert(rc == -1 && errno == EINVAL);
+    int n = slab_stats(stats, 16);
+    assert(n > 0 && n <= 16);
+    int i;
+    for(i = 1; i < n; ++i) assert(stats[i].size > stats[i - 1].size);
+
+    /* Storage of closed objects gets reused. */
+    int ch[2];
+    rc = chmake(ch);
+    errno_assert(rc == 0);
+    rc = hclose(ch[0]);
+    errno_assert(rc == 0);
+    rc = hclose(ch[1]);
+    errno_assert(rc == 0);
+    n = slab_stats(stats, 16);
+    struct slab_stats before = *find_class(stats, n,
+        sizeof(struct chstorage));
+    assert(before.cached > 0);
+    for(i = 0; i != 100; ++i) {
+        rc = chmake(ch);
+        errno_assert(rc == 0);
+        rc = hclose(ch[0]);
+        errno_assert(rc == 0);
+        rc = hclose(ch[1]);
+        errno_assert(rc == 0);
+    }
+    n = slab_stats(stats, 16);
+    struct slab_stats *after = find_class(stats, n, sizeof(struct chstorage));
+    assert(after->allocs == before.allocs + 100);
+    assert(after->hits == before.hits + 100);
+    assert(after->frees == before.frees + 100);
+    assert(after->cached == before.cached);
+
+    /* The number of cached objects is capped. */
+    int bs[10];
+    for(i = 0; i != 10; ++i) {
+        bs[i] = bundle();
+        errno_assert(bs[i] >= 0);
+    }
+    rc = slab_setcap(4);
+    errno_assert(rc == 0);
+    for(i = 0; i != 10; ++i) {
+        rc = hclose(bs[i]);
+        errno_assert(rc == 0);
+    }
+    n = slab_stats(stats, 16);
+    for(i = 0; i != n; ++i) {
+        assert(stats[i].cap == 4);
+        assert(stats[i].cached <= 4);
+    }
+
+    /* Zero cap disables the caching. */
+    rc = slab_setcap(0);
+    errno_assert(rc == 0);
+    rc = chmake(ch);
+    errno_assert(rc == 0);
+    rc = hclose(ch[0]);
+    errno_assert(rc == 0);
+    rc = hclose(ch[1]);
+    errno_assert(rc == 0);
+    n = slab_stats(stats, 16);
+    for(i = 0; i != n; ++i) assert(stats[i].cached == 0);
+
+    return 0;
+}
@@ -0,0 +1,197 @@
+/*
+
+  Copyright (c) 2016 Martin Sustrik
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"),
+  to deal in the Software without restriction, including without limitation
+  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+  and/or sell copies of the Software, and to permit persons to whom
+  the Software is furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included
+  in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+  IN THE SOFTWARE.
+
+*/
+
+#include <string.h>
+
+#include "assert.h"
+#include "../libdill.h"
+
+coroutine void tcp_client(int port) {
+    struct ipaddr addr;
+    int rc = ipaddr_local(&addr, NULL, port, 0);
+    errno_assert(rc == 0);
+    int s = tcp_connect(&addr, -1);
+    errno_assert(s >= 0);
+    /* Let the peer block waiting for the data. */
+    rc = msleep(now() + 50);
+    errno_assert(rc == 0);
+    char buf[100];
+    memset(buf, 'A', sizeof(buf));
+    rc = bsend(s, buf, sizeof(buf), -1);
+    errno_assert(rc == 0);
+    struct sock_stats st;
+    rc = sock_stats(s, &st);
+    errno_assert(rc == 0);
+    assert(st.bytes_out == 100);
+    assert(st.msgs_out == 1);
+    assert(st.wire_bytes_out == 100);
+    assert(st.syscalls == 1);
+    assert(st.bytes_in == 0);
+    rc = brecv(s, buf, 1, -1);
+    errno_assert(rc == 0);
+    rc = hclose(s);
+    errno_assert(rc == 0);
+}
+
+coroutine void ws_client(int s) {
+    s = ws_attach_client(s, WS_NOHTTP | WS_BINARY, NULL, NULL, -1);
+    errno_assert(s >= 0);
+    int rc = msend(s, "ABCDEFGHIJ", 10, -1);
+    errno_assert(rc == 0);
+    struct sock_stats st;
+    rc = sock_stats(s, &st);
+    errno_assert(rc == 0);
+    assert(st.bytes_out == 10);
+    assert(st.msgs_out == 1);
+    /* Header plus masked payload. The client sends the payload byte by
+       byte. */
+    assert(st.wire_bytes_out == 16);
+    assert(st.syscalls == 11);
+    rc = hclose(s);
+    errno_assert(rc == 0);
+}
+
+int main(void) {
+    struct sock_stats st;
+    /* Invalid arguments. */
+    int rc = sock_stats(-1, &st);
+    assert(rc == -1 && errno == EBADF);
+    int b = bundle();
+    errno_assert(b >= 0);
+    rc = sock_stats(b, &st);
+    assert(rc == -1 && errno == ENOTSUP);
+    rc = hclose(b);
+    errno_assert(rc == 0);
+
+    /* TCP. */
+    struct ipaddr addr;
+    rc = ipaddr_local(&addr, NULL, 0, 0);
+    errno_assert(rc == 0);
+    int ls = tcp_listen(&addr, 10);
+    errno_assert(ls >= 0);
+    rc = sock_stats(ls, &st);
+    assert(rc == -1 && errno == ENOTSUP);
+    int cr = go(tcp_client(ipaddr_port(&addr)));
+    errno_assert(cr >= 0);
+    int s = tcp_accept(ls, NULL, -1);
+    errno_assert(s >= 0);
+    /* Small reads are served from the rx buffer. */
+    char buf[10];
+    int i;
+    for(i = 0; i != 10; ++i) {
+        rc = brecv(s, buf, sizeof(buf), -1);
+        errno_assert(rc == 0);
+    }
+    rc = sock_stats(s, &st);
+    errno_assert(rc == 0);
+    assert(st.bytes_in == 100);
+    assert(st.msgs_in == 10);
+    assert(st.wire_bytes_in == 100);
+    assert(st.rxbuf_hits == 9);
+    assert(st.direct_reads == 0);
+    assert(st.eagains == 1);
+    assert(st.syscalls == 2);
+    assert(st.blocked_ns >= 10000000);
+#if defined __linux__
+    assert(st.tcpinfo);
+    assert(st.cwnd > 0);
+#endif
+    /* Large reads go directly into the user's buffer. */
+    char large[4096];
+    memset(large, 0, sizeof(large));
+    rc = bsend(s, large, 1, -1);
+    errno_assert(rc == 0);
+    rc = bundle_wait(cr, -1);
+    errno_assert(rc == 0);
+    rc = hclose(cr);
+    errno_assert(rc == 0);
+    /* The peer is gone, so the read fails. */
+    rc = brecv(s, large, sizeof(large), -1);
+    assert(rc == -1);
+    rc = sock_stats(s, &st);
+    errno_assert(rc == 0);
+    assert(st.direct_reads == 1);
+    assert(st.bytes_out == 1);
+    rc = hclose(s);
+    errno_assert(rc == 0);
+    rc = hclose(ls);
+    errno_assert(rc == 0);
+
+    /* Layered protocols report file descriptor activity of the bottom-most
+       socket. */
+    int p[2];
+    rc = ipc_pair(p);
+    errno_assert(rc == 0);
+    cr = go(ws_client(p[1]));
+    errno_assert(cr >= 0);
+    s = ws_attach_server(p[0], WS_NOHTTP | WS_BINARY, NULL, 0, NULL, 0, -1);
+    errno_assert(s >= 0);
+    ssize_t sz = mrecv(s, buf, sizeof(buf), -1);
+    errno_assert(sz == 10);
+    rc = sock_stats(s, &st);
+    errno_assert(rc == 0);
+    assert(st.bytes_in == 10);
+    assert(st.msgs_in == 1);
+    assert(st.wire_bytes_in == 16);
+    assert(st.tcpinfo == 0);
+    rc = bundle_wait(cr, -1);
+    errno_assert(rc == 0);
+    rc = hclose(cr);
+    errno_assert(rc == 0);
+    rc = hclose(s);
+    errno_assert(rc == 0);
+
+    /* UDP. */
+    struct ipaddr addr1;
+    rc = ipaddr_local(&addr1, NULL, 0, 0);
+    errno_assert(rc == 0);
+    int s1 = udp_open(&addr1, NULL);
+    errno_assert(s1 >= 0);
+    struct ipaddr addr2;
+    rc = ipaddr_local(&addr2, "127.0.0.1", ipaddr_port(&addr1), 0);
+    errno_assert(rc == 0);
+    int s2 = udp_open(NULL, &addr2);
+    errno_assert(s2 >= 0);
+    rc = msend(s2, "ABC", 3, -1);
+    errno_assert(rc == 0);
+    sz = mrecv(s1, buf, sizeof(buf), -1);
+    errno_assert(sz == 3);
+    rc = sock_stats(s2, &st);
+    errno_assert(rc == 0);
+    assert(st.msgs_out == 1);
+    assert(st.bytes_out == 3);
+    assert(st.syscalls == 1);
+    rc = sock_stats(s1, &st);
+    errno_assert(rc == 0);
+    assert(st.msgs_in == 1);
+    assert(st.bytes_in == 3);
+    assert(st.tcpinfo == 0);
+    rc = hclose(s2);
+    errno_assert(rc == 0);
+    rc = hclose(s1);
+    errno_assert(rc == 0);
+
+    return 0;
+}
+
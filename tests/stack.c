@@ -0,0 +1,96 @@
+/*
+
+  Copyright (c) 2016 Martin Sustrik
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"),
+  to deal in the Software without restriction, including without limitation
+  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+  and/or sell copies of the Software, and to permit persons to whom
+  the Software is furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included
+  in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+  IN THE SOFTWARE.
+
+*/
+
+#include <string.h>
+
+#include "assert.h"
+#include "../libdill.h"
+
+coroutine void shallow(void) {
+}
+
+/* Touches about 'n' kB of the stack. */
+coroutine void deep(int n) {
+    volatile char buf[1024];
+    memset((char*)buf, 0, sizeof(buf));
+    if(n > 1) deep(n - 1);
+}
+
+int main(void) {
+    /* Invalid arguments. */
+    int rc = stack_sample(-1);
+    assert(rc == -1 && errno == EINVAL);
+    rc = stack_stats(NULL, 1);
+    assert(rc == -1 && errno == EINVAL);
+
+    rc = stack_sample(1);
+    if(rc < 0 && errno == ENOTSUP) return 0;
+    errno_assert(rc == 0);
+    int shallowline = __LINE__ + 3;
+    int i;
+    for(i = 0; i != 10; ++i) {
+        int h = go(shallow());
+        errno_assert(h >= 0);
+        rc = hclose(h);
+        errno_assert(rc == 0);
+    }
+    int deepline = __LINE__ + 2;
+    for(i = 0; i != 10; ++i) {
+        int h = go(deep(64));
+        errno_assert(h >= 0);
+        rc = hclose(h);
+        errno_assert(rc == 0);
+    }
+    struct stack_stats stats[4];
+    rc = stack_stats(stats, 4);
+    errno_assert(rc == 2);
+    struct stack_stats *s = NULL;
+    struct stack_stats *d = NULL;
+    for(i = 0; i != rc; ++i) {
+        assert(strcmp(stats[i].file, __FILE__) == 0);
+        if(stats[i].line == shallowline) s = &stats[i];
+        if(stats[i].line == deepline) d = &stats[i];
+    }
+    assert(s && d);
+    assert(s->samples == 10);
+    assert(d->samples == 10);
+    assert(s->max < 16 * 1024);
+    assert(d->max >= 64 * 1024);
+    assert(d->p50 <= d->p90 && d->p90 <= d->p99 && d->p99 <= d->max);
+    assert(d->p50 > s->max);
+
+    /* Sampling can be switched off. */
+    rc = stack_sample(0);
+    errno_assert(rc == 0);
+    int h = go(shallow());
+    errno_assert(h >= 0);
+    rc = hclose(h);
+    errno_assert(rc == 0);
+    rc = stack_stats(stats, 4);
+    errno_assert(rc == 2);
+    for(i = 0; i != rc; ++i)
+        assert(stats[i].samples == 10);
+    return 0;
+}
+
@@ -0,0 +1,127 @@
+/*
+
+  Copyright (c) 2018 Martin Sustrik
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"),
+  to deal in the Software without restriction, including without limitation
+  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+  and/or sell copies of the Software, and to permit persons to whom
+  the Software is furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included
+  in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+  IN THE SOFTWARE.
+
+*/
+
+#include <string.h>
+
+#include "assert.h"
+#include "../libdill.h"
+
+coroutine void sleeper(void) {
+    int rc = msleep(-1);
+    assert(rc == -1 && errno == ECANCELED);
+}
+
+coroutine void sender(int ch) {
+    int rc = yield();
+    errno_assert(rc == 0);
+    int val = 42;
+    rc = chsend(ch, &val, sizeof(val), -1);
+    errno_assert(rc == 0);
+}
+
+int main(void) {
+    /* Invalid arguments. */
+    int rc = stats(NULL);
+    assert(rc == -1 && errno == EINVAL);
+
+    struct stats s1;
+    rc = stats(&s1);
+    errno_assert(rc == 0);
+    assert(s1.coroutines == 0);
+    assert(s1.ready == 0);
+
+    int h = go(sleeper());
+    errno_assert(h >= 0);
+    /* Timer that fires. */
+    rc = msleep(now() + 10);
+    errno_assert(rc == 0);
+    /* Timer that is canceled. */
+    int ch[2];
+    rc = chmake(ch);
+    errno_assert(rc == 0);
+    int h2 = go(sender(ch[1]));
+    errno_assert(h2 >= 0);
+    int val;
+    rc = chrecv(ch[0], &val, sizeof(val), now() + 1000);
+    errno_assert(rc == 0);
+
+    /* Bytes transferred over sockets. */
+    int s[2];
+    rc = ipc_pair(s);
+    errno_assert(rc == 0);
+    rc = bsend(s[0], "ABCDEFGHIJ", 10, -1);
+    errno_assert(rc == 0);
+    char buf[10];
+    rc = brecv(s[1], buf, sizeof(buf), -1);
+    errno_assert(rc == 0);
+
+    struct stats s2;
+    rc = stats(&s2);
+    errno_assert(rc == 0);
+    assert(s2.coroutines == 1);
+    assert(s2.switches_total > s1.switches_total);
+    assert(s2.polls_total > s1.polls_total);
+    assert(s2.poll_ns_total >= 5000000);
+    assert(s2.timers_armed_total == s1.timers_armed_total + 2);
+    assert(s2.timers_fired_total == s1.timers_fired_total + 1);
+    assert(s2.timers_canceled_total == s1.timers_canceled_total + 1);
+    assert(s2.handles >= 6);
+    assert(s2.bytes_sent_total[STATS_IPC] == 10);
+    assert(s2.bytes_received_total[STATS_IPC] == 10);
+    assert(s2.bytes_sent_total[STATS_TCP] == 0);
+
+    rc = hclose(s[1]);
+    errno_assert(rc == 0);
+    rc = hclose(s[0]);
+    errno_assert(rc == 0);
+    rc = hclose(ch[1]);
+    errno_assert(rc == 0);
+    rc = hclose(ch[0]);
+    errno_assert(rc == 0);
+    rc = hclose(h2);
+    errno_assert(rc == 0);
+    rc = hclose(h);
+    errno_assert(rc == 0);
+    rc = stats(&s1);
+    errno_assert(rc == 0);
+    assert(s1.coroutines == 0);
+    assert(s1.rxbufs == 0);
+    assert(s1.handles == s2.handles - 6);
+
+    /* Prometheus format. */
+    char text[4096];
+    ssize_t sz = stats_prometheus(&s2, text, sizeof(text));
+    errno_assert(sz > 0);
+    assert(strlen(text) == sz);
+    assert(strstr(text, "# TYPE libdill_coroutines gauge\n"
+        "libdill_coroutines 1\n"));
+    assert(strstr(text, "libdill_timers_fired_total "));
+    assert(strstr(text, "libdill_sent_bytes_total{type=\"ipc\"} 10\n"));
+    assert(text[sz - 1] == '\n');
+    sz = stats_prometheus(&s2, text, 100);
+    assert(sz == -1 && errno == ENOBUFS);
+
+    return 0;
+}
+
@@ -0,0 +1,310 @@
+/*
+
+  Copyright (c) 2018 Martin Sustrik
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"),
+  to deal in the Software without restriction, including without limitation
+  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+  and/or sell copies of the Software, and to permit persons to whom
+  the Software is furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included
+  in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+  IN THE SOFTWARE.
+
+*/
+
+
+#include "assert.h"
+#include "../libdill.h"
+
+static int order[16];
+static int norder = 0;
+
+coroutine void locker(int mtx, int id) {
+    int rc = mutex_lock(mtx, -1);
+    errno_assert(rc == 0);
+    order[norder++] = id;
+    rc = msleep(now() + 5);
+    errno_assert(rc == 0);
+    rc = mutex_unlock(mtx);
+    errno_assert(rc == 0);
+}
+
+coroutine void acquirer(int s, int id) {
+    int rc = sem_acquire(s, -1);
+    errno_assert(rc == 0);
+    order[norder++] = id;
+}
+
+coroutine void cond_waiter(int cv, int mtx, int *flag, int id) {
+    int rc = mutex_lock(mtx, -1);
+    errno_assert(rc == 0);
+    while(!*flag) {
+        rc = cond_wait(cv, mtx, -1);
+        errno_assert(rc == 0);
+    }
+    order[norder++] = id;
+    rc = mutex_unlock(mtx);
+    errno_assert(rc == 0);
+}
+
+coroutine void reader(int rw, int id) {
+    int rc = rwlock_rdlock(rw, -1);
+    errno_assert(rc == 0);
+    order[norder++] = id;
+    rc = msleep(now() + 10);
+    errno_assert(rc == 0);
+    rc = rwlock_unlock(rw);
+    errno_assert(rc == 0);
+}
+
+coroutine void writer(int rw, int id) {
+    int rc = rwlock_wrlock(rw, -1);
+    errno_assert(rc == 0);
+    order[norder++] = id;
+    rc = msleep(now() + 10);
+    errno_assert(rc == 0);
+    rc = rwlock_unlock(rw);
+    errno_assert(rc == 0);
+}
+
+coroutine void timed_writer(int rw, int64_t deadline) {
+    int rc = rwlock_wrlock(rw, deadline);
+    assert(rc == -1 && errno == ETIMEDOUT);
+}
+
+coroutine void worker(int wg, int id) {
+    int rc = msleep(now() + 5 * id);
+    errno_assert(rc == 0);
+    order[norder++] = id;
+    rc = waitgroup_done(wg);
+    errno_assert(rc == 0);
+}
+
+coroutine void closed_waiter(int mtx) {
+    int rc = mutex_lock(mtx, -1);
+    assert(rc == -1 && errno == EBADF);
+}
+
+int main(void) {
+    int i;
+
+    /* Mutex: basic locking and timeouts. */
+    struct mutex_storage mstor;
+    int mtx = mutex_mem(&mstor);
+    errno_assert(mtx >= 0);
+    int rc = mutex_unlock(mtx);
+    assert(rc == -1 && errno == EPERM);
+    rc = mutex_lock(mtx, 0);
+    errno_assert(rc == 0);
+    rc = mutex_lock(mtx, 0);
+    assert(rc == -1 && errno == ETIMEDOUT);
+    rc = mutex_lock(mtx, now() + 10);
+    assert(rc == -1 && errno == ETIMEDOUT);
+    rc = mutex_unlock(mtx);
+    errno_assert(rc == 0);
+
+    /* Mutex: waiters get the lock in FIFO order. */
+    rc = mutex_lock(mtx, -1);
+    errno_assert(rc == 0);
+    int b = bundle();
+    errno_assert(b >= 0);
+    for(i = 0; i != 4; ++i) {
+        rc = bundle_go(b, locker(mtx, i));
+        errno_assert(rc == 0);
+    }
+    rc = msleep(now() + 10);
+    errno_assert(rc == 0);
+    rc = mutex_unlock(mtx);
+    errno_assert(rc == 0);
+    /* The mutex was handed off to the first waiter. */
+    rc = mutex_lock(mtx, 0);
+    assert(rc == -1 && errno == ETIMEDOUT);
+    rc = bundle_wait(b, -1);
+    errno_assert(rc == 0);
+    assert(norder == 4);
+    for(i = 0; i != 4; ++i) assert(order[i] == i);
+    norder = 0;
+
+    /* Mutex: closing with waiters. */
+    rc = mutex_lock(mtx, -1);
+    errno_assert(rc == 0);
+    rc = bundle_go(b, closed_waiter(mtx));
+    errno_assert(rc == 0);
+    rc = msleep(now() + 10);
+    errno_assert(rc == 0);
+    rc = hclose(mtx);
+    errno_assert(rc == 0);
+    rc = bundle_wait(b, -1);
+    errno_assert(rc == 0);
+
+    /* Semaphore. */
+    int s = sem(-1);
+    assert(s == -1 && errno == EINVAL);
+    s = sem(2);
+    errno_assert(s >= 0);
+    rc = sem_acquire(s, 0);
+    errno_assert(rc == 0);
+    rc = sem_acquire(s, 0);
+    errno_assert(rc == 0);
+    rc = sem_acquire(s, 0);
+    assert(rc == -1 && errno == ETIMEDOUT);
+    for(i = 0; i != 3; ++i) {
+        rc = bundle_go(b, acquirer(s, i));
+        errno_assert(rc == 0);
+    }
+    rc = msleep(now() + 10);
+    errno_assert(rc == 0);
+    for(i = 0; i != 3; ++i) {
+        rc = sem_release(s);
+        errno_assert(rc == 0);
+    }
+    /* The released units were handed off to the waiters. */
+    rc = sem_acquire(s, 0);
+    assert(rc == -1 && errno == ETIMEDOUT);
+    rc = bundle_wait(b, -1);
+    errno_assert(rc == 0);
+    assert(norder == 3);
+    for(i = 0; i != 3; ++i) assert(order[i] == i);
+    norder = 0;
+    rc = hclose(s);
+    errno_assert(rc == 0);
+
+    /* Condition variable. */
+    mtx = mutex();
+    errno_assert(mtx >= 0);
+    int cv = cond();
+    errno_assert(cv >= 0);
+    rc = cond_wait(cv, mtx, -1);
+    assert(rc == -1 && errno == EPERM);
+    rc = mutex_lock(mtx, -1);
+    errno_assert(rc == 0);
+    rc = cond_wait(cv, mtx, now() + 10);
+    assert(rc == -1 && errno == ETIMEDOUT);
+    /* The mutex is re-acquired even if the wait times out. */
+    rc = mutex_lock(mtx, 0);
+    assert(rc == -1 && errno == ETIMEDOUT);
+    rc = mutex_unlock(mtx);
+    errno_assert(rc == 0);
+    int flag = 0;
+    for(i = 0; i != 3; ++i) {
+        rc = bundle_go(b, cond_waiter(cv, mtx, &flag, i));
+        errno_assert(rc == 0);
+    }
+    rc = msleep(now() + 10);
+    errno_assert(rc == 0);
+    rc = cond_signal(cv);
+    errno_assert(rc == 0);
+    rc = msleep(now() + 10);
+    errno_assert(rc == 0);
+    assert(norder == 0);
+    flag = 1;
+    rc = cond_broadcast(cv);
+    errno_assert(rc == 0);
+    rc = bundle_wait(b, -1);
+    errno_assert(rc == 0);
+    assert(norder == 3);
+    norder = 0;
+    rc = hclose(cv);
+    errno_assert(rc == 0);
+    rc = hclose(mtx);
+    errno_assert(rc == 0);
+
+    /* Read-write lock. */
+    struct rwlock_storage rwstor;
+    int rw = rwlock_mem(&rwstor);
+    errno_assert(rw >= 0);
+    rc = rwlock_unlock(rw);
+    assert(rc == -1 && errno == EPERM);
+    rc = rwlock_rdlock(rw, 0);
+    errno_assert(rc == 0);
+    rc = rwlock_rdlock(rw, 0);
+    errno_assert(rc == 0);
+    rc = rwlock_wrlock(rw, 0);
+    assert(rc == -1 && errno == ETIMEDOUT);
+    rc = rwlock_unlock(rw);
+    errno_assert(rc == 0);
+    rc = rwlock_unlock(rw);
+    errno_assert(rc == 0);
+    rc = rwlock_wrlock(rw, 0);
+    errno_assert(rc == 0);
+    rc = rwlock_rdlock(rw, 0);
+    assert(rc == -1 && errno == ETIMEDOUT);
+    /* Waiters are served in FIFO order. Consecutive readers share the lock,
+       a waiting writer blocks the readers behind it. */
+    rc = bundle_go(b, reader(rw, 0));
+    errno_assert(rc == 0);
+    rc = bundle_go(b, reader(rw, 1));
+    errno_assert(rc == 0);
+    rc = bundle_go(b, writer(rw, 2));
+    errno_assert(rc == 0);
+    rc = bundle_go(b, reader(rw, 3));
+    errno_assert(rc == 0);
+    rc = msleep(now() + 5);
+    errno_assert(rc == 0);
+    rc = rwlock_unlock(rw);
+    errno_assert(rc == 0);
+    rc = msleep(now() + 5);
+    errno_assert(rc == 0);
+    assert(norder == 2);
+    rc = bundle_wait(b, -1);
+    errno_assert(rc == 0);
+    assert(norder == 4);
+    for(i = 0; i != 4; ++i) assert(order[i] == i);
+    norder = 0;
+    /* Writer that times out unblocks the readers queued behind it. */
+    rc = rwlock_rdlock(rw, 0);
+    errno_assert(rc == 0);
+    rc = bundle_go(b, timed_writer(rw, now() + 10));
+    errno_assert(rc == 0);
+    rc = bundle_go(b, reader(rw, 1));
+    errno_assert(rc == 0);
+    assert(norder == 0);
+    rc = msleep(now() + 20);
+    errno_assert(rc == 0);
+    assert(norder == 1);
+    rc = rwlock_unlock(rw);
+    errno_assert(rc == 0);
+    rc = bundle_wait(b, -1);
+    errno_assert(rc == 0);
+    norder = 0;
+    rc = hclose(rw);
+    errno_assert(rc == 0);
+
+    /* Wait group. */
+    int wg = waitgroup();
+    errno_assert(wg >= 0);
+    rc = waitgroup_wait(wg, 0);
+    errno_assert(rc == 0);
+    rc = waitgroup_done(wg);
+    assert(rc == -1 && errno == EINVAL);
+    rc = waitgroup_add(wg, 3);
+    errno_assert(rc == 0);
+    for(i = 0; i != 3; ++i) {
+        rc = bundle_go(b, worker(wg, i + 1));
+        errno_assert(rc == 0);
+    }
+    rc = waitgroup_wait(wg, 0);
+    assert(rc == -1 && errno == ETIMEDOUT);
+    rc = waitgroup_wait(wg, -1);
+    errno_assert(rc == 0);
+    assert(norder == 3);
+    norder = 0;
+    rc = bundle_wait(b, -1);
+    errno_assert(rc == 0);
+    rc = hclose(wg);
+    errno_assert(rc == 0);
+
+    rc = hclose(b);
+    errno_assert(rc == 0);
+    return 0;
+}
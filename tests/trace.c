@@ -0,0 +1,118 @@
+/*
+
+  Copyright (c) 2018 Martin Sustrik
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"),
+  to deal in the Software without restriction, including without limitation
+  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+  and/or sell copies of the Software, and to permit persons to whom
+  the Software is furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included
+  in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+  IN THE SOFTWARE.
+
+*/
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "assert.h"
+#include "../libdill.h"
+
+coroutine void sender(int ch) {
+    int rc = msleep(now() + 10);
+    errno_assert(rc == 0);
+    int val = 42;
+    rc = chsend(ch, &val, sizeof(val), -1);
+    errno_assert(rc == 0);
+}
+
+int main(void) {
+    /* Invalid arguments. */
+    int rc = trace_dump(1);
+    assert(rc == -1 && errno == EINVAL);
+    rc = trace_start(0);
+    assert(rc == -1 && errno == EINVAL);
+
+    rc = trace_start(1000);
+    errno_assert(rc == 0);
+    int ch[2];
+    rc = chmake(ch);
+    errno_assert(rc == 0);
+    int h = go(sender(ch[0]));
+    errno_assert(h >= 0);
+    int val;
+    rc = chrecv(ch[1], &val, sizeof(val), -1);
+    errno_assert(rc == 0);
+    rc = hclose(h);
+    errno_assert(rc == 0);
+    rc = trace_stop();
+    errno_assert(rc == 0);
+
+    /* Events are not recorded while tracing is stopped. */
+    rc = yield();
+    errno_assert(rc == 0);
+
+    char path[] = "/tmp/libdill-trace-XXXXXX";
+    int fd = mkstemp(path);
+    errno_assert(fd >= 0);
+    rc = unlink(path);
+    errno_assert(rc == 0);
+    rc = trace_dump(fd);
+    errno_assert(rc == 0);
+    off_t sz = lseek(fd, 0, SEEK_END);
+    errno_assert(sz > 0);
+    char *buf = malloc(sz + 1);
+    assert(buf);
+    ssize_t nbytes = pread(fd, buf, sz, 0);
+    assert(nbytes == sz);
+    buf[sz] = 0;
+    rc = close(fd);
+    errno_assert(rc == 0);
+    assert(strncmp(buf, "{\"traceEvents\":[", 16) == 0);
+    assert(strcmp(buf + sz - 4, "\n]}\n") == 0);
+    assert(strstr(buf, "\"name\":\"spawn\""));
+    assert(strstr(buf, "\"name\":\"run\""));
+    assert(strstr(buf, "\"name\":\"exit\""));
+    assert(strstr(buf, "\"name\":\"poll\""));
+    assert(strstr(buf, "\"reason\":\"timer\""));
+    assert(strstr(buf, "\"reason\":\"chan\""));
+    assert(strstr(buf, "\"source\":\"timer\""));
+    assert(strstr(buf, "\"source\":\"chan\""));
+    assert(!strstr(buf, "\"reason\":\"yield\""));
+    free(buf);
+
+    /* Old events are overwritten. */
+    rc = trace_start(4);
+    errno_assert(rc == 0);
+    int i;
+    for(i = 0; i != 100; ++i) {
+        rc = yield();
+        errno_assert(rc == 0);
+    }
+    fd = open("/dev/null", O_WRONLY);
+    errno_assert(fd >= 0);
+    rc = trace_dump(fd);
+    errno_assert(rc == 0);
+    rc = close(fd);
+    errno_assert(rc == 0);
+
+    rc = hclose(ch[1]);
+    errno_assert(rc == 0);
+    rc = hclose(ch[0]);
+    errno_assert(rc == 0);
+    return 0;
+}
+
@@ -0,0 +1,142 @@
+/*
+
+  Copyright (c) 2018 Martin Sustrik
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"),
+  to deal in the Software without restriction, including without limitation
+  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+  and/or sell copies of the Software, and to permit persons to whom
+  the Software is furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included
+  in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+  IN THE SOFTWARE.
+
+*/
+
+#include <stdint.h>
+#include <unistd.h>
+
+#include "assert.h"
+#include "../libdill.h"
+
+coroutine void sender(int ch) {
+    int val = 42;
+    int rc = chsend(ch, &val, sizeof(val), -1);
+    errno_assert(rc == 0);
+}
+
+coroutine void reader(int fd) {
+    int rc = fdin(fd, -1);
+    errno_assert(rc == 0);
+}
+
+coroutine void sleeper(void) {
+    int rc = msleep(-1);
+    assert(rc == -1 && errno == ECANCELED);
+}
+
+static uint64_t count(int source) {
+    struct wakehist hist;
+    int rc = wakehist(source, &hist);
+    errno_assert(rc == 0);
+    uint64_t total = 0;
+    int i;
+    for(i = 0; i != WAKEHIST_NBUCKETS; ++i) {
+        if(i > 0) assert(hist.bounds_ns[i] >= hist.bounds_ns[i - 1]);
+        total += hist.counts[i];
+    }
+    assert(hist.bounds_ns[WAKEHIST_NBUCKETS - 1] == UINT64_MAX);
+    assert(total == hist.count);
+    assert(hist.max_ns * hist.count >= hist.sum_ns);
+    return hist.count;
+}
+
+int main(void) {
+    /* Invalid arguments. */
+    struct wakehist hist;
+    int rc = wakehist(-1, &hist);
+    assert(rc == -1 && errno == EINVAL);
+    rc = wakehist(WAKE_NSOURCES, &hist);
+    assert(rc == -1 && errno == EINVAL);
+    rc = wakehist(WAKE_FD, NULL);
+    assert(rc == -1 && errno == EINVAL);
+
+    /* Channel. */
+    int ch[2];
+    rc = chmake(ch);
+    errno_assert(rc == 0);
+    int h = go(sender(ch[0]));
+    errno_assert(h >= 0);
+    int val;
+    rc = chrecv(ch[1], &val, sizeof(val), -1);
+    errno_assert(rc == 0);
+    /* Let the sender run. */
+    rc = yield();
+    errno_assert(rc == 0);
+    assert(count(WAKE_CHAN) == 1);
+    rc = hclose(h);
+    errno_assert(rc == 0);
+
+    /* Timer. */
+    rc = msleep(now() + 1);
+    errno_assert(rc == 0);
+    assert(count(WAKE_TIMER) == 1);
+
+    /* File descriptor. */
+    int fds[2];
+    rc = pipe(fds);
+    errno_assert(rc == 0);
+    h = go(reader(fds[0]));
+    errno_assert(h >= 0);
+    ssize_t sz = write(fds[1], "A", 1);
+    errno_assert(sz == 1);
+    rc = msleep(now() + 10);
+    errno_assert(rc == 0);
+    assert(count(WAKE_FD) == 1);
+    rc = hclose(h);
+    errno_assert(rc == 0);
+    rc = fdclean(fds[0]);
+    errno_assert(rc == 0);
+    close(fds[0]);
+    close(fds[1]);
+
+    /* Cancellation. */
+    h = go(sleeper());
+    errno_assert(h >= 0);
+    rc = hclose(h);
+    errno_assert(rc == 0);
+    assert(count(WAKE_CANCEL) >= 1);
+
+    /* Yielding and launching a coroutine. */
+    uint64_t other = count(WAKE_OTHER);
+    rc = yield();
+    errno_assert(rc == 0);
+    assert(count(WAKE_OTHER) == other + 1);
+    h = go(sleeper());
+    errno_assert(h >= 0);
+    assert(count(WAKE_OTHER) == other + 2);
+    rc = hclose(h);
+    errno_assert(rc == 0);
+
+    /* Reset. */
+    rc = wakehist_reset();
+    errno_assert(rc == 0);
+    int i;
+    for(i = 0; i != WAKE_NSOURCES; ++i) assert(count(i) == 0);
+
+    rc = hclose(ch[1]);
+    errno_assert(rc == 0);
+    rc = hclose(ch[0]);
+    errno_assert(rc == 0);
+    return 0;
+}
+
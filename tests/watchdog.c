@@ -0,0 +1,122 @@
+/*
+
+  Copyright (c) 2016 Martin Sustrik
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"),
+  to deal in the Software without restriction, including without limitation
+  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+  and/or sell copies of the Software, and to permit persons to whom
+  the Software is furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included
+  in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+  IN THE SOFTWARE.
+
+*/
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "assert.h"
+#include "../libdill.h"
+
+/* Hogs the CPU without getting back to the scheduler. */
+static void spin(int ms) {
+    int64_t deadline = now() + ms;
+    volatile uint64_t n = 0;
+    while(now() < deadline) ++n;
+}
+
+coroutine void staller(int ms) {
+    spin(ms);
+}
+
+/* Reads everything available from the pipe. */
+static size_t drain(int fd, char *buf, size_t len) {
+    size_t pos = 0;
+    while(pos < len - 1) {
+        ssize_t sz = read(fd, buf + pos, len - 1 - pos);
+        if(sz <= 0) break;
+        pos += sz;
+    }
+    buf[pos] = 0;
+    return pos;
+}
+
+int main(void) {
+    int p[2];
+    int rc = pipe(p);
+    errno_assert(rc == 0);
+    rc = fcntl(p[0], F_SETFL, O_NONBLOCK);
+    errno_assert(rc == 0);
+    static char buf[65536];
+
+    /* Invalid arguments. */
+    rc = watchdog_start(0, p[1]);
+    assert(rc == -1 && errno == EINVAL);
+    rc = watchdog_start(50, -1);
+    assert(rc == -1 && errno == EINVAL);
+    /* Stopping the watchdog that's not running is a no-op. */
+    rc = watchdog_stop();
+    errno_assert(rc == 0);
+
+    rc = watchdog_start(50, p[1]);
+    if(rc < 0 && errno == ENOTSUP) return 0;
+    errno_assert(rc == 0);
+    rc = watchdog_start(50, p[1]);
+    assert(rc == -1 && errno == EBUSY);
+
+    /* Waiting for events is not a stall. */
+    rc = msleep(now() + 200);
+    errno_assert(rc == 0);
+    assert(drain(p[0], buf, sizeof(buf)) == 0);
+
+    /* A coroutine stalls the thread. */
+    int goline = __LINE__ + 1;
+    int h = go(staller(200));
+    errno_assert(h >= 0);
+    assert(drain(p[0], buf, sizeof(buf)) > 0);
+    assert(strstr(buf, "libdill: thread stalled for "));
+    char site[256];
+    snprintf(site, sizeof(site), "launched at %s:%d\n", __FILE__, goline);
+    assert(strstr(buf, site));
+    /* The stall is reported only once. */
+    assert(!strstr(strstr(buf, "libdill: thread stalled") + 1,
+        "libdill: thread stalled"));
+    rc = hclose(h);
+    errno_assert(rc == 0);
+
+    /* The main coroutine stalls the thread. */
+    spin(200);
+    assert(drain(p[0], buf, sizeof(buf)) > 0);
+    assert(strstr(buf, "in main coroutine\n"));
+
+    rc = watchdog_stop();
+    errno_assert(rc == 0);
+    spin(200);
+    assert(drain(p[0], buf, sizeof(buf)) == 0);
+
+    /* The watchdog can be restarted. */
+    rc = watchdog_start(1000, p[1]);
+    errno_assert(rc == 0);
+    rc = watchdog_stop();
+    errno_assert(rc == 0);
+
+    rc = close(p[0]);
+    errno_assert(rc == 0);
+    rc = close(p[1]);
+    errno_assert(rc == 0);
+    return 0;
+}
+
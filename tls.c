@@ -31,6 +31,9 @@
 
 #define DILL_DISABLE_RAW_NAMES
 #include "libdillimpl.h"
+#include "probes.h"
+#include "slab.h"
+#include "sockstats.h"
 #include "utils.h"
 
 #define DILL_TLS_BUFSIZE 2048
@@ -44,6 +47,7 @@ struct dill_tls_sock {
     SSL *ssl;
     int u;
     int64_t deadline;
+    struct dill_sockstats stats;
     unsigned int indone : 1;
     unsigned int outdone: 1;
     unsigned int inerr : 1;
@@ -68,6 +72,7 @@ static void *dill_tls_hquery(struct dill_hvfs *hvfs, const void *type) {
     struct dill_tls_sock *self = (struct dill_tls_sock*)hvfs;
     if(type == dill_bsock_type) return &self->bvfs;
     if(type == dill_tls_type) return self;
+    if(type == dill_sockstats_type) return &self->stats;
     errno = ENOTSUP;
     return NULL;
 }
@@ -107,6 +112,7 @@ int dill_tls_attach_client_mem(int s, struct dill_tls_storage *mem,
     self->ssl = ssl;
     self->u = s;
     self->deadline = -1;
+    dill_sockstats_init(&self->stats, -1, s);
     self->indone = 0;
     self->outdone = 0;
     self->inerr = 0;
@@ -116,6 +122,7 @@ int dill_tls_attach_client_mem(int s, struct dill_tls_storage *mem,
     while(1) {
         ERR_clear_error();
         int rc = SSL_connect(ssl);
+        dill_probe2(tls_handshake, 0, rc);
         if(dill_tls_followup(self, rc)) break;
         if(dill_slow(errno != 0)) {err = errno; goto error4;}
     }
@@ -137,7 +144,7 @@ error1:
 
 int dill_tls_attach_client(int s, int64_t deadline) {
     int err;
-    struct dill_tls_sock *obj = malloc(sizeof(struct dill_tls_sock));
+    struct dill_tls_sock *obj = dill_slab_alloc(sizeof(struct dill_tls_sock));
     if(dill_slow(!obj)) {err = ENOMEM; goto error1;}
     s = dill_tls_attach_client_mem(s, (struct dill_tls_storage*)obj,
         deadline);
@@ -145,7 +152,7 @@ int dill_tls_attach_client(int s, int64_t deadline) {
     obj->mem = 0;
     return s;
 error2:
-    free(obj);
+    dill_slab_free(obj, sizeof(struct dill_tls_sock));
 error1:
     if(s >= 0) dill_hclose(s);
     errno = err;
@@ -193,6 +200,7 @@ int dill_tls_attach_server_mem(int s, const char *cert, const char *pkey,
     self->ssl = ssl;
     self->u = s;
     self->deadline = -1;
+    dill_sockstats_init(&self->stats, -1, s);
     self->indone = 0;
     self->outdone = 0;
     self->inerr = 0;
@@ -202,6 +210,7 @@ int dill_tls_attach_server_mem(int s, const char *cert, const char *pkey,
     while(1) {
         ERR_clear_error();
         rc = SSL_accept(ssl);
+        dill_probe2(tls_handshake, 1, rc);
         if(dill_tls_followup(self, rc)) break;
         if(dill_slow(errno != 0)) {err = errno; goto error4;}
     }
@@ -224,7 +233,7 @@ error1:
 int dill_tls_attach_server(int s, const char *cert, const char *pkey,
       int64_t deadline) {
     int err;
-    struct dill_tls_sock *obj = malloc(sizeof(struct dill_tls_sock));
+    struct dill_tls_sock *obj = dill_slab_alloc(sizeof(struct dill_tls_sock));
     if(dill_slow(!obj)) {err = ENOMEM; goto error1;}
     s = dill_tls_attach_server_mem(s, cert, pkey,
         (struct dill_tls_storage*)obj, deadline);
@@ -232,7 +241,7 @@ int dill_tls_attach_server(int s, const char *cert, const char *pkey,
     obj->mem = 0;
     return s;
 error2:
-    free(obj);
+    dill_slab_free(obj, sizeof(struct dill_tls_sock));
 error1:
     if(s >= 0) dill_hclose(s);
     errno = err;
@@ -247,6 +256,7 @@ int dill_tls_done(int s, int64_t deadline) {
     while(1) {
         ERR_clear_error();
         int rc = SSL_shutdown(self->ssl);
+        dill_probe1(tls_shutdown, rc);
         if(rc == 0) {self->outdone = 1; return 0;}
         if(rc == 1) {self->outdone = 1; self->indone = 1; return 0;}
         if(dill_tls_followup(self, rc)) break;
@@ -271,6 +281,7 @@ int dill_tls_detach(int s, int64_t deadline) {
         while(1) {
             ERR_clear_error();
             int rc = SSL_shutdown(self->ssl);
+            dill_probe1(tls_shutdown, rc);
             if(rc == 1) break;
             if(dill_tls_followup(self, rc)) {err = errno; goto error;}
         }
@@ -307,9 +318,11 @@ static int dill_tls_bsendl(struct dill_bsock_vfs *bvfs,
                 len -= rc;
             }
         }
+        self->stats.bytes_out += it->iol_len;
         if(it == last) break;
         it = it->iol_next;
     }
+    self->stats.msgs_out++;
     return 0;
 }
 
@@ -337,9 +350,11 @@ static int dill_tls_brecvl(struct dill_bsock_vfs *bvfs,
                 len -= rc;
             }
         }
+        self->stats.bytes_in += it->iol_len;
         if(it == last) break;
         it = it->iol_next;
     }
+    self->stats.msgs_in++;
     return 0;
 }
 
@@ -351,7 +366,7 @@ static void dill_tls_hclose(struct dill_hvfs *hvfs) {
         int rc = dill_hclose(self->u);
         dill_assert(rc == 0);
     }
-    if(!self->mem) free(self);
+    if(!self->mem) dill_slab_free(self, sizeof(struct dill_tls_sock));
 }
 
 /******************************************************************************/
@@ -0,0 +1,272 @@
+/*
+
+  Copyright (c) 2016 Martin Sustrik
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"),
+  to deal in the Software without restriction, including without limitation
+  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+  and/or sell copies of the Software, and to permit persons to whom
+  the Software is furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included
+  in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+  IN THE SOFTWARE.
+
+*/
+
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "alloc.h"
+#include "cr.h"
+#include "ctx.h"
+#include "trace.h"
+#include "utils.h"
+
+#define DILL_DISABLE_RAW_NAMES
+#include "libdill.h"
+
+int dill_ctx_trace_init(struct dill_ctx_trace *ctx) {
+    ctx->on = 0;
+    ctx->events = NULL;
+    ctx->capacity = 0;
+    ctx->head = 0;
+    ctx->start_ts = 0;
+    return 0;
+}
+
+void dill_ctx_trace_term(struct dill_ctx_trace *ctx) {
+    dill_free(ctx->events, ctx->capacity * sizeof(struct dill_trace_event),
+        DILL_ALLOC_OTHER);
+    ctx->events = NULL;
+    ctx->on = 0;
+}
+
+void dill_trace_(struct dill_ctx_trace *ctx, int type, uint32_t cr,
+      int64_t arg) {
+    struct dill_trace_event *ev =
+        &ctx->events[ctx->head & (ctx->capacity - 1)];
+    ev->ts = dill_ticks();
+    ev->arg = arg;
+    ev->cr = cr;
+    ev->type = type;
+    ++ctx->head;
+}
+
+int dill_trace_start(size_t nevents) {
+    struct dill_ctx_trace *ctx = &dill_getctx->trace;
+    if(dill_slow(nevents == 0 || nevents > SIZE_MAX / 2 /
+          sizeof(struct dill_trace_event))) {errno = EINVAL; return -1;}
+    size_t capacity = 1;
+    while(capacity < nevents) capacity *= 2;
+    if(capacity != ctx->capacity) {
+        struct dill_trace_event *events = dill_alloc(
+            capacity * sizeof(struct dill_trace_event), DILL_ALLOC_OTHER);
+        if(dill_slow(!events)) return -1;
+        dill_ctx_trace_term(ctx);
+        ctx->events = events;
+        ctx->capacity = capacity;
+    }
+    ctx->head = 0;
+    ctx->start_ts = dill_ticks();
+    ctx->on = 1;
+    return 0;
+}
+
+int dill_trace_stop(void) {
+    struct dill_ctx_trace *ctx = &dill_getctx->trace;
+    ctx->on = 0;
+    return 0;
+}
+
+/******************************************************************************/
+/*  Export to Chrome JSON trace format.                                       */
+/******************************************************************************/
+
+/* Coroutines are rendered as threads of a single process. Polling gets
+   a separate pseudo-thread. */
+#define DILL_TRACE_POLLTID -1
+
+struct dill_trace_out {
+    int fd;
+    size_t len;
+    /* Set once there's at least one event in the output. */
+    int comma;
+    char buf[4096];
+};
+
+static int dill_trace_flush(struct dill_trace_out *out) {
+    size_t pos = 0;
+    while(pos < out->len) {
+        ssize_t sz = write(out->fd, out->buf + pos, out->len - pos);
+        if(dill_slow(sz < 0)) {
+            if(errno == EINTR) continue;
+            return -1;
+        }
+        pos += sz;
+    }
+    out->len = 0;
+    return 0;
+}
+
+static int dill_trace_print(struct dill_trace_out *out, const char *fmt, ...)
+    __attribute__((format(printf, 2, 3)));
+
+static int dill_trace_print(struct dill_trace_out *out, const char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    int sz = vsnprintf(out->buf + out->len, sizeof(out->buf) - out->len,
+        fmt, ap);
+    va_end(ap);
+    dill_assert(sz >= 0 && sz < 1024);
+    out->len += sz;
+    if(out->len > sizeof(out->buf) - 1024) return dill_trace_flush(out);
+    return 0;
+}
+
+/* Prints an event, except for the closing brace, so that the caller can
+   append more fields. */
+static int dill_trace_event(struct dill_trace_out *out, const char *name,
+      const char *ph, int64_t tid, double ts) {
+    int rc = dill_trace_print(out,
+        "%s\n{\"name\":\"%s\",\"ph\":\"%s\",\"pid\":%d,\"tid\":%lld,"
+        "\"ts\":%.3f", out->comma ? "," : "", name, ph, (int)getpid(),
+        (long long)tid, ts);
+    out->comma = 1;
+    return rc;
+}
+
+/* Running time of a coroutine is rendered as a complete event spanning
+   from the switch to the coroutine till it blocks, exits or another
+   switch happens. */
+static int dill_trace_run(struct dill_trace_out *out, int *running,
+      uint32_t cr, double start, double end) {
+    if(!*running) return 0;
+    *running = 0;
+    int rc = dill_trace_event(out, "run", "X", cr, start);
+    if(dill_slow(rc < 0)) return -1;
+    return dill_trace_print(out, ",\"dur\":%.3f}", end - start);
+}
+
+static const char *dill_trace_kind(int kind) {
+    switch(kind) {
+    case DILL_CLAUSE_FDIN: return "fdin";
+    case DILL_CLAUSE_FDOUT: return "fdout";
+    case DILL_CLAUSE_CHAN: return "chan";
+    case DILL_CLAUSE_TIMER: return "timer";
+    case DILL_CLAUSE_SYNC: return "sync";
+    case DILL_TRACE_CANCEL: return "cancel";
+    default: return "other";
+    }
+}
+
+int dill_trace_dump(int fd) {
+    struct dill_ctx_trace *ctx = &dill_getctx->trace;
+    if(dill_slow(fd < 0 || !ctx->events)) {errno = EINVAL; return -1;}
+    uint64_t now_ts = dill_ticks();
+    double scale = dill_ticks_scale();
+    struct dill_trace_out out;
+    out.fd = fd;
+    out.len = 0;
+    out.comma = 0;
+    int rc = dill_trace_print(&out, "{\"traceEvents\":[");
+    if(dill_slow(rc < 0)) return -1;
+    rc = dill_trace_event(&out, "thread_name", "M", DILL_TRACE_POLLTID, 0);
+    if(dill_slow(rc < 0)) return -1;
+    rc = dill_trace_print(&out, ",\"args\":{\"name\":\"poll\"}}");
+    if(dill_slow(rc < 0)) return -1;
+    uint64_t n = ctx->head < ctx->capacity ? ctx->head : ctx->capacity;
+    uint64_t i;
+    /* The coroutine that is running and since when. */
+    int running = 0;
+    uint32_t rcr = 0;
+    double rts = 0;
+    double dur;
+    for(i = ctx->head - n; i != ctx->head; ++i) {
+        struct dill_trace_event *ev = &ctx->events[i & (ctx->capacity - 1)];
+        /* Microseconds since the start of the trace. */
+        double ts = ((double)(int64_t)(ev->ts - ctx->start_ts)) * scale /
+            1000.0;
+        switch(ev->type) {
+        case DILL_TRACE_SPAWN:
+            rc = dill_trace_event(&out, "spawn", "i", ev->arg, ts);
+            if(dill_slow(rc < 0)) return -1;
+            rc = dill_trace_print(&out, ",\"s\":\"t\",\"args\":{\"cr\":%u}}",
+                (unsigned)ev->cr);
+            break;
+        case DILL_TRACE_EXIT:
+            rc = dill_trace_run(&out, &running, rcr, rts, ts);
+            if(dill_slow(rc < 0)) return -1;
+            rc = dill_trace_event(&out, "exit", "i", ev->cr, ts);
+            if(dill_slow(rc < 0)) return -1;
+            rc = dill_trace_print(&out, ",\"s\":\"t\"}");
+            break;
+        case DILL_TRACE_SWITCH:
+            rc = dill_trace_run(&out, &running, rcr, rts, ts);
+            if(dill_slow(rc < 0)) return -1;
+            running = 1;
+            rcr = ev->cr;
+            rts = ts;
+            break;
+        case DILL_TRACE_BLOCK:
+            rc = dill_trace_run(&out, &running, rcr, rts, ts);
+            if(dill_slow(rc < 0)) return -1;
+            rc = dill_trace_event(&out, "block", "i", ev->cr, ts);
+            if(dill_slow(rc < 0)) return -1;
+            rc = dill_trace_print(&out, ",\"s\":\"t\",\"args\":{\"reason\":\"");
+            if(dill_slow(rc < 0)) return -1;
+            if(!ev->arg) {
+                rc = dill_trace_print(&out, "yield");
+                if(dill_slow(rc < 0)) return -1;
+            }
+            int kind;
+            int first = 1;
+            for(kind = 0; kind != 64; ++kind) {
+                if(!(ev->arg & ((int64_t)1 << kind))) continue;
+                rc = dill_trace_print(&out, "%s%s", first ? "" : "|",
+                    dill_trace_kind(kind));
+                if(dill_slow(rc < 0)) return -1;
+                first = 0;
+            }
+            rc = dill_trace_print(&out, "\"}}");
+            break;
+        case DILL_TRACE_WAKE:
+            rc = dill_trace_event(&out, "wake", "i", ev->cr, ts);
+            if(dill_slow(rc < 0)) return -1;
+            rc = dill_trace_print(&out,
+                ",\"s\":\"t\",\"args\":{\"source\":\"%s\"}}",
+                dill_trace_kind((int)ev->arg));
+            break;
+        case DILL_TRACE_POLL:
+            /* The event is recorded when the poll finishes. */
+            dur = ((double)ev->arg) * scale / 1000.0;
+            rc = dill_trace_event(&out, "poll", "X", DILL_TRACE_POLLTID,
+                ts - dur);
+            if(dill_slow(rc < 0)) return -1;
+            rc = dill_trace_print(&out, ",\"dur\":%.3f}", dur);
+            break;
+        default:
+            dill_assert(0);
+        }
+        if(dill_slow(rc < 0)) return -1;
+    }
+    /* The coroutine doing the dump is still running. */
+    rc = dill_trace_run(&out, &running, rcr, rts,
+        ((double)(int64_t)(now_ts - ctx->start_ts)) * scale / 1000.0);
+    if(dill_slow(rc < 0)) return -1;
+    rc = dill_trace_print(&out, "\n]}\n");
+    if(dill_slow(rc < 0)) return -1;
+    return dill_trace_flush(&out);
+}
+
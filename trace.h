@@ -0,0 +1,84 @@
+/*
+
+  Copyright (c) 2016 Martin Sustrik
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"),
+  to deal in the Software without restriction, including without limitation
+  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+  and/or sell copies of the Software, and to permit persons to whom
+  the Software is furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included
+  in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+  IN THE SOFTWARE.
+
+*/
+
+#ifndef DILL_TRACE_INCLUDED
+#define DILL_TRACE_INCLUDED
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "now.h"
+#include "utils.h"
+
+/* Types of trace events. */
+#define DILL_TRACE_SPAWN 1
+#define DILL_TRACE_EXIT 2
+#define DILL_TRACE_SWITCH 3
+#define DILL_TRACE_BLOCK 4
+#define DILL_TRACE_WAKE 5
+#define DILL_TRACE_POLL 6
+
+/* Wake source of a coroutine that was canceled rather than triggered. */
+#define DILL_TRACE_CANCEL -1
+
+struct dill_trace_event {
+    /* Timestamp as returned by dill_ticks(). */
+    uint64_t ts;
+    /* SPAWN: serial number of the parent coroutine.
+       BLOCK: bitmask of kinds of clauses the coroutine is waiting for.
+       WAKE: kind of the triggered clause or DILL_TRACE_CANCEL.
+       POLL: duration of the poll.
+       Unused otherwise. */
+    int64_t arg;
+    /* Serial number of the coroutine the event relates to. */
+    uint32_t cr;
+    uint32_t type;
+};
+
+struct dill_ctx_trace {
+    /* 1 if the events are being recorded. */
+    int on;
+    /* Ring buffer of events. Capacity is a power of two. */
+    struct dill_trace_event *events;
+    size_t capacity;
+    /* Number of events recorded so far. Older events are overwritten. */
+    uint64_t head;
+    /* Timestamp when tracing started. */
+    uint64_t start_ts;
+};
+
+int dill_ctx_trace_init(struct dill_ctx_trace *ctx);
+void dill_ctx_trace_term(struct dill_ctx_trace *ctx);
+
+void dill_trace_(struct dill_ctx_trace *ctx, int type, uint32_t cr,
+    int64_t arg);
+
+/* Records an event if tracing is switched on. */
+#define dill_trace(ctx, type, cr, arg) \
+    do {\
+        if(dill_slow((ctx)->on)) dill_trace_((ctx), (type), (cr), (arg));\
+    } while(0)
+
+#endif
+
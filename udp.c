@@ -29,8 +29,12 @@
 
 #define DILL_DISABLE_RAW_NAMES
 #include "libdillimpl.h"
+#include "ctx.h"
 #include "fd.h"
 #include "iol.h"
+#include "probes.h"
+#include "slab.h"
+#include "sockstats.h"
 #include "utils.h"
 
 dill_unique_id(dill_udp_type);
@@ -47,6 +51,7 @@ struct dill_udp_sock {
     struct dill_msock_vfs mvfs;
     int fd;
     struct dill_ipaddr remote;
+    struct dill_sockstats stats;
     unsigned int busy : 1;
     unsigned int hasremote : 1;
     unsigned int mem : 1;
@@ -58,6 +63,7 @@ static void *dill_udp_hquery(struct dill_hvfs *hvfs, const void *type) {
     struct dill_udp_sock *obj = (struct dill_udp_sock*)hvfs;
     if(type == dill_msock_type) return &obj->mvfs;
     if(type == dill_udp_type) return obj;
+    if(type == dill_sockstats_type) return &obj->stats;
     errno = ENOTSUP;
     return NULL;
 }
@@ -103,6 +109,7 @@ int dill_udp_open_mem(struct dill_ipaddr *local,
     obj->hasremote = remote ? 1 : 0;
     obj->mem = 1;
     if(remote) obj->remote = *remote;
+    dill_sockstats_init(&obj->stats, s, -1);
     /* Create the handle. */
     int h = dill_hmake(&obj->hvfs);
     if(dill_slow(h < 0)) {err = errno; goto error2;}
@@ -116,14 +123,14 @@ error1:
 
 int dill_udp_open(struct dill_ipaddr *local, const struct dill_ipaddr *remote) {
     int err;
-    struct dill_udp_sock *obj = malloc(sizeof(struct dill_udp_sock));
+    struct dill_udp_sock *obj = dill_slab_alloc(sizeof(struct dill_udp_sock));
     if(dill_slow(!obj)) {err = ENOMEM; goto error1;}
     int s = dill_udp_open_mem(local, remote, (struct dill_udp_storage*)obj);
     if(dill_slow(s < 0)) {err = errno; goto error2;}
     obj->mem = 0;
     return s;
 error2:
-    free(obj);
+    dill_slab_free(obj, sizeof(struct dill_udp_sock));
 error1:
     errno = err;
     return -1;
@@ -155,8 +162,19 @@ static int dill_udp_sendl_(struct dill_msock_vfs *mvfs,
     hdr.msg_iov = (struct iovec*)iov;
     hdr.msg_iovlen = niov;
     ssize_t sz = sendmsg(obj->fd, &hdr, 0);
-    if(dill_fast(sz >= 0)) return 0;
-    if(errno == EAGAIN || errno == EWOULDBLOCK) return 0;
+    obj->stats.syscalls++;
+    if(dill_fast(sz >= 0)) {
+        dill_getctx->fd.sent[DILL_STATS_UDP] += sz;
+        obj->stats.bytes_out += sz;
+        obj->stats.wire_out += sz;
+        obj->stats.msgs_out++;
+        dill_probe2(sock_send, DILL_STATS_UDP, sz);
+        return 0;
+    }
+    if(errno == EAGAIN || errno == EWOULDBLOCK) {
+        obj->stats.eagains++;
+        return 0;
+    }
     return -1;
 }
 
@@ -182,17 +200,24 @@ static ssize_t dill_udp_recvl_(struct dill_msock_vfs *mvfs,
     hdr.msg_iovlen = niov;
     while(1) {
         ssize_t sz = recvmsg(obj->fd, &hdr, 0);
+        obj->stats.syscalls++;
         if(sz >= 0) {
+            obj->stats.wire_in += sz;
             /* If remote IP address is specified we'll silently drop all
                packets coming from different addresses. */
             if(obj->hasremote && !dill_ipaddr_equal(&raddr, &obj->remote, 0))
                 continue;
             if(addr) *addr = raddr;
+            dill_getctx->fd.received[DILL_STATS_UDP] += sz;
+            obj->stats.bytes_in += sz;
+            obj->stats.msgs_in++;
+            dill_probe2(sock_recv, DILL_STATS_UDP, sz);
             return sz;
         }
         if(errno != EAGAIN && errno != EWOULDBLOCK) return -1;
+        obj->stats.eagains++;
         obj->busy = 1;
-        rc = dill_fdin(obj->fd, deadline);
+        rc = dill_sockstats_fdin(&obj->stats, obj->fd, deadline);
         obj->busy = 0;
         if(dill_slow(rc < 0)) return -1;
     }
@@ -247,6 +272,6 @@ static void dill_udp_hclose(struct dill_hvfs *hvfs) {
        outgoing packets rather than flushing them. The effect is balanced
        out by lingering when closing the socket. */
     dill_fd_close(obj->fd);
-    if(!obj->mem) free(obj);
+    if(!obj->mem) dill_slab_free(obj, sizeof(struct dill_udp_sock));
 }
 
@@ -0,0 +1,291 @@
+/*
+
+  Copyright (c) 2016 Martin Sustrik
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"),
+  to deal in the Software without restriction, including without limitation
+  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+  and/or sell copies of the Software, and to permit persons to whom
+  the Software is furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included
+  in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+  IN THE SOFTWARE.
+
+*/
+
+#include <errno.h>
+#include <signal.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#if defined HAVE_EXECINFO_H
+#include <execinfo.h>
+#endif
+
+#include "ctx.h"
+#include "now.h"
+#include "utils.h"
+#include "watchdog.h"
+
+#define DILL_DISABLE_RAW_NAMES
+#include "libdill.h"
+
+/* The signal used to interrupt a stalled thread. SIGURG is ignored by default
+   and is rarely used otherwise, so a stray one does no harm. */
+#define DILL_WATCHDOG_SIGNAL SIGURG
+
+#if defined DILL_THREADS
+/* Signal dispositions are per process, therefore only one thread can be
+   watched at a time. The signal handler can't use dill_getctx, which may try
+   to create a context, so the watched thread is published here instead. */
+static struct dill_ctx_watchdog *volatile dill_watchdog_owner = NULL;
+static pthread_t dill_watchdog_thread;
+static struct sigaction dill_watchdog_oldact;
+
+/* Restores the previous signal disposition and gives up the ownership. */
+static void dill_watchdog_uninstall(void) {
+    int rc = sigaction(DILL_WATCHDOG_SIGNAL, &dill_watchdog_oldact, NULL);
+    dill_assert(rc == 0);
+    dill_watchdog_owner = NULL;
+}
+#endif
+
+int dill_ctx_watchdog_init(struct dill_ctx_watchdog *ctx) {
+    ctx->running = 0;
+#if defined DILL_THREADS
+    int rc = pthread_mutex_init(&ctx->lock, NULL);
+    if(dill_slow(rc != 0)) {errno = rc; return -1;}
+    rc = pthread_cond_init(&ctx->cond, NULL);
+    if(dill_slow(rc != 0)) {
+        pthread_mutex_destroy(&ctx->lock);
+        errno = rc;
+        return -1;
+    }
+    ctx->stop = 0;
+#endif
+    ctx->threshold = 0;
+    ctx->fd = -1;
+    ctx->stalled = 0;
+    ctx->cr = NULL;
+    return 0;
+}
+
+#if defined DILL_THREADS
+
+static void dill_watchdog_stop_(struct dill_ctx_watchdog *ctx) {
+    if(!ctx->running) return;
+    int rc = pthread_mutex_lock(&ctx->lock);
+    dill_assert(rc == 0);
+    ctx->stop = 1;
+    rc = pthread_cond_signal(&ctx->cond);
+    dill_assert(rc == 0);
+    rc = pthread_mutex_unlock(&ctx->lock);
+    dill_assert(rc == 0);
+    rc = pthread_join(ctx->watcher, NULL);
+    dill_assert(rc == 0);
+    ctx->running = 0;
+    dill_watchdog_uninstall();
+}
+
+#endif
+
+void dill_ctx_watchdog_term(struct dill_ctx_watchdog *ctx) {
+#if defined DILL_THREADS
+    dill_watchdog_stop_(ctx);
+    pthread_cond_destroy(&ctx->cond);
+    pthread_mutex_destroy(&ctx->lock);
+#endif
+}
+
+void dill_ctx_watchdog_atfork(struct dill_ctx_watchdog *ctx) {
+#if defined DILL_THREADS
+    /* The watchdog thread is gone and the mutex may have been held by it. */
+    int rc = pthread_mutex_init(&ctx->lock, NULL);
+    dill_assert(rc == 0);
+    rc = pthread_cond_init(&ctx->cond, NULL);
+    dill_assert(rc == 0);
+    ctx->stop = 0;
+    if(dill_watchdog_owner == ctx) dill_watchdog_uninstall();
+#endif
+    ctx->running = 0;
+}
+
+#if defined DILL_THREADS
+
+/* Appends a string to the report. Only async-signal-safe code can be used
+   in the signal handler, therefore no snprintf(). */
+static size_t dill_watchdog_puts(char *buf, size_t pos, size_t len,
+      const char *s) {
+    while(*s && pos < len) buf[pos++] = *s++;
+    return pos;
+}
+
+static size_t dill_watchdog_putu(char *buf, size_t pos, size_t len,
+      uint64_t val) {
+    char digits[20];
+    int n = 0;
+    do {
+        digits[n++] = '0' + val % 10;
+        val /= 10;
+    } while(val);
+    while(n && pos < len) buf[pos++] = digits[--n];
+    return pos;
+}
+
+/* Executed by the stalled thread. */
+static void dill_watchdog_handler(int signo) {
+    struct dill_ctx_watchdog *ctx = dill_watchdog_owner;
+    if(!ctx || !ctx->running) return;
+    /* The signal was sent by someone else to a thread that's not being
+       watched. Its context may not even exist. */
+    if(!pthread_equal(pthread_self(), dill_watchdog_thread)) return;
+    int err = errno;
+    struct dill_cr *r = ctx->cr->r;
+    char buf[512];
+    size_t sz = dill_watchdog_puts(buf, 0, sizeof(buf),
+        "libdill: thread stalled for ");
+    sz = dill_watchdog_putu(buf, sz, sizeof(buf), ctx->stalled);
+    if(r->file) {
+        sz = dill_watchdog_puts(buf, sz, sizeof(buf), " ms in coroutine ");
+        sz = dill_watchdog_putu(buf, sz, sizeof(buf), r->serial);
+        sz = dill_watchdog_puts(buf, sz, sizeof(buf), " launched at ");
+        sz = dill_watchdog_puts(buf, sz, sizeof(buf), r->file);
+        sz = dill_watchdog_puts(buf, sz, sizeof(buf), ":");
+        sz = dill_watchdog_putu(buf, sz, sizeof(buf), r->line);
+        sz = dill_watchdog_puts(buf, sz, sizeof(buf), "\n");
+    }
+    else {
+        sz = dill_watchdog_puts(buf, sz, sizeof(buf),
+            " ms in main coroutine\n");
+    }
+    ssize_t nbytes = write(ctx->fd, buf, sz);
+    (void)nbytes;
+#if defined HAVE_EXECINFO_H
+    void *frames[64];
+    int nframes = backtrace(frames, sizeof(frames) / sizeof(frames[0]));
+    backtrace_symbols_fd(frames, nframes, ctx->fd);
+#endif
+    errno = err;
+}
+
+static int dill_watchdog_install(void) {
+#if defined HAVE_EXECINFO_H
+    /* The first call to backtrace() loads libgcc, which allocates memory
+       and is thus not safe to do in the signal handler. */
+    static int preloaded = 0;
+    if(!preloaded) {
+        void *frame;
+        backtrace(&frame, 1);
+        preloaded = 1;
+    }
+#endif
+    struct sigaction act;
+    memset(&act, 0, sizeof(act));
+    act.sa_handler = dill_watchdog_handler;
+    act.sa_flags = SA_RESTART;
+    sigemptyset(&act.sa_mask);
+    return sigaction(DILL_WATCHDOG_SIGNAL, &act, &dill_watchdog_oldact);
+}
+
+/* Number of times the watched thread has got back to the scheduler. */
+static uint64_t dill_watchdog_heartbeat(struct dill_ctx_watchdog *ctx) {
+    return __atomic_load_n(&ctx->cr->switches, __ATOMIC_RELAXED) +
+        __atomic_load_n(&ctx->cr->polls, __ATOMIC_RELAXED);
+}
+
+static void *dill_watchdog_run(void *arg) {
+    struct dill_ctx_watchdog *ctx = arg;
+    /* Check four times per threshold period. */
+    int64_t period = ctx->threshold / 4;
+    if(period < 1) period = 1;
+    uint64_t heartbeat = dill_watchdog_heartbeat(ctx);
+    int64_t since = dill_mnow();
+    int reported = 0;
+    int rc = pthread_mutex_lock(&ctx->lock);
+    dill_assert(rc == 0);
+    while(!ctx->stop) {
+        struct timespec ts;
+        rc = clock_gettime(CLOCK_REALTIME, &ts);
+        dill_assert(rc == 0);
+        ts.tv_sec += period / 1000;
+        ts.tv_nsec += (period % 1000) * 1000000;
+        if(ts.tv_nsec >= 1000000000) {
+            ++ts.tv_sec;
+            ts.tv_nsec -= 1000000000;
+        }
+        rc = pthread_cond_timedwait(&ctx->cond, &ctx->lock, &ts);
+        dill_assert(rc == 0 || rc == ETIMEDOUT);
+        if(ctx->stop) break;
+        int64_t nw = dill_mnow();
+        uint64_t hb = dill_watchdog_heartbeat(ctx);
+        /* Waiting for events in the pollset doesn't count as a stall. */
+        if(hb != heartbeat ||
+              __atomic_load_n(&ctx->cr->polling, __ATOMIC_RELAXED)) {
+            heartbeat = hb;
+            since = nw;
+            reported = 0;
+            continue;
+        }
+        /* Report each stall only once. */
+        if(!reported && nw - since >= ctx->threshold) {
+            ctx->stalled = nw - since;
+            rc = pthread_kill(dill_watchdog_thread, DILL_WATCHDOG_SIGNAL);
+            dill_assert(rc == 0);
+            reported = 1;
+        }
+    }
+    rc = pthread_mutex_unlock(&ctx->lock);
+    dill_assert(rc == 0);
+    return NULL;
+}
+
+#endif
+
+int dill_watchdog_start(int64_t threshold, int fd) {
+#if defined DILL_THREADS
+    struct dill_ctx *c = dill_getctx;
+    struct dill_ctx_watchdog *ctx = &c->watchdog;
+    if(dill_slow(threshold <= 0 || fd < 0)) {errno = EINVAL; return -1;}
+    if(dill_slow(!__sync_bool_compare_and_swap(&dill_watchdog_owner,
+          NULL, ctx))) {
+        errno = EBUSY; return -1;}
+    ctx->threshold = threshold;
+    ctx->fd = fd;
+    ctx->cr = &c->cr;
+    ctx->stop = 0;
+    dill_watchdog_thread = pthread_self();
+    int rc = dill_watchdog_install();
+    if(dill_slow(rc < 0)) {dill_watchdog_owner = NULL; return -1;}
+    /* The flag has to be set before the watchdog can signal the thread. */
+    ctx->running = 1;
+    rc = pthread_create(&ctx->watcher, NULL, dill_watchdog_run, ctx);
+    if(dill_slow(rc != 0)) {
+        ctx->running = 0;
+        dill_watchdog_uninstall();
+        errno = rc;
+        return -1;
+    }
+    return 0;
+#else
+    errno = ENOTSUP;
+    return -1;
+#endif
+}
+
+int dill_watchdog_stop(void) {
+#if defined DILL_THREADS
+    dill_watchdog_stop_(&dill_getctx->watchdog);
+#endif
+    return 0;
+}
+
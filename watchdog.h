@@ -0,0 +1,65 @@
+/*
+
+  Copyright (c) 2016 Martin Sustrik
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"),
+  to deal in the Software without restriction, including without limitation
+  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+  and/or sell copies of the Software, and to permit persons to whom
+  the Software is furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included
+  in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+  IN THE SOFTWARE.
+
+*/
+
+#ifndef DILL_WATCHDOG_INCLUDED
+#define DILL_WATCHDOG_INCLUDED
+
+#include <stdint.h>
+
+#if defined DILL_THREADS
+#include <pthread.h>
+#endif
+
+#include "cr.h"
+
+struct dill_ctx_watchdog {
+    /* 1 if the watchdog thread is running. */
+    int running;
+#if defined DILL_THREADS
+    /* The watchdog thread. */
+    pthread_t watcher;
+    /* Used to wake the watchdog thread up when it's being stopped. */
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int stop;
+#endif
+    /* Stall threshold in milliseconds. */
+    int64_t threshold;
+    /* Where to write the reports. */
+    int fd;
+    /* Duration of the stall being reported, in milliseconds. Passed from
+       the watchdog thread to the signal handler. */
+    volatile int64_t stalled;
+    /* Scheduler state of the watched thread. */
+    struct dill_ctx_cr *cr;
+};
+
+int dill_ctx_watchdog_init(struct dill_ctx_watchdog *ctx);
+void dill_ctx_watchdog_term(struct dill_ctx_watchdog *ctx);
+
+/* Forgets about the watchdog thread, which doesn't survive fork(). */
+void dill_ctx_watchdog_atfork(struct dill_ctx_watchdog *ctx);
+
+#endif
+
@@ -30,6 +30,8 @@
 #define DILL_DISABLE_RAW_NAMES
 #include "libdillimpl.h"
 #include "iol.h"
+#include "slab.h"
+#include "sockstats.h"
 #include "utils.h"
 
 dill_unique_id(dill_ws_type);
@@ -46,6 +48,7 @@ struct dill_ws_sock {
     uint16_t status;
     uint8_t msglen;
     uint8_t msg[128];
+    struct dill_sockstats stats;
 };
 
 DILL_CHECK_STORAGE(dill_ws_sock, dill_ws_storage)
@@ -61,6 +64,7 @@ static void *dill_ws_hquery(struct dill_hvfs *hvfs, const void *type) {
     struct dill_ws_sock *self = (struct dill_ws_sock*)hvfs;
     if(type == dill_msock_type) return &self->mvfs;
     if(type == dill_ws_type) return self;
+    if(type == dill_sockstats_type) return &self->stats;
     errno = ENOTSUP;
     return NULL;
 }
@@ -79,6 +83,7 @@ int dill_ws_attach_client_mem(int s, int flags, const char *resource,
     self->mvfs.msendl = dill_ws_msendl;
     self->mvfs.mrecvl = dill_ws_mrecvl;
     self->u = s;
+    dill_sockstats_init(&self->stats, -1, s);
     self->flags = flags;
     self->indone = 0;
     self->outdone = 0;
@@ -170,7 +175,7 @@ error:
 int dill_ws_attach_client(int s, int flags, const char *resource,
       const char *host, int64_t deadline) {
     int err;
-    struct dill_ws_sock *obj = malloc(sizeof(struct dill_ws_sock));
+    struct dill_ws_sock *obj = dill_slab_alloc(sizeof(struct dill_ws_sock));
     if(dill_slow(!obj)) {err = ENOMEM; goto error1;}
     s = dill_ws_attach_client_mem(s, flags, resource, host,
         (struct dill_ws_storage*)obj, deadline);
@@ -178,7 +183,7 @@ int dill_ws_attach_client(int s, int flags, const char *resource,
     obj->mem = 0;
     return s;
 error2:
-    free(obj);
+    dill_slab_free(obj, sizeof(struct dill_ws_sock));
 error1:
     if(s >= 0) dill_hclose(s);
     errno = err;
@@ -201,6 +206,7 @@ int dill_ws_attach_server_mem(int s, int flags,
     self->mvfs.msendl = dill_ws_msendl;
     self->mvfs.mrecvl = dill_ws_mrecvl;
     self->u = s;
+    dill_sockstats_init(&self->stats, -1, s);
     self->flags = flags;
     self->indone = 0;
     self->outdone = 0;
@@ -302,7 +308,7 @@ error:
 int dill_ws_attach_server(int s, int flags, char *resource, size_t resourcelen,
       char *host, size_t hostlen, int64_t deadline) {
     int err;
-    struct dill_ws_sock *obj = malloc(sizeof(struct dill_ws_sock));
+    struct dill_ws_sock *obj = dill_slab_alloc(sizeof(struct dill_ws_sock));
     if(dill_slow(!obj)) {err = ENOMEM; goto error1;}
     s = dill_ws_attach_server_mem(s, flags, resource, resourcelen,
         host, hostlen, (struct dill_ws_storage*)obj, deadline);
@@ -310,7 +316,7 @@ int dill_ws_attach_server(int s, int flags, char *resource, size_t resourcelen,
     obj->mem = 0;
     return s;
 error2:
-    free(obj);
+    dill_slab_free(obj, sizeof(struct dill_ws_sock));
 error1:
     if(s >= 0) dill_hclose(s);
     errno = err;
@@ -355,6 +361,8 @@ static int dill_ws_sendl_base(struct dill_msock_vfs *mvfs, uint8_t type,
     if(self->server) {
         rc = dill_bsendl(self->u, first, last, deadline);
         if(dill_slow(rc < 0)) return -1;
+        self->stats.bytes_out += len;
+        self->stats.msgs_out++;
         return 0;
     }
     /* On the client side, the payload has to be masked. */
@@ -369,6 +377,8 @@ static int dill_ws_sendl_base(struct dill_msock_vfs *mvfs, uint8_t type,
         }
         first = first->iol_next;
     }
+    self->stats.bytes_out += len;
+    self->stats.msgs_out++;
     return 0;
 }
 
@@ -468,6 +478,8 @@ static ssize_t dill_ws_recvl_base(struct dill_msock_vfs *mvfs, int *flags,
         errno = EPIPE;
         return -1;
     }
+    self->stats.bytes_in += res;
+    self->stats.msgs_in++;
     return res;
 }
 
@@ -557,7 +569,7 @@ int dill_ws_detach(int s, int status, const void *buf, size_t len,
         }
     }
     int u = self->u;
-    if(!self->mem) free(self);
+    if(!self->mem) dill_slab_free(self, sizeof(struct dill_ws_sock));
     return u;
 }
 
@@ -565,7 +577,7 @@ static void dill_ws_hclose(struct dill_hvfs *hvfs) {
     struct dill_ws_sock *self = (struct dill_ws_sock*)hvfs;
     int rc = dill_hclose(self->u);
     dill_assert(rc == 0);
-    if(!self->mem) free(self);
+    if(!self->mem) dill_slab_free(self, sizeof(struct dill_ws_sock));
 }
 
 ssize_t dill_ws_status(int s, int *status, void *buf, size_t len) {